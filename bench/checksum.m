@@ -0,0 +1,120 @@
+/* Checksum kernels, scalar vs. vector. Build with --simd=none, sse2 or avx2 and compare. */
+int   printf(...);
+uchar* malloc(long size);
+long  clock();
+
+uint sum_bytes_scalar(uchar* p, int n)
+{
+    uint sum = 0;
+    int  i   = 0;
+    while (i < n)
+    {
+        sum = sum + *(p + i);
+        i   = i + 1;
+    }
+    return sum;
+}
+
+uint sum_bytes_vector(uchar* p, int n)
+{
+    uint sum = 0;
+    int  i   = 0;
+    while (i + 16 <= n)
+    {
+        sum = sum + reduce_add(*(v16u8*) (p + i));
+        i   = i + 16;
+    }
+    while (i < n)
+    {
+        sum = sum + *(p + i);
+        i   = i + 1;
+    }
+    return sum;
+}
+
+int sum_ints_scalar(int* p, int n)
+{
+    int sum = 0;
+    int i   = 0;
+    while (i < n)
+    {
+        sum = sum + *(p + i);
+        i   = i + 1;
+    }
+    return sum;
+}
+
+int sum_ints_vector(int* p, int n)
+{
+    v4i32 acc = 0;
+    int   i   = 0;
+    while (i + 4 <= n)
+    {
+        acc = acc + *(v4i32*) (p + i);
+        i   = i + 4;
+    }
+    int sum = reduce_add(acc);
+    while (i < n)
+    {
+        sum = sum + *(p + i);
+        i   = i + 1;
+    }
+    return sum;
+}
+
+int main()
+{
+    int    n    = 1048576;
+    int    reps = 64;
+    uchar* data = malloc(n);
+    int    i    = 0;
+    while (i < n)
+    {
+        *(data + i) = i * 7 + 3;
+        i           = i + 1;
+    }
+
+    long start = clock();
+    uint a     = 0;
+    int  r     = 0;
+    while (r < reps)
+    {
+        a = a + sum_bytes_scalar(data, n);
+        r = r + 1;
+    }
+    long t_bytes_scalar = clock() - start;
+
+    start  = clock();
+    uint b = 0;
+    r      = 0;
+    while (r < reps)
+    {
+        b = b + sum_bytes_vector(data, n);
+        r = r + 1;
+    }
+    long t_bytes_vector = clock() - start;
+
+    start = clock();
+    int c = 0;
+    r     = 0;
+    while (r < reps)
+    {
+        c = c + sum_ints_scalar((int*) data, n / 4);
+        r = r + 1;
+    }
+    long t_ints_scalar = clock() - start;
+
+    start = clock();
+    int d = 0;
+    r     = 0;
+    while (r < reps)
+    {
+        d = d + sum_ints_vector((int*) data, n / 4);
+        r = r + 1;
+    }
+    long t_ints_vector = clock() - start;
+
+    printf("bytes: scalar %ld us, v16u8 %ld us (sums %u %u)\n", t_bytes_scalar, t_bytes_vector, a, b);
+    printf("ints:  scalar %ld us, v4i32 %ld us (sums %d %d)\n", t_ints_scalar, t_ints_vector, c, d);
+    return 0;
+}
@@ -0,0 +1,12 @@
+#!/bin/sh
+# Builds bench/checksum.m for each vector lowering and runs it.
+# Usage: bench/checksum.sh [path/to/cmicro]
+set -e
+CMICRO=${1:-cmicro/build/cmicro}
+DIR=$(dirname "$0")
+OUT=${TMPDIR:-/tmp}/cmicro-checksum
+for isa in none sse2 avx2; do
+    "$CMICRO" --simd=$isa -o "$OUT-$isa" "$DIR/checksum.m"
+    echo "== --simd=$isa"
+    "$OUT-$isa"
+done
@@ -0,0 +1,93 @@
+/* std.mem vs. the C library. bench/mem.sh builds this once per runtime and compares. */
+import std.mem;
+
+int    printf(...);
+uchar* malloc(long size);
+long   clock();
+
+long bench_memcpy(uchar* dst, uchar* src, ulong n, int reps)
+{
+    long start = clock();
+    int  r     = 0;
+    while (r < reps)
+    {
+        memcpy(dst + r % 8, src, n);
+        r = r + 1;
+    }
+    return clock() - start;
+}
+
+long bench_memset(uchar* dst, ulong n, int reps)
+{
+    long start = clock();
+    int  r     = 0;
+    while (r < reps)
+    {
+        memset(dst + r % 8, r, n);
+        r = r + 1;
+    }
+    return clock() - start;
+}
+
+long bench_memcmp(uchar* a, uchar* b, ulong n, int reps)
+{
+    long start = clock();
+    int  r     = 0;
+    int  sum   = 0;
+    while (r < reps)
+    {
+        sum = sum + memcmp(a, b, n);
+        r   = r + 1;
+    }
+    return clock() - start + sum;
+}
+
+long bench_strlen(uchar* s, int reps)
+{
+    long  start = clock();
+    int   r     = 0;
+    ulong len   = 0;
+    while (r < reps)
+    {
+        len = len + strlen((char*) (s + r % 8));
+        r   = r + 1;
+    }
+    return clock() - start + len % 1;
+}
+
+int main()
+{
+    ulong  max = 1048576;
+    uchar* a   = malloc(max + 64);
+    uchar* b   = malloc(max + 64);
+    ulong  i   = 0;
+    while (i < max + 64)
+    {
+        *(a + i) = i * 7 + 3;
+        *(b + i) = i * 7 + 3;
+        i        = i + 1;
+    }
+
+    printf("%8s %10s %10s %10s %10s\n", "size", "memcpy", "memset", "memcmp", "strlen");
+    ulong n = 8;
+    while (n <= max)
+    {
+        // Keep the bytes per size roughly constant.
+        int reps = 268435456 / (n + 64);
+        *(a + n + 8) = 0;
+        long t_cpy   = bench_memcpy(b, a, n, reps);
+        long t_set   = bench_memset(b, n, reps);
+        i            = 0;
+        while (i < n)
+        {
+            *(b + i) = *(a + i);
+            i        = i + 1;
+        }
+        long t_cmp   = bench_memcmp(a, b, n, reps);
+        long t_len   = bench_strlen(a, reps);
+        *(a + n + 8) = n * 7 + 3;
+        printf("%8lu %8ldus %8ldus %8ldus %8ldus\n", n, t_cpy, t_set, t_cmp, t_len);
+        n = n * 4;
+    }
+    return 0;
+}
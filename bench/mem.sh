@@ -0,0 +1,16 @@
+#!/bin/sh
+# Builds bench/mem.m against the C library and against std.mem for each vector ISA and runs it.
+# Usage: bench/mem.sh [path/to/cmicro]
+set -e
+CMICRO=${1:-cmicro/build/cmicro}
+DIR=$(dirname "$0")
+OUT=${TMPDIR:-/tmp}/cmicro-mem
+sed '/^import std.mem;/d' "$DIR/mem.m" > "$OUT-libc.m"
+"$CMICRO" -O1 -o "$OUT-libc" "$OUT-libc.m"
+echo "== libc"
+"$OUT-libc"
+for isa in none sse2 avx2; do
+    "$CMICRO" -O1 --simd=$isa -o "$OUT-$isa" "$DIR/mem.m"
+    echo "== std.mem --simd=$isa"
+    "$OUT-$isa"
+done
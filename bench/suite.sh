@@ -0,0 +1,48 @@
+#!/bin/sh
+# Builds each program of bench/suite with cmicro and its C version with clang -O2, runs both and
+# prints one JSON object per program: the best wall time of RUNS runs in microseconds, the
+# Micro/C time ratio, the binary sizes and whether both printed the same result.
+# Usage: bench/suite.sh [path/to/cmicro] [program...]
+# Environment: MFLAGS (cmicro flags, -O1), CC (clang), CFLAGS (-O2), RUNS (5)
+set -e
+CMICRO=${1:-cmicro/build/cmicro}
+[ $# -gt 0 ] && shift
+DIR=$(dirname "$0")/suite
+OUT=${TMPDIR:-/tmp}/cmicro-suite
+MFLAGS=${MFLAGS:--O1}
+CC=${CC:-clang}
+CFLAGS=${CFLAGS:--O2}
+RUNS=${RUNS:-5}
+mkdir -p "$OUT"
+
+# Prints the best wall time of $1 in microseconds, its output goes to $2.
+best_time() {
+    best=
+    run=0
+    while [ $run -lt "$RUNS" ]; do
+        start=$(date +%s%N)
+        "$1" > "$2"
+        end=$(date +%s%N)
+        t=$(((end - start) / 1000))
+        if [ -z "$best" ] || [ $t -lt $best ]; then
+            best=$t
+        fi
+        run=$((run + 1))
+    done
+    echo $best
+}
+
+programs=${*:-$(cd "$DIR" && ls *.m | sed 's/\.m$//')}
+for p in $programs; do
+    "$CMICRO" $MFLAGS -o "$OUT/$p-micro" "$DIR/$p.m" > /dev/null
+    $CC $CFLAGS -o "$OUT/$p-c" "$DIR/$p.c"
+    micro_us=$(best_time "$OUT/$p-micro" "$OUT/$p-micro.txt")
+    c_us=$(best_time "$OUT/$p-c" "$OUT/$p-c.txt")
+    ratio=$(awk "BEGIN { printf \"%.3f\", $micro_us / ($c_us > 0 ? $c_us : 1) }")
+    same=true
+    cmp -s "$OUT/$p-micro.txt" "$OUT/$p-c.txt" || same=false
+    printf '{"program": "%s", "micro_us": %d, "c_us": %d, "ratio": %s, ' "$p" "$micro_us" "$c_us" \
+        "$ratio"
+    printf '"micro_bytes": %d, "c_bytes": %d, "same_output": %s}\n' \
+        "$(wc -c < "$OUT/$p-micro")" "$(wc -c < "$OUT/$p-c")" "$same"
+done
@@ -0,0 +1,41 @@
+/* Adler-32 style checksum of a buffer: byte loads and modulo in a tight loop.
+   C version: checksum.c */
+int    printf(...);
+uchar* malloc(long size);
+
+uint checksum(uchar* p, long n)
+{
+    uint a = 1;
+    uint b = 0;
+    long i = 0;
+    while (i < n)
+    {
+        a = (a + *(p + i)) % 65521;
+        b = (b + a) % 65521;
+        i = i + 1;
+    }
+    return b * 65536 + a;
+}
+
+int main()
+{
+    long   n    = 4194304;
+    int    reps = 16;
+    uchar* data = malloc(n);
+    long   i    = 0;
+    while (i < n)
+    {
+        *(data + i) = i * 7 + 3;
+        i           = i + 1;
+    }
+    uint sum = 0;
+    int  r   = 0;
+    while (r < reps)
+    {
+        *data = r;
+        sum   = sum + checksum(data, n);
+        r     = r + 1;
+    }
+    printf("checksum of %d x %ld bytes: %u\n", reps, n, sum);
+    return 0;
+}
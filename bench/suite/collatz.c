@@ -0,0 +1,41 @@
+/* Longest Collatz chain below a limit: 64-bit arithmetic and data-dependent branches.
+   Micro version: collatz.m */
+#include <stdio.h>
+
+int chain_length(long n)
+{
+    int length = 1;
+    while (n != 1)
+    {
+        if (n % 2 == 0)
+        {
+            n = n / 2;
+        }
+        else
+        {
+            n = 3 * n + 1;
+        }
+        length = length + 1;
+    }
+    return length;
+}
+
+int main(void)
+{
+    long limit = 2000000;
+    long best  = 1;
+    int  most  = 1;
+    long n     = 1;
+    while (n < limit)
+    {
+        int length = chain_length(n);
+        if (length > most)
+        {
+            most = length;
+            best = n;
+        }
+        n = n + 1;
+    }
+    printf("longest chain below %ld starts at %ld (%d steps)\n", limit, best, most);
+    return 0;
+}
@@ -0,0 +1,17 @@
+/* Recursive Fibonacci: call overhead and small-function codegen. Micro version: fib.m */
+#include <stdio.h>
+
+int fib(int n)
+{
+    if (n < 2)
+    {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main(void)
+{
+    printf("fib(35) = %d\n", fib(35));
+    return 0;
+}
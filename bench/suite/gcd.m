@@ -0,0 +1,32 @@
+/* Euclid's algorithm over all pairs: integer division and short loops. C version: gcd.c */
+int printf(...);
+
+int gcd(int a, int b)
+{
+    while (b != 0)
+    {
+        int t = a % b;
+        a     = b;
+        b     = t;
+    }
+    return a;
+}
+
+int main()
+{
+    int  n   = 3000;
+    long sum = 0;
+    int  i   = 1;
+    while (i <= n)
+    {
+        int j = 1;
+        while (j <= n)
+        {
+            sum = sum + gcd(i, j);
+            j   = j + 1;
+        }
+        i = i + 1;
+    }
+    printf("sum of gcd(i, j) for i, j <= %d = %ld\n", n, sum);
+    return 0;
+}
@@ -0,0 +1,57 @@
+/* Naive matrix multiply: nested loops, index arithmetic and loads. C version: matmul.c */
+int    printf(...);
+uchar* malloc(long size);
+
+void multiply(long* c, long* a, long* b, int n)
+{
+    int i = 0;
+    while (i < n)
+    {
+        int j = 0;
+        while (j < n)
+        {
+            long sum = 0;
+            int  k   = 0;
+            while (k < n)
+            {
+                sum = sum + *(a + i * n + k) * *(b + k * n + j);
+                k   = k + 1;
+            }
+            *(c + i * n + j) = sum;
+            j                = j + 1;
+        }
+        i = i + 1;
+    }
+}
+
+int main()
+{
+    int   n = 300;
+    long* a = (long*) malloc(n * n * 8);
+    long* b = (long*) malloc(n * n * 8);
+    long* c = (long*) malloc(n * n * 8);
+    int   i = 0;
+    while (i < n * n)
+    {
+        *(a + i) = i % 17 - 8;
+        *(b + i) = i % 13 - 6;
+        i        = i + 1;
+    }
+    multiply(c, a, b, n);
+    long trace = 0;
+    long total = 0;
+    i          = 0;
+    while (i < n * n)
+    {
+        total = total + *(c + i);
+        i     = i + 1;
+    }
+    i = 0;
+    while (i < n)
+    {
+        trace = trace + *(c + i * n + i);
+        i     = i + 1;
+    }
+    printf("%dx%d: trace %ld, sum %ld\n", n, n, trace, total);
+    return 0;
+}
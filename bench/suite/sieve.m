@@ -0,0 +1,34 @@
+/* Sieve of Eratosthenes: byte stores and strided loops over a large array.
+   C version: sieve.c */
+int    printf(...);
+uchar* malloc(long size);
+
+int main()
+{
+    long   n         = 20000000;
+    uchar* composite = malloc(n + 1);
+    long   i         = 0;
+    while (i <= n)
+    {
+        *(composite + i) = 0;
+        i                = i + 1;
+    }
+    long count = 0;
+    i          = 2;
+    while (i <= n)
+    {
+        if (*(composite + i) == 0)
+        {
+            count  = count + 1;
+            long j = i * i;
+            while (j <= n)
+            {
+                *(composite + j) = 1;
+                j                = j + i;
+            }
+        }
+        i = i + 1;
+    }
+    printf("%ld primes up to %ld\n", count, n);
+    return 0;
+}
@@ -0,0 +1,50 @@
+/* djb2 hashing of many short strings: byte loads, a data-dependent loop exit and calls.
+   C version: strhash.c */
+int    printf(...);
+uchar* malloc(long size);
+
+uint hash(uchar* s)
+{
+    uint h = 5381;
+    while (*s != 0)
+    {
+        h = h * 33 + *s;
+        s = s + 1;
+    }
+    return h;
+}
+
+int main()
+{
+    int    count = 200000;
+    int    size  = 24;
+    uchar* words = malloc(count * size);
+    int    i     = 0;
+    while (i < count)
+    {
+        // Words of 4 to 19 letters, each one derived from its index.
+        int length = 4 + i % 16;
+        int k      = 0;
+        while (k < length)
+        {
+            *(words + i * size + k) = 97 + (i * 31 + k * 7) % 26;
+            k                       = k + 1;
+        }
+        *(words + i * size + length) = 0;
+        i                            = i + 1;
+    }
+    uint combined = 0;
+    int  r        = 0;
+    while (r < 50)
+    {
+        i = 0;
+        while (i < count)
+        {
+            combined = combined * 31 + hash(words + i * size);
+            i        = i + 1;
+        }
+        r = r + 1;
+    }
+    printf("hash of %d words: %u\n", count, combined);
+    return 0;
+}
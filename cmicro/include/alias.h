@@ -0,0 +1,33 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_ALIAS_H
+#define _CMICRO_ALIAS_H
+
+#include <types.h>
+#include <stdbool.h>
+
+typedef enum
+{
+    ALIAS_NO,
+    ALIAS_MAY,
+    ALIAS_MUST
+} alias_result_t;
+
+typedef struct mem_loc
+{
+    const char*        addr;        // QBE value holding the address
+    const char*        base;        // NOTE: Can be NULL, slot or restrict pointer it derives from
+    const type_info_t* type;        // type of the accessed object
+    bool               is_stack;    // base is a local slot whose address never escapes
+    bool               is_restrict; // base is a restrict-qualified pointer
+} mem_loc_t;
+
+alias_result_t alias_query(const mem_loc_t* a, const mem_loc_t* b);
+bool           alias_types_compatible(const type_info_t* a, const type_info_t* b);
+
+#endif // _CMICRO_ALIAS_H
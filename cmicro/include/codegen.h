@@ -8,8 +8,36 @@
 #define _CMICRO_CODEGEN_H
 
 #include <parser.h>
+#include <simd.h>
+#include <stdbool.h>
 #include <stdio.h>
 
-int codegen_generate(ast_node_t* root, const char* output_path);
+typedef enum
+{
+    CODEGEN_EMIT_BIN, // executable, or object with compile_only
+    CODEGEN_EMIT_QBE, // stop after the QBE IL
+    CODEGEN_EMIT_ASM  // stop after the assembly
+} codegen_emit_t;
+
+typedef struct codegen_options
+{
+    int                opt_level;         // 0 disables all IL optimizations
+    bool               print_stats;       // print code size and instantiation statistics
+    simd_isa_t         simd;              // instruction set used for vector operations
+    const char*        profile;           // NOTE: Can be NULL, call counts for function layout
+    bool               function_sections; // one section per function (.text.NAME)
+    bool               data_sections;     // one section per data item (.data.NAME, .bss.NAME, ...)
+    bool               gc_sections;       // let the linker discard unreferenced sections
+    bool               compile_only;      // produce an object instead of an executable
+    codegen_emit_t     emit;              // the stage whose output goes to output_path
+    ast_node_t* const* imports;           // NOTE: Can be NULL, programs of imported modules
+    const char* const* import_paths;      // NOTE: Can be NULL, names of the imports in diagnostics
+    const char* const* import_sources;    // NOTE: only used with import_paths
+    size_t             import_count;
+} codegen_options_t;
+
+int codegen_generate(ast_node_t* root, const char* output_path, const codegen_options_t* opts);
+int codegen_link(const char* const* objects, size_t count, const char* output_path,
+                 const codegen_options_t* opts);
 
 #endif // _CMICRO_CODEGEN_H
\ No newline at end of file
@@ -0,0 +1,35 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_DRIVER_H
+#define _CMICRO_DRIVER_H
+
+#include <codegen.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct module_cache module_cache_t;
+
+// Compiles one program of a batch, returns 0 on success.
+typedef int (*batch_compile_t)(const char* input, const char* output, void* data);
+
+typedef struct driver_options
+{
+    int             jobs;     // compile jobs running at the same time
+    bool            verbose;  // print the progress of each module
+    module_cache_t* cache;    // NOTE: Can be NULL, parsed modules kept between builds
+    bool            manifest; // write <object>.d and skip modules that are up to date
+} driver_options_t;
+
+int             driver_build(const char* const* sources, size_t count, const char* output_path,
+                             const codegen_options_t* opts, const driver_options_t* driver);
+int             driver_batch(const char* list_path, batch_compile_t compile, void* data,
+                             const driver_options_t* driver);
+module_cache_t* module_cache_create(void);
+void            module_cache_free(module_cache_t* cache);
+
+#endif // _CMICRO_DRIVER_H
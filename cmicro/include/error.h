@@ -8,7 +8,10 @@
 #ifndef _CMICRO_ERROR_H
 #define _CMICRO_ERROR_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 typedef enum
 {
@@ -19,17 +22,33 @@ typedef enum
 
 typedef struct
 {
-    const char*   source;  // full source code
+    const char*   source;  // full source code, NULL for the source of the current sink
     const char*   message; // error message
     uint32_t      line;    // 1-based line number
     uint32_t      column;  // 1-based column number
     error_level_t level;   // severity
+    uint32_t      length;  // columns covered from `column`, 0 for just the position
 } error_t;
 
-void report_error(const error_t* err);
+typedef struct error_sink error_sink_t;
 
-#define ERROR_FATAL(src, line, col, msg) report_error(&(error_t){src, msg, line, col, ERROR_FATAL})
-#define ERROR_WARN(src, line, col, msg) report_error(&(error_t){src, msg, line, col, ERROR_WARNING})
-#define ERROR_INFO(src, line, col, msg) report_error(&(error_t){src, msg, line, col, ERROR_INFO})
+void          report_error(const error_t* err);
+void          error_begin(const char* module, const char* source, size_t len);
+void          error_flush(void);
+void          error_origin(const char* module, const char* source); // NOTE: NULL for the own module
+bool          error_save(FILE* out); // NOTE: ends the current sink like error_flush()
+error_sink_t* error_load(FILE* in);
+void          error_replay(error_sink_t* sink); // NOTE: writes and frees the sink, NULL is empty
+void          error_set_limit(unsigned limit);  // NOTE: 0 for no limit
+unsigned      error_count(void);
 
-#endif // _CMICRO_ERROR_H
\ No newline at end of file
+#define ERROR_FATAL(src, line, col, msg)                                                          \
+    report_error(&(error_t){src, msg, line, col, ERROR_FATAL, 0})
+#define ERROR_WARN(src, line, col, msg)                                                           \
+    report_error(&(error_t){src, msg, line, col, ERROR_WARNING, 0})
+#define ERROR_INFO(src, line, col, msg)                                                           \
+    report_error(&(error_t){src, msg, line, col, ERROR_INFO, 0})
+#define ERROR_RANGE(src, line, col, len, msg)                                                     \
+    report_error(&(error_t){src, msg, line, col, ERROR_FATAL, len})
+
+#endif // _CMICRO_ERROR_H
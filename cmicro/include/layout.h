@@ -0,0 +1,41 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_LAYOUT_H
+#define _CMICRO_LAYOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct layout_func
+{
+    const char* name;
+    uint64_t    count;    // execution count (estimated or profiled)
+    bool        is_entry; // NOTE: entry points (main) are never cold
+    bool        cold;     // NOTE: output, set by layout_order()
+} layout_func_t;
+
+typedef struct layout_edge
+{
+    size_t   caller; // index into the function array
+    size_t   callee;
+    uint64_t weight; // number of calls (estimated or profiled)
+} layout_edge_t;
+
+typedef struct layout_profile layout_profile_t;
+
+void layout_order(layout_func_t* funcs, size_t count, const layout_edge_t* edges,
+                  size_t edge_count, size_t* order);
+
+layout_profile_t* layout_profile_load(const char* path);
+bool              layout_profile_count(const layout_profile_t* p, const char* name, uint64_t* out);
+bool              layout_profile_edge(const layout_profile_t* p, const char* caller,
+                                      const char* callee, uint64_t* out);
+void              layout_profile_free(layout_profile_t* p);
+
+#endif // _CMICRO_LAYOUT_H
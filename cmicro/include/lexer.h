@@ -38,6 +38,7 @@ typedef enum token_type
     TOKEN_GT,      // >
     TOKEN_LTE,     // <=
     TOKEN_GTE,     // >=
+    TOKEN_AMP,     // &
 
     /* Symbols / punctuation */
     TOKEN_LPAREN,   // (
@@ -48,6 +49,7 @@ typedef enum token_type
     TOKEN_COMMA,    // ,
     TOKEN_DOT,      // .
     TOKEN_ELLIPSIS, // ...
+    TOKEN_COLON,    // :
 
     /* Specials */
     TOKEN_ERROR = 0xdeadbeef,
@@ -99,12 +101,14 @@ typedef struct token
      : (t) == TOKEN_GT      ? "GT"                                                                 \
      : (t) == TOKEN_LTE     ? "LTE"                                                                \
      : (t) == TOKEN_GTE     ? "GTE"                                                                \
+     : (t) == TOKEN_AMP     ? "AMP"                                                                \
      : (t) == TOKEN_LPAREN  ? "LPAREN"                                                             \
      : (t) == TOKEN_RPAREN  ? "RPAREN"                                                             \
      : (t) == TOKEN_LBRACE  ? "LBRACE"                                                             \
      : (t) == TOKEN_RBRACE  ? "RBRACE"                                                             \
      : (t) == TOKEN_SEMI    ? "SEMI"                                                               \
      : (t) == TOKEN_DOT     ? "DOT"                                                                \
+     : (t) == TOKEN_COLON   ? "COLON"                                                              \
      : (t) == TOKEN_ERROR   ? "ERROR"                                                              \
      : (t) == TOKEN_COMMA   ? "COMMA"                                                              \
      : (t) == TOKEN_EOF     ? "EOF"                                                                \
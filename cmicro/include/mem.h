@@ -0,0 +1,50 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_MEM_H
+#define _CMICRO_MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef enum
+{
+    MEM_SOURCE,  // source buffers, file and module bookkeeping
+    MEM_TOKENS,  // token arrays and string literals
+    MEM_AST,     // AST nodes and their names
+    MEM_SYMBOLS, // scopes, functions, globals, types, instances
+    MEM_TEMPS,   // emitter temporaries: temp and label names
+    MEM_OTHER,
+    MEM_CATEGORY_COUNT
+} mem_category_t;
+
+void* mem_malloc(size_t size, mem_category_t category);
+void* mem_calloc(size_t count, size_t size, mem_category_t category);
+void* mem_realloc(void* ptr, size_t size, mem_category_t category);
+char* mem_strdup(const char* s, mem_category_t category);
+char* mem_strndup(const char* s, size_t n, mem_category_t category);
+void  mem_free(void* ptr);
+
+void mem_stats_enable(bool enable);
+void mem_stats_reset(void);
+bool mem_stats_save(FILE* out);
+bool mem_stats_merge(FILE* in);
+void mem_stats_report(FILE* out);
+
+// A source file defines MEM_CATEGORY before including this header (after the system headers) to
+// account its allocations to that category.
+#ifdef MEM_CATEGORY
+#define malloc(size) mem_malloc(size, MEM_CATEGORY)
+#define calloc(count, size) mem_calloc(count, size, MEM_CATEGORY)
+#define realloc(ptr, size) mem_realloc(ptr, size, MEM_CATEGORY)
+#define strdup(s) mem_strdup(s, MEM_CATEGORY)
+#define strndup(s, n) mem_strndup(s, n, MEM_CATEGORY)
+#define free(ptr) mem_free(ptr)
+#endif
+
+#endif // _CMICRO_MEM_H
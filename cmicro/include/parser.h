@@ -27,6 +27,11 @@ typedef enum
     NODE_ELSEIF,
     NODE_ELSE,
     NODE_IMPORT,
+    NODE_CAST,
+    NODE_ADDR_OF,
+    NODE_DEREF,
+    NODE_WHILE,
+    NODE_ASM,
 } ast_node_type_t;
 
 typedef struct param_node
@@ -73,6 +78,9 @@ typedef struct
     size_t           name_len;
     char*            type; // NOTE: NULL for assignment, non-NULL for definition
     struct ast_node* value;
+    struct ast_node* target; // NOTE: Non-NULL (and name NULL) for stores through a pointer
+    bool             is_thread_local; // NOTE: definitions only, one instance per thread
+    bool             is_extern;       // NOTE: definitions only, defined in another object
 } ast_assign_t;
 
 typedef struct
@@ -88,6 +96,8 @@ typedef struct
     param_node_t*    params;
     struct ast_node* root;
     bool             is_declaration;
+    char**           type_params; // NOTE: Non-NULL for generic functions, e.g. 'T max<T>(T a, T b)'
+    size_t           type_param_count;
 } ast_func_def_t;
 
 typedef struct
@@ -96,6 +106,8 @@ typedef struct
     size_t           name_len;
     struct ast_node* args;
     size_t           arg_count;
+    char**           type_args; // NOTE: Can be NULL, explicit type arguments, e.g. 'max<int>(a, b)'
+    size_t           type_arg_count;
 } ast_func_call_t;
 
 typedef struct
@@ -134,9 +146,51 @@ typedef struct
     char* module;
 } ast_import_t;
 
+typedef struct
+{
+    char*            type;
+    struct ast_node* expr;
+} ast_cast_t;
+
+typedef struct
+{
+    struct ast_node* expr; // NOTE: Must be an NODE_IDENT
+} ast_addr_of_t;
+
+typedef struct
+{
+    struct ast_node* expr;
+} ast_deref_t;
+
+typedef struct
+{
+    struct ast_node* condition;
+    struct ast_node* body;
+} ast_while_t;
+
+typedef struct
+{
+    char*            constraint; // e.g. "=a", "+r" or "i"
+    struct ast_node* expr;       // NOTE: Outputs must be a NODE_IDENT or NODE_DEREF
+} asm_operand_t;
+
+typedef struct
+{
+    char*          text; // AT&T syntax template, operands are referenced as %0, %1, ...
+    size_t         text_len;
+    asm_operand_t* outputs;
+    size_t         output_count;
+    asm_operand_t* inputs;
+    size_t         input_count;
+    char**         clobbers;
+    size_t         clobber_count;
+} ast_asm_t;
+
 typedef struct ast_node
 {
     ast_node_type_t type;
+    uint32_t        line;   // NOTE: 0 for nodes without a source position
+    uint32_t        column;
     union
     {
         ast_binop_t     binop;
@@ -153,10 +207,19 @@ typedef struct ast_node
         ast_elseif_t    elseif_stmt;
         ast_else_t      else_stmt;
         ast_import_t    import;
+        ast_cast_t      cast;
+        ast_addr_of_t   addr_of;
+        ast_deref_t     deref;
+        ast_while_t     while_stmt;
+        ast_asm_t       asm_stmt;
     } data;
 } ast_node_t;
 
+typedef void (*ast_visit_fn_t)(ast_node_t* node, void* data);
+
 ast_node_t* ast_gen(token_t* tokens);
+void        ast_walk(ast_node_t* node, ast_visit_fn_t fn, void* data);
+size_t      ast_node_count(ast_node_t* node);
 void        ast_free(ast_node_t* node);
 
 #endif // _CMICRO_PARSER_H
\ No newline at end of file
@@ -0,0 +1,36 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_REMARK_H
+#define _CMICRO_REMARK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    REMARK_PASSED,   // an optimization was applied (-Rpass)
+    REMARK_MISSED,   // an optimization was not applied, and why (-Rpass-missed)
+    REMARK_ANALYSIS, // facts that decided an optimization (-Rpass-analysis)
+    REMARK_KIND_COUNT
+} remark_kind_t;
+
+typedef enum
+{
+    REMARK_FORMAT_YAML,
+    REMARK_FORMAT_JSON
+} remark_format_t;
+
+bool remark_filter(remark_kind_t kind, const char* pattern); // NOTE: pattern NULL matches all
+void remark_record(remark_format_t format);
+void remark_set_file(const char* file); // NOTE: locates the remarks emitted after it
+void remark_emit(remark_kind_t kind, const char* pass, const char* function, uint32_t line,
+                 uint32_t column, const char* fmt, ...);
+bool remark_write(const char* output_path); // NOTE: no-op unless recording
+void remark_reset(void);
+
+#endif // _CMICRO_REMARK_H
@@ -0,0 +1,16 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_RUNTIME_H
+#define _CMICRO_RUNTIME_H
+
+#include <simd.h>
+#include <stdio.h>
+
+int runtime_write(FILE* out, const char* module, simd_isa_t isa);
+
+#endif // _CMICRO_RUNTIME_H
@@ -0,0 +1,19 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_SERVER_H
+#define _CMICRO_SERVER_H
+
+#include <driver.h>
+
+// Runs one forwarded command line, returns its exit status.
+typedef int (*server_handler_t)(int argc, char** argv, module_cache_t* cache);
+
+int server_run(const char* socket_path, server_handler_t handler);
+int client_run(const char* socket_path, int argc, char** argv);
+
+#endif // _CMICRO_SERVER_H
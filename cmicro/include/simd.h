@@ -0,0 +1,36 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_SIMD_H
+#define _CMICRO_SIMD_H
+
+#include <types.h>
+#include <stdio.h>
+
+typedef enum
+{
+    SIMD_NONE, // scalarize every vector operation in the IL
+    SIMD_SSE2,
+    SIMD_AVX2
+} simd_isa_t;
+
+typedef enum
+{
+    SIMD_ADD,
+    SIMD_SUB,
+    SIMD_MUL,
+    SIMD_DIV,
+    SIMD_SHUFFLE,   // NOTE: imm holds the lane indices, two bits per lane
+    SIMD_REDUCE_ADD // NOTE: returns the sum in rax/eax
+} simd_op_t;
+
+const char*        simd_stub(simd_op_t op, const type_info_t* type, unsigned imm, simd_isa_t isa);
+const type_info_t* simd_reduce_type(const type_info_t* type);
+int                simd_write_stubs(FILE* out, bool function_sections);
+void               simd_reset(void);
+
+#endif // _CMICRO_SIMD_H
@@ -0,0 +1,47 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_TIMING_H
+#define _CMICRO_TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum
+{
+    PHASE_READ,
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_CODEGEN, // IL generation
+    PHASE_QBE,     // NOTE: external process
+    PHASE_CLANG,   // NOTE: external process, assembles (and links single-module builds)
+    PHASE_LINK,    // NOTE: external process, links the objects of multi-module builds
+    PHASE_COUNT
+} phase_t;
+
+typedef enum
+{
+    COUNTER_BYTES_IN, // source bytes read
+    COUNTER_TOKENS,
+    COUNTER_AST_NODES,
+    COUNTER_IL_LINES,
+    COUNTER_IL_BYTES,
+    COUNTER_BYTES_OUT, // bytes of the objects and executables written
+    COUNTER_COUNT
+} counter_t;
+
+void    timing_begin(phase_t phase);
+void    timing_end(phase_t phase);
+phase_t timing_phase(void); // NOTE: PHASE_COUNT outside of any phase
+void    timing_add(counter_t counter, uint64_t value);
+bool    timing_save(FILE* out);
+bool    timing_merge(FILE* in);
+void    timing_report(FILE* out, bool json);
+void    timing_reset(void);
+
+#endif // _CMICRO_TIMING_H
@@ -0,0 +1,24 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_TRACE_H
+#define _CMICRO_TRACE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+void trace_enable(bool enable);
+bool trace_enabled(void);
+void trace_set_module(const char* module); // NOTE: tags the spans begun after it, NULL for none
+void trace_begin(const char* name, const char* category);
+void trace_end(void); // NOTE: ends the innermost span
+bool trace_save(FILE* out);
+bool trace_merge(FILE* in);
+bool trace_write(const char* path);
+void trace_reset(void);
+
+#endif // _CMICRO_TRACE_H
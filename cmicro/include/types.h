@@ -0,0 +1,39 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef _CMICRO_TYPES_H
+#define _CMICRO_TYPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct type_info
+{
+    const char*             name;       // spelling, e.g. "int" or "int*"
+    char                    qbe_type;   // QBE class: w, l, s, d (0 for void)
+    uint8_t                 size;       // size in bytes
+    bool                    is_signed;  // signed integer
+    bool                    is_float;   // float or double
+    bool                    is_pointer; // pointer (or string)
+    const struct type_info* pointee;    // NOTE: only set for pointers
+    uint8_t                 lanes;      // NOTE: only set for vectors
+    const struct type_info* elem;       // NOTE: only set for vectors, type of one lane
+    struct type_info*       next;       // NOTE: only used by interned pointer types
+} type_info_t;
+
+const type_info_t* type_lookup(const char* name);
+const type_info_t* type_lookup_n(const char* name, size_t len);
+const type_info_t* type_pointer_to(const type_info_t* base);
+bool               type_is_restrict(const char* name);
+bool               type_is_integer(const type_info_t* t);
+bool               type_is_vector(const type_info_t* t);
+const char*        type_load_op(const type_info_t* t);
+const char*        type_store_op(const type_info_t* t);
+void               types_reset(void);
+
+#endif // _CMICRO_TYPES_H
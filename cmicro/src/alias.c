@@ -0,0 +1,73 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <alias.h>
+#include <string.h>
+
+static bool same_base(const mem_loc_t* a, const mem_loc_t* b)
+{
+    return a->base && b->base && strcmp(a->base, b->base) == 0;
+}
+
+// An access of a variable itself, not through a pointer, has its slot as address and base.
+static bool is_direct(const mem_loc_t* loc)
+{
+    return loc->addr && loc->base && strcmp(loc->addr, loc->base) == 0;
+}
+
+/* ========================= */
+/* Type-based alias analysis */
+/* ========================= */
+
+// Two accesses may alias only if their types match up to signedness. Character types alias
+// everything and all pointer types are treated as one class.
+bool alias_types_compatible(const type_info_t* a, const type_info_t* b)
+{
+    if (!a || !b)
+        return true;
+    // Vectors are accessed as arrays of their lane type.
+    if (a->lanes)
+        a = a->elem;
+    if (b->lanes)
+        b = b->elem;
+    if (!a->is_float && !a->is_pointer && a->size == 1)
+        return true;
+    if (!b->is_float && !b->is_pointer && b->size == 1)
+        return true;
+    if (a->is_pointer || b->is_pointer)
+        return a->is_pointer && b->is_pointer;
+    return a->is_float == b->is_float && a->size == b->size;
+}
+
+/* ================== */
+/* Alias queries      */
+/* ================== */
+alias_result_t alias_query(const mem_loc_t* a, const mem_loc_t* b)
+{
+    if (a->addr && b->addr && strcmp(a->addr, b->addr) == 0)
+        return (a->type && b->type && a->type->size == b->type->size) ? ALIAS_MUST : ALIAS_MAY;
+
+    // Non-escaping stack slots can only be reached through their own slot address.
+    if (a->is_stack || b->is_stack)
+        return (a->is_stack && b->is_stack && same_base(a, b)) ? ALIAS_MAY : ALIAS_NO;
+
+    if (!alias_types_compatible(a->type, b->type))
+        return ALIAS_NO;
+
+    // An object accessed through a restrict pointer is only accessed through that pointer and
+    // pointers derived from it. Derived pointers aren't tracked (their base is the slot of the
+    // variable they were copied to), so this only rules out accesses through another restrict
+    // pointer and direct accesses of a variable.
+    if ((a->is_restrict || b->is_restrict) && !same_base(a, b))
+    {
+        const mem_loc_t* other = a->is_restrict ? b : a;
+        if (other->is_restrict || is_direct(other))
+            return ALIAS_NO;
+    }
+
+    return ALIAS_MAY;
+}
@@ -8,39 +8,82 @@
 #define _GNU_SOURCE
 #include <codegen.h>
 #include <parser.h>
+#include <types.h>
+#include <alias.h>
+#include <simd.h>
+#include <runtime.h>
+#include <layout.h>
+#include <timing.h>
+#include <trace.h>
+#include <remark.h>
 #include <error.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#define MEM_CATEGORY MEM_SYMBOLS
+#include <mem.h>
 
 typedef struct gen_result
 {
-    char* val;
-    char  qbe_type;
+    char*              val;
+    char               qbe_type;
+    const type_info_t* type;        // NOTE: NULL when only the QBE class is known
+    const char*        base;        // NOTE: pointer values only, slot of the variable it came from
+    bool               is_restrict; // NOTE: pointer values only, derived from a restrict pointer
 } gen_result_t;
 
 typedef struct var_info
 {
-    char* ptr;
-    char  vtype;
+    char*              ptr;
+    char               vtype;
+    const type_info_t* type;
+    bool               is_restrict;
+    bool               escaped;
 } var_info_t;
 
 typedef struct sym_entry
 {
-    char*             name;
-    char*             ptr;
-    char              vtype;
-    struct sym_entry* next;
+    char*              name;
+    char*              ptr; // address of the variable's stack slot
+    char               vtype;
+    const type_info_t* type;
+    bool               is_restrict; // declared as a restrict pointer
+    bool               escaped;     // address is taken somewhere in the function
+    struct sym_entry*  next;
 } sym_entry_t;
 
+// A stack slot of the current function. Objects whose lifetimes don't overlap share a slot.
+typedef struct frame_slot
+{
+    char*              ptr;        // temp holding the slot's address
+    size_t             size;       // largest object placed in the slot
+    size_t             align;      // strictest alignment of those objects
+    size_t             offset;     // NOTE: only set for slots in the merged frame allocation
+    bool               promotable; // scalars whose address is never taken, QBE keeps them in regs
+    char               qbe_class;  // NOTE: only set for promotable slots, class of the accesses
+    const void*        owner;      // NOTE: NULL when free, else the scope the slot is live in
+    struct frame_slot* next;
+} frame_slot_t;
+
 typedef struct scope
 {
     sym_entry_t*  entries;
     struct scope* prev;
 } scope_t;
 
+// A global variable. `ptr` is the operand naming its address, NULL for extern thread_local
+// variables, whose address is computed once per function (see global_var()).
+typedef struct global
+{
+    ast_node_t*        node;
+    char*              ptr;
+    const type_info_t* type;
+    struct global*     next;
+} global_t;
+
 typedef struct func_entry
 {
     char*              name;
@@ -53,51 +96,195 @@ typedef struct str_info
     char*            value;
     size_t           len;
     char*            gname;
+    bool             used; // referenced by the generated code, only used literals are emitted
     struct str_info* next;
 } str_info_t;
 
+typedef struct name_entry
+{
+    char*              name;
+    struct name_entry* next;
+} name_entry_t;
+
+// Memory values known at the current point of the current basic block.
+typedef struct load_entry
+{
+    mem_loc_t          loc; // NOTE: addr and base are owned
+    char*              val;
+    struct load_entry* next;
+} load_entry_t;
+
+// Binds the type parameters of a generic function to concrete types.
+typedef struct type_env
+{
+    char**              names; // NOTE: borrowed from the generic function's AST
+    const type_info_t** types;
+    size_t              count;
+} type_env_t;
+
+typedef struct instance
+{
+    ast_node_t*      func; // generic function definition
+    type_env_t       env;
+    char*            name; // mangled symbol, e.g. "max__int"
+    bool             emitted;
+    long             il_bytes;
+    int              il_lines;
+    struct instance* next;
+} instance_t;
+
+typedef struct func_text
+{
+    char*             name;
+    char*             text; // complete IL of the function
+    size_t            len;
+    uint32_t          line; // of the definition, for remarks
+    uint32_t          column;
+    struct func_text* next;
+} func_text_t;
+
+typedef struct call_edge
+{
+    char*             caller;
+    char*             callee;
+    uint64_t          weight; // static estimate, calls in loops count 10x per nesting level
+    struct call_edge* next;
+} call_edge_t;
+
 typedef struct codegen_context
 {
-    FILE*         out;
-    scope_t*      current_scope;
-    func_entry_t* funcs;
-    str_info_t*   strings;
-    int           temp_count;
-    int           label_count;
-    int           str_count;
+    FILE*                    out;
+    FILE*                    frame; // stack slots of the current function, emitted into @start
+    frame_slot_t*            slots; // stack slots of the current function
+    const codegen_options_t* opts;
+    scope_t*                 current_scope;
+    func_entry_t*            funcs;
+    global_t*                globals;
+    str_info_t*              strings;
+    name_entry_t*            escaped;    // locals whose address is taken in the current function
+    load_entry_t*            load_cache; // NOTE: only used with opt_level > 0
+    const type_info_t*       ret_type;   // return type of the function being generated
+    const type_env_t*        env;        // NOTE: Can be NULL, bindings of the current instance
+    instance_t*              instances;  // generic instantiations, in order of first use
+    int                      instance_requests;
+    int                      mem_inlined; // memory builtin calls expanded inline
+    int                      printf_lowered; // printf calls specialized for their format
+    bool                     put_int_used;   // $__micro_put_int has to be emitted
+    int                      il_lines;
+    int                      slot_objects; // stack objects of all functions
+    int                      slot_count;   // stack slots they were colored into
+    size_t                   frame_bytes;  // total frame size of all functions
+    bool                     terminated; // current block ended in jmp/ret, rest is unreachable
+    int                      temp_count;
+    int                      label_count;
+    int                      str_count;
+    char**                   asm_blocks; // expanded inline asm, indexed by marker number
+    size_t                   asm_block_count;
+    func_text_t*             func_texts; // generated functions, in order of generation
+    call_edge_t*             call_edges; // NOTE: only recorded with opt_level > 0
+    const char*              func_name;  // symbol of the function being generated
+    int                      loop_depth;
+    int                      cold_funcs;
+    int                      forwarded_loads; // loads of the current function served by the cache
+    uint32_t                 line; // position of the node being generated, for diagnostics
+    uint32_t                 column;
 } codegen_context_t;
 
 static codegen_context_t ctx = {0};
 
-static void         emit(const char* fmt, ...);
-static char*        new_temp(void);
-static char*        new_label(void);
-static char         str_to_qbe_type(const char* s);
-static void         push_scope(void);
-static void         free_scope(scope_t* scope);
-static void         pop_scope(void);
-static void         add_sym(const char* name, size_t name_len, char* ptr, char vtype);
-static var_info_t   find_sym(const char* name);
-static ast_node_t*  find_func(const char* name);
-static void         free_strings(void);
-static void         collect_strings(ast_node_t* node);
-static gen_result_t gen_number(ast_node_t* node);
-static gen_result_t gen_string(ast_node_t* node);
-static gen_result_t gen_ident(ast_node_t* node);
-static gen_result_t gen_binop(token_type_t op, gen_result_t left, gen_result_t right);
-static gen_result_t gen_binop_node(ast_node_t* node);
-static gen_result_t gen_func_call(ast_node_t* node);
-static void         gen_func_call_stmt(ast_node_t* node);
-static gen_result_t gen_assign(ast_node_t* node);
-static void         gen_assign_stmt(ast_node_t* node);
-static gen_result_t gen_expr(ast_node_t* node);
-static void         gen_return(ast_node_t* node);
-static void         gen_conditional(ast_node_t* node, char* cont_lab);
-static void         gen_stmt(ast_node_t* node);
-static void         gen_block(ast_node_t* node);
-static void         gen_func_def(ast_node_t* node);
-static void         gen_program(ast_node_t* node);
-static void         free_context(void);
+static void               emit(const char* fmt, ...);
+static void               emit_label(const char* label);
+static void               emit_jump(const char* label);
+static char*              frame_alloc(size_t size, size_t align, char promote_class);
+static void               frame_release(const void* owner);
+static void               frame_emit(void);
+static size_t             slot_align(const type_info_t* type);
+static char*              new_temp(void);
+static char*              new_label(void);
+static char               str_to_qbe_type(const char* s);
+static const type_info_t* str_to_type(const char* s);
+static void               push_scope(void);
+static void               free_scope(scope_t* scope);
+static void               pop_scope(void);
+static bool               is_escaped(const char* name, size_t name_len);
+static void               add_sym(const char* name, size_t name_len, char* ptr,
+                                  const char* type_name);
+static var_info_t         find_sym(const char* name);
+static var_info_t         global_var(global_t* g);
+static void               gen_globals(ast_node_t* root, bool external);
+static void               free_globals(void);
+static ast_node_t*        lookup_func(const char* name);
+static ast_node_t*        find_func(const char* name);
+static void               free_strings(void);
+static void               collect_strings(ast_node_t* node);
+static gen_result_t       gen_number(ast_node_t* node);
+static gen_result_t       gen_string(ast_node_t* node);
+static gen_result_t       gen_ident(ast_node_t* node);
+static gen_result_t       gen_addr_of(ast_node_t* node);
+static gen_result_t       gen_deref(ast_node_t* node);
+static void               collect_escaped(ast_node_t* node, void* data);
+static void               free_escaped(void);
+static void               cache_clear(void);
+static void               cache_invalidate(const mem_loc_t* loc);
+static void               cache_insert(const mem_loc_t* loc, const char* val);
+static gen_result_t       gen_load(const mem_loc_t* loc);
+static void               free_load_entry(load_entry_t* e);
+static void               gen_store(const mem_loc_t* loc, const char* val);
+static const type_info_t* result_type(gen_result_t res);
+static const type_info_t* common_type(const type_info_t* a, const type_info_t* b);
+static gen_result_t       gen_convert(gen_result_t res, const type_info_t* to);
+static gen_result_t       gen_cast(ast_node_t* node);
+static gen_result_t       gen_pointer_arith(token_type_t op, gen_result_t left, gen_result_t right);
+static gen_result_t       gen_binop(token_type_t op, gen_result_t left, gen_result_t right);
+static gen_result_t       gen_binop_node(ast_node_t* node);
+static char*              vec_addr(const char* base, size_t offset);
+static void               vec_copy(const char* dst, const char* src, const type_info_t* type);
+static gen_result_t       vec_load_lane(const char* base, const type_info_t* type, size_t lane);
+static void               vec_store_lane(const char* base, const type_info_t* type, size_t lane,
+                                         gen_result_t val);
+static gen_result_t       vec_splat(gen_result_t val, const type_info_t* type);
+static gen_result_t       vec_coerce(gen_result_t res, const type_info_t* to);
+static gen_result_t       gen_vector_binop(token_type_t op, gen_result_t left, gen_result_t right);
+static bool               gen_mem_builtin(ast_node_t* node, const char* name, gen_result_t* out);
+static bool               gen_vector_builtin(ast_node_t* node, const char* name, gen_result_t* out);
+static void               printf_collect(const ast_node_t* node);
+static bool               gen_printf_stmt(ast_node_t* node);
+static gen_result_t       gen_func_call(ast_node_t* node);
+static void               gen_func_call_stmt(ast_node_t* node);
+static gen_result_t       gen_store_through(ast_node_t* node);
+static gen_result_t       gen_assign(ast_node_t* node);
+static void               gen_assign_stmt(ast_node_t* node);
+static gen_result_t       gen_expr(ast_node_t* node);
+static void               gen_return(ast_node_t* node);
+static void               gen_conditional(ast_node_t* node, char* cont_lab);
+static void               gen_while(ast_node_t* node);
+static void               gen_asm(ast_node_t* node);
+static char*              emit_asm_marker(char* text, char ret_class, const gen_result_t* args,
+                                          size_t argc);
+static bool               gen_atomic_builtin(ast_node_t* node, const char* name, gen_result_t* out);
+static int                splice_inline_asm(const char* asm_path);
+static void               gen_stmt(ast_node_t* node);
+static void               gen_block(ast_node_t* node);
+static void               record_call(const char* callee);
+static void               gen_func_def(ast_node_t* node);
+static void               gen_program(ast_node_t* node);
+static void               free_context(void);
+
+// Makes `node` the position of the diagnostics reported while it is generated. Nodes the parser
+// didn't locate keep the position of their parent.
+static void locate(const ast_node_t* node)
+{
+    if (node->line)
+    {
+        ctx.line   = node->line;
+        ctx.column = node->column;
+    }
+}
+
+static void gen_error(const char* message)
+{
+    ERROR_FATAL(NULL, ctx.line, ctx.column, message);
+}
 
 static void emit(const char* fmt, ...)
 {
@@ -105,11 +292,139 @@ static void emit(const char* fmt, ...)
     va_start(args, fmt);
     vfprintf(ctx.out, fmt, args);
     va_end(args);
+    for (const char* p = fmt; *p; p++)
+        ctx.il_lines += *p == '\n';
+}
+
+// Starts a new basic block, nothing is known about memory at a join point.
+static void emit_label(const char* label)
+{
+    cache_clear();
+    emit("%s\n", label);
+    ctx.terminated = false;
+}
+
+// Ends the current block with a jump, unless it already ended in a jump or return.
+static void emit_jump(const char* label)
+{
+    if (!ctx.terminated)
+        emit("jmp %s\n", label);
+    ctx.terminated = true;
+}
+
+/* ================== */
+/* Stack slots        */
+/* ================== */
+
+// Allocates a stack slot for an object living until the current scope ends. A slot freed by a
+// sibling scope is reused when possible. A promotable object passes the QBE class of its accesses
+// as `promote_class` (0 otherwise), such slots are only reused for objects of the same size and
+// class, since QBE only keeps a slot in registers when all its accesses have one class.
+static char* frame_alloc(size_t size, size_t align, char promote_class)
+{
+    bool          promotable = promote_class != 0;
+    frame_slot_t* best       = NULL;
+    for (frame_slot_t* slot = ctx.slots; slot; slot = slot->next)
+    {
+        if (slot->owner || slot->promotable != promotable)
+            continue;
+        if (promotable && (slot->size != size || slot->qbe_class != promote_class))
+            continue;
+        // Prefer the smallest slot the object fits in, then the one needing the least growth.
+        bool fits      = slot->size >= size && slot->align >= align;
+        bool best_fits = best && best->size >= size && best->align >= align;
+        if (!best || (fits && !best_fits) ||
+            (fits == best_fits && (fits ? slot->size < best->size : slot->size > best->size)))
+            best = slot;
+    }
+    if (!best)
+    {
+        best = calloc(1, sizeof(frame_slot_t));
+        if (!best)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for stack slot");
+        best->ptr        = new_temp();
+        best->promotable = promotable;
+        best->qbe_class  = promote_class;
+        best->next       = ctx.slots;
+        ctx.slots        = best;
+        ctx.slot_count++;
+    }
+    best->size  = size > best->size ? size : best->size;
+    best->align = align > best->align ? align : best->align;
+    best->owner = ctx.current_scope;
+    ctx.slot_objects++;
+    char* ptr = strdup(best->ptr);
+    if (!ptr)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for stack slot");
+    return ptr;
+}
+
+// Frees the slots of a scope that ends. Values cached for them belong to dead objects.
+static void frame_release(const void* owner)
+{
+    for (frame_slot_t* slot = ctx.slots; slot; slot = slot->next)
+    {
+        if (slot->owner != owner)
+            continue;
+        mem_loc_t loc = {slot->ptr, slot->ptr, NULL, true, false};
+        cache_invalidate(&loc);
+        slot->owner = NULL;
+    }
+}
+
+// Writes the slots into the start block; QBE turns allocs anywhere else into dynamic stack
+// allocations (which would grow in loops). Promotable slots keep their own alloc so QBE can
+// still turn them into temporaries, all others are laid out in one frame allocation.
+static void frame_emit(void)
+{
+    size_t offset = 0;
+    for (size_t align = 16; align >= 4; align /= 2)
+    {
+        for (frame_slot_t* slot = ctx.slots; slot; slot = slot->next)
+        {
+            if (!slot->promotable && slot->align == align)
+            {
+                slot->offset = (offset + align - 1) & ~(align - 1);
+                offset       = slot->offset + slot->size;
+            }
+        }
+    }
+    offset      = (offset + 15) & ~(size_t) 15;
+    char* frame = offset ? new_temp() : NULL;
+    if (frame)
+    {
+        fprintf(ctx.frame, "%s =l alloc16 %zu\n", frame, offset);
+        ctx.il_lines++;
+    }
+    ctx.frame_bytes += offset;
+    while (ctx.slots)
+    {
+        frame_slot_t* slot = ctx.slots;
+        if (slot->promotable)
+        {
+            fprintf(ctx.frame, "%s =l alloc%zu %zu\n", slot->ptr, slot->align, slot->size);
+            ctx.frame_bytes += slot->size;
+        }
+        else
+        {
+            fprintf(ctx.frame, "%s =l add %s, %zu\n", slot->ptr, frame, slot->offset);
+        }
+        ctx.il_lines++;
+        ctx.slots = slot->next;
+        free(slot->ptr);
+        free(slot);
+    }
+    free(frame);
+}
+
+static size_t slot_align(const type_info_t* type)
+{
+    return type->size > 8 ? 16 : type->size > 4 ? 8 : 4;
 }
 
 static char* new_temp(void)
 {
-    char* buf = malloc(20);
+    char* buf = mem_malloc(20, MEM_TEMPS);
     if (!buf)
         ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for temp variable");
     sprintf(buf, "%%t%d", ctx.temp_count++);
@@ -118,29 +433,52 @@ static char* new_temp(void)
 
 static char* new_label(void)
 {
-    char* buf = malloc(20);
+    char* buf = mem_malloc(20, MEM_TEMPS);
     if (!buf)
         ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for label");
     sprintf(buf, "@l%d", ctx.label_count++);
     return buf;
 }
 
-static char str_to_qbe_type(const char* s)
+// Resolves a type name, substituting type parameters bound in `env`.
+static const type_info_t* resolve_type(const char* s, const type_env_t* env)
 {
-    static const struct
-    {
-        const char* name;
-        char        qbe_type;
-    } type_map[] = {{"int", 'w'}, {"float", 'd'}, {"string", 'l'}, {NULL, 0}};
     if (!s)
-        return 'w';
-    for (int i = 0; type_map[i].name; i++)
+        return type_lookup("int");
+    size_t len = strlen(s);
+    while (len > 9 && strncmp(s + len - 9, " restrict", 9) == 0)
+        len -= 9;
+    size_t stars = 0;
+    while (len > 0 && s[len - 1] == '*')
+        len--, stars++;
+    const type_info_t* type = NULL;
+    for (size_t i = 0; env && i < env->count; i++)
     {
-        if (strcmp(s, type_map[i].name) == 0)
-            return type_map[i].qbe_type;
+        if (strlen(env->names[i]) == len && strncmp(env->names[i], s, len) == 0)
+        {
+            type = env->types[i];
+            while (stars--)
+                type = type_pointer_to(type);
+            return type;
+        }
+    }
+    type = type_lookup(s);
+    if (!type)
+    {
+        gen_error("Unknown type");
+        return type_lookup("int");
     }
-    ERROR_FATAL(NULL, 0, 0, "Unknown type");
-    return 'w';
+    return type;
+}
+
+static const type_info_t* str_to_type(const char* s)
+{
+    return resolve_type(s, ctx.env);
+}
+
+static char str_to_qbe_type(const char* s)
+{
+    return str_to_type(s)->qbe_type;
 }
 
 static void push_scope(void)
@@ -170,17 +508,48 @@ static void pop_scope(void)
 {
     scope_t* scope    = ctx.current_scope;
     ctx.current_scope = scope->prev;
+    frame_release(scope);
     free_scope(scope);
 }
 
-static void add_sym(const char* name, size_t name_len, char* ptr, char vtype)
+static bool is_escaped(const char* name, size_t name_len)
+{
+    for (name_entry_t* n = ctx.escaped; n; n = n->next)
+    {
+        if (strlen(n->name) == name_len && strncmp(n->name, name, name_len) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Whether the slot of a local can be promoted to a register by QBE: scalars whose address is
+// never taken are only ever loaded and stored whole.
+static bool is_promotable(const type_info_t* type, const char* name, size_t name_len,
+                          const ast_node_t* at)
+{
+    const char* reason = type_is_vector(type)         ? "it has a vector type"
+                         : is_escaped(name, name_len) ? "its address is taken"
+                                                      : NULL;
+    if (reason)
+        remark_emit(REMARK_MISSED, "promote", ctx.func_name, at->line, at->column,
+                    "'%.*s' kept in memory: %s", (int) name_len, name, reason);
+    else
+        remark_emit(REMARK_PASSED, "promote", ctx.func_name, at->line, at->column,
+                    "'%.*s' promoted to a register", (int) name_len, name);
+    return !reason;
+}
+
+static void add_sym(const char* name, size_t name_len, char* ptr, const char* type_name)
 {
     sym_entry_t* e = calloc(1, sizeof(sym_entry_t));
     if (!e)
         ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for symbol");
-    e->name                    = strndup(name, name_len);
-    e->ptr                     = ptr;
-    e->vtype                   = vtype;
+    e->name        = strndup(name, name_len);
+    e->ptr         = ptr;
+    e->type        = str_to_type(type_name);
+    e->vtype       = e->type->qbe_type;
+    e->is_restrict = type_is_restrict(type_name);
+    e->escaped     = is_escaped(name, name_len);
     e->next                    = ctx.current_scope->entries;
     ctx.current_scope->entries = e;
 }
@@ -192,24 +561,36 @@ static var_info_t find_sym(const char* name)
         for (sym_entry_t* e = s->entries; e; e = e->next)
         {
             if (strcmp(e->name, name) == 0)
-                return (var_info_t){e->ptr, e->vtype};
+                return (var_info_t){e->ptr, e->vtype, e->type, e->is_restrict, e->escaped};
         }
     }
-    ERROR_FATAL(NULL, 0, 0, "Undefined variable");
-    return (var_info_t){NULL, 0};
+    for (global_t* g = ctx.globals; g; g = g->next)
+    {
+        if (strcmp(g->node->data.assign.name, name) == 0)
+            return global_var(g);
+    }
+    gen_error("Undefined variable");
+    return (var_info_t){NULL, 0, NULL, false, false};
 }
 
-static ast_node_t* find_func(const char* name)
+static ast_node_t* lookup_func(const char* name)
 {
     for (func_entry_t* f = ctx.funcs; f; f = f->next)
     {
         if (strcmp(f->name, name) == 0)
             return f->node;
     }
-    ERROR_WARN(NULL, 0, 0, "Function not found");
     return NULL;
 }
 
+static ast_node_t* find_func(const char* name)
+{
+    ast_node_t* func = lookup_func(name);
+    if (!func)
+        ERROR_WARN(NULL, ctx.line, ctx.column, "Function not found");
+    return func;
+}
+
 static void free_strings(void)
 {
     str_info_t* si = ctx.strings;
@@ -224,6 +605,44 @@ static void free_strings(void)
     ctx.strings = NULL;
 }
 
+static str_info_t* find_literal(const char* value, size_t len)
+{
+    for (str_info_t* si = ctx.strings; si; si = si->next)
+    {
+        if (si->len == len && memcmp(si->value, value, len) == 0)
+            return si;
+    }
+    return NULL;
+}
+
+// Returns the symbol of a collected literal for use in the generated code.
+static const char* use_literal(str_info_t* si)
+{
+    si->used = true;
+    return si->gname;
+}
+
+static void collect_literal(const char* value, size_t len)
+{
+    if (find_literal(value, len))
+        return;
+    char* gname = malloc(10);
+    if (!gname)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string name");
+    sprintf(gname, "$str%d", ctx.str_count++);
+    str_info_t* new_si = calloc(1, sizeof(str_info_t));
+    if (!new_si)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string info");
+    new_si->value = malloc(len);
+    if (!new_si->value)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string value");
+    memcpy(new_si->value, value, len);
+    new_si->len   = len;
+    new_si->gname = gname;
+    new_si->next  = ctx.strings;
+    ctx.strings   = new_si;
+}
+
 static void collect_strings(ast_node_t* node)
 {
     if (!node)
@@ -248,10 +667,22 @@ static void collect_strings(ast_node_t* node)
     case NODE_FUNC_CALL:
         for (size_t i = 0; i < node->data.func_call.arg_count; i++)
             collect_strings(&node->data.func_call.args[i]);
+        printf_collect(node);
         break;
     case NODE_ASSIGN:
+        collect_strings(node->data.assign.target);
         collect_strings(node->data.assign.value);
         break;
+    case NODE_BINOP:
+        collect_strings(node->data.binop.left);
+        collect_strings(node->data.binop.right);
+        break;
+    case NODE_CAST:
+        collect_strings(node->data.cast.expr);
+        break;
+    case NODE_DEREF:
+        collect_strings(node->data.deref.expr);
+        break;
     case NODE_IF:
         collect_strings(node->data.if_stmt.condition);
         collect_strings(node->data.if_stmt.then_block);
@@ -265,32 +696,13 @@ static void collect_strings(ast_node_t* node)
     case NODE_ELSE:
         collect_strings(node->data.else_stmt.block);
         break;
+    case NODE_WHILE:
+        collect_strings(node->data.while_stmt.condition);
+        collect_strings(node->data.while_stmt.body);
+        break;
     case NODE_STRING:
-    {
-        char*  value = node->data.string.value;
-        size_t len   = node->data.string.len;
-        for (str_info_t* si = ctx.strings; si; si = si->next)
-        {
-            if (si->len == len && memcmp(si->value, value, len) == 0)
-                return;
-        }
-        char* gname = malloc(10);
-        if (!gname)
-            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string name");
-        sprintf(gname, "$str%d", ctx.str_count++);
-        str_info_t* new_si = calloc(1, sizeof(str_info_t));
-        if (!new_si)
-            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string info");
-        new_si->value = malloc(len);
-        if (!new_si->value)
-            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string value");
-        memcpy(new_si->value, value, len);
-        new_si->len   = len;
-        new_si->gname = gname;
-        new_si->next  = ctx.strings;
-        ctx.strings   = new_si;
+        collect_literal(node->data.string.value, node->data.string.len);
         break;
-    }
     default:
         break;
     }
@@ -298,43 +710,41 @@ static void collect_strings(ast_node_t* node)
 
 static gen_result_t gen_number(ast_node_t* node)
 {
-    gen_result_t res = {NULL, 0};
+    gen_result_t res = {0};
     if (node->data.number.lit_type == TOKEN_NLIT)
     {
-        char* buf = malloc(32);
+        char* buf = mem_malloc(32, MEM_TEMPS);
         if (!buf)
             ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for number");
         sprintf(buf, "%ld", node->data.number.value.i64);
         res.val      = buf;
         res.qbe_type = 'w';
+        res.type     = type_lookup("int");
     }
     else
     {
-        char* buf = malloc(32);
+        char* buf = mem_malloc(32, MEM_TEMPS);
         if (!buf)
             ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for number");
-        sprintf(buf, "d_%g", node->data.number.value.f64);
+        sprintf(buf, "d_%.17g", node->data.number.value.f64);
         res.val      = buf;
         res.qbe_type = 'd';
+        res.type     = type_lookup("double");
     }
     return res;
 }
 
 static gen_result_t gen_string(ast_node_t* node)
 {
-    gen_result_t res   = {NULL, 0};
-    char*        value = node->data.string.value;
-    size_t       len   = node->data.string.len;
-    for (str_info_t* si = ctx.strings; si; si = si->next)
+    gen_result_t res = {0};
+    str_info_t*  si  = find_literal(node->data.string.value, node->data.string.len);
+    if (si)
     {
-        if (si->len == len && memcmp(si->value, value, len) == 0)
-        {
-            res.val = strdup(si->gname);
-            if (!res.val)
-                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string");
-            res.qbe_type = 'l';
-            break;
-        }
+        res.val = strdup(use_literal(si));
+        if (!res.val)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string");
+        res.qbe_type = 'l';
+        res.type     = type_lookup("string");
     }
     if (!res.val)
         ERROR_FATAL(NULL, 0, 0, "String not collected");
@@ -343,219 +753,1718 @@ static gen_result_t gen_string(ast_node_t* node)
 
 static gen_result_t gen_ident(ast_node_t* node)
 {
-    gen_result_t res = {NULL, 0};
+    gen_result_t res = {0};
     var_info_t   vi  = find_sym(node->data.ident.name);
+    if (!vi.ptr)
+        return res;
+    if (type_is_vector(vi.type))
+    {
+        // A vector variable's value is the address of its slot.
+        res.val = strdup(vi.ptr);
+        if (!res.val)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for vector");
+        res.qbe_type = 'l';
+        res.type     = vi.type;
+        return res;
+    }
+    mem_loc_t loc = {vi.ptr, vi.ptr, vi.type, !vi.escaped, false};
+    res           = gen_load(&loc);
+    if (vi.type->is_pointer)
+    {
+        res.base        = vi.ptr;
+        res.is_restrict = vi.is_restrict;
+    }
+    return res;
+}
+
+static gen_result_t gen_addr_of(ast_node_t* node)
+{
+    gen_result_t res = {0};
+    var_info_t   vi  = find_sym(node->data.addr_of.expr->data.ident.name);
     if (!vi.ptr)
         return res;
     res.val = strdup(vi.ptr);
     if (!res.val)
-        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for identifier");
-    res.qbe_type = vi.vtype;
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for address");
+    res.qbe_type = 'l';
+    res.type     = type_pointer_to(vi.type);
+    res.base     = vi.ptr;
     return res;
 }
 
-static gen_result_t gen_binop(token_type_t op, gen_result_t left, gen_result_t right)
+static gen_result_t gen_deref(ast_node_t* node)
 {
-    gen_result_t res = {NULL, 0};
-    if (!left.val || !right.val)
-        return res;
-    static const struct
-    {
-        token_type_t token;
-        const char*  opstr;
-        int          is_comp;
-    } ops[]           = {{TOKEN_PLUS, "add", 0},  {TOKEN_MINUS, "sub", 0},   {TOKEN_STAR, "mul", 0},
-                         {TOKEN_SLASH, "div", 0}, {TOKEN_PERCENT, "rem", 0}, {TOKEN_EQ, "ceq", 1},
-                         {TOKEN_NEQ, "cne", 1},   {TOKEN_LT, "slt", 1},      {TOKEN_LTE, "sle", 1},
-                         {TOKEN_GT, "sgt", 1},    {TOKEN_GTE, "sge", 1},     {0, NULL, 0}};
-    const char* opstr = NULL;
-    int         is_comp = 0;
-    for (int i = 0; ops[i].opstr; i++)
-    {
-        if (ops[i].token == op)
-        {
-            opstr   = ops[i].opstr;
-            is_comp = ops[i].is_comp;
-            break;
-        }
-    }
-    if (!opstr)
-    {
-        ERROR_FATAL(NULL, 0, 0, "Unimplemented binary operator");
-        free(left.val);
-        free(right.val);
-        return res;
-    }
-    char  otype   = left.qbe_type;
-    char* tmp     = new_temp();
-    char* full_op = malloc(strlen(opstr) + 2);
-    if (!full_op)
-        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for operator");
-    sprintf(full_op, "%s%c", opstr, otype);
-    if (is_comp)
+    gen_result_t ptr = gen_expr(node->data.deref.expr);
+    if (!ptr.val)
+        return ptr;
+    const type_info_t* type = result_type(ptr);
+    if (!type->is_pointer)
     {
-        emit("%s =w %s %s, %s\n", tmp, full_op, left.val, right.val);
-        res.qbe_type = 'w';
+        gen_error("Cannot dereference a non-pointer value");
+        free(ptr.val);
+        return (gen_result_t){0};
     }
-    else
+    if (type_is_vector(type->pointee))
     {
-        emit("%s =%c %s %s, %s\n", tmp, otype, opstr, left.val, right.val);
-        res.qbe_type = otype;
+        // Vector loads are left to the operation consuming the value.
+        return (gen_result_t){.val = ptr.val, .qbe_type = 'l', .type = type->pointee};
     }
-    res.val = tmp;
-    free(full_op);
-    free(left.val);
-    free(right.val);
+    mem_loc_t    loc = {ptr.val, ptr.base, type->pointee, false, ptr.is_restrict};
+    gen_result_t res = gen_load(&loc);
+    free(ptr.val);
     return res;
 }
 
-static gen_result_t gen_binop_node(ast_node_t* node)
+/* ================== */
+/* Memory optimizer   */
+/* ================== */
+static void collect_escaped(ast_node_t* node, void* data)
 {
-    gen_result_t left  = gen_expr(node->data.binop.left);
-    gen_result_t right = gen_expr(node->data.binop.right);
-    return gen_binop(node->data.binop.op, left, right);
+    (void) data;
+    if (node->type != NODE_ADDR_OF)
+        return;
+    name_entry_t* n = calloc(1, sizeof(name_entry_t));
+    if (!n)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for escaped variable");
+    n->name     = strdup(node->data.addr_of.expr->data.ident.name);
+    n->next     = ctx.escaped;
+    ctx.escaped = n;
 }
 
-static gen_result_t gen_func_call(ast_node_t* node)
+static void free_escaped(void)
 {
-    gen_result_t res  = {NULL, 0};
-    char*        name = strndup(node->data.func_call.name, node->data.func_call.name_len);
-    if (!name)
-        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function name");
-    ast_node_t* func        = find_func(name);
-    char        ret_type    = func ? str_to_qbe_type(func->data.func_def.return_type) : 'l';
-    bool        is_variadic = false;
-    if (func)
-    {
-        for (param_node_t* param = func->data.func_def.params; param; param = param->next)
-        {
-            if (param->is_variadic)
-            {
-                is_variadic = true;
-                break;
-            }
-        }
-    }
-    param_node_t* param       = func ? func->data.func_def.params : NULL;
-    size_t        param_count = 0;
-    for (param_node_t* p = param; p && !p->is_variadic; p = p->next)
-        param_count++;
-    gen_result_t* args = calloc(node->data.func_call.arg_count, sizeof(gen_result_t));
-    if (!args)
-        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for arguments");
-    for (size_t i = 0; i < node->data.func_call.arg_count; i++)
-    {
-        args[i] = gen_expr(&node->data.func_call.args[i]);
-        if (!args[i].val)
-        {
-            for (size_t j = 0; j < i; j++)
-                free(args[j].val);
-            free(args);
-            free(name);
-            return res;
-        }
-    }
-    char* tmp = NULL;
-    if (ret_type != 0)
+    while (ctx.escaped)
     {
-        tmp = new_temp();
-        emit("%s =%c call $%s (", tmp, ret_type, name);
+        name_entry_t* next = ctx.escaped->next;
+        free(ctx.escaped->name);
+        free(ctx.escaped);
+        ctx.escaped = next;
     }
-    else
+}
+
+static void free_load_entry(load_entry_t* e)
+{
+    free((char*) e->loc.addr);
+    free((char*) e->loc.base);
+    free(e->val);
+    free(e);
+}
+
+static void cache_clear(void)
+{
+    while (ctx.load_cache)
     {
-        emit("call $%s (", name);
+        load_entry_t* next = ctx.load_cache->next;
+        free_load_entry(ctx.load_cache);
+        ctx.load_cache = next;
     }
-    for (size_t i = 0; i < node->data.func_call.arg_count; i++)
+}
+
+// Drops every known value that a write to `loc` may clobber. A NULL `loc` stands for an unknown
+// write (e.g. a call), which clobbers everything except non-escaping stack slots.
+static void cache_invalidate(const mem_loc_t* loc)
+{
+    load_entry_t** link = &ctx.load_cache;
+    while (*link)
     {
-        char ptype = 'w';
-        if (param && i < param_count && !is_variadic)
+        load_entry_t* e       = *link;
+        bool          clobber = loc ? alias_query(&e->loc, loc) != ALIAS_NO : !e->loc.is_stack;
+        if (clobber)
         {
-            ptype = str_to_qbe_type(param->type);
-            param = param->next;
+            *link = e->next;
+            free_load_entry(e);
         }
-        else if (args[i].qbe_type)
+        else
         {
-            ptype = args[i].qbe_type;
+            link = &e->next;
         }
-        emit("%c %s", ptype, args[i].val);
-        if (i < node->data.func_call.arg_count - 1)
-            emit(", ");
-        free(args[i].val);
-    }
-    emit(")\n");
-    free(args);
-    free(name);
-    if (ret_type != 0)
-    {
-        res.val      = tmp;
-        res.qbe_type = ret_type;
     }
-    return res;
 }
 
-static void gen_func_call_stmt(ast_node_t* node)
+static void cache_insert(const mem_loc_t* loc, const char* val)
 {
-    gen_result_t res = gen_func_call(node);
-    if (res.val)
-        free(res.val);
+    load_entry_t* e = calloc(1, sizeof(load_entry_t));
+    if (!e)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for load cache entry");
+    e->loc      = *loc;
+    e->loc.addr = strdup(loc->addr);
+    e->loc.base = loc->base ? strdup(loc->base) : NULL;
+    e->val      = strdup(val);
+    if (!e->loc.addr || !e->val)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for load cache entry");
+    e->next        = ctx.load_cache;
+    ctx.load_cache = e;
 }
 
-static gen_result_t gen_assign(ast_node_t* node)
+static gen_result_t gen_load(const mem_loc_t* loc)
 {
-    gen_result_t res  = {NULL, 0};
-    char*        name = strndup(node->data.assign.name, node->data.assign.name_len);
-    if (!name)
-        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for variable name");
-    gen_result_t val = {NULL, 0};
-    if (node->data.assign.value)
+    gen_result_t res = {.qbe_type = loc->type->qbe_type, .type = loc->type};
+    if (ctx.opts->opt_level > 0)
     {
-        val = gen_expr(node->data.assign.value);
-        if (!val.val)
+        for (load_entry_t* e = ctx.load_cache; e; e = e->next)
         {
-            free(name);
-            return res;
+            if (e->loc.type == loc->type && alias_query(&e->loc, loc) == ALIAS_MUST)
+            {
+                res.val = strdup(e->val);
+                if (!res.val)
+                    ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for load");
+                ctx.forwarded_loads++;
+                return res;
+            }
         }
     }
-    if (node->data.assign.type)
-    {
-        char  vtype      = str_to_qbe_type(node->data.assign.type);
-        char* ptr        = new_temp();
-        int   alloc_size = (vtype == 'w' || vtype == 's') ? 4 : 8;
-        emit("%s =l alloc%d 1\n", ptr, alloc_size);
-        add_sym(name, node->data.assign.name_len, ptr, vtype);
-        if (node->data.assign.value)
-        {
-            emit("store%c %s, %s\n", vtype, val.val, ptr);
-            res.val = strdup(val.val);
-            if (!res.val)
-                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for result");
-            res.qbe_type = vtype;
+    res.val = new_temp();
+    emit("%s =%c %s %s\n", res.val, res.qbe_type, type_load_op(loc->type), loc->addr);
+    if (ctx.opts->opt_level > 0)
+        cache_insert(loc, res.val);
+    return res;
+}
+
+static void gen_store(const mem_loc_t* loc, const char* val)
+{
+    emit("%s %s, %s\n", type_store_op(loc->type), val, loc->addr);
+    if (ctx.opts->opt_level == 0)
+        return;
+    cache_invalidate(loc);
+    // Sub-word stores truncate, so the stored value can't be forwarded as is.
+    if (loc->type->size >= 4 || loc->type->is_pointer)
+        cache_insert(loc, val);
+}
+
+static const type_info_t* result_type(gen_result_t res)
+{
+    if (res.type)
+        return res.type;
+    switch (res.qbe_type)
+    {
+    case 'l':
+        return type_lookup("long");
+    case 's':
+        return type_lookup("float");
+    case 'd':
+        return type_lookup("double");
+    default:
+        return type_lookup("int");
+    }
+}
+
+// Usual arithmetic conversions: floats win, then pointers, then the wider (or unsigned) integer.
+static const type_info_t* common_type(const type_info_t* a, const type_info_t* b)
+{
+    if (a->is_float || b->is_float)
+    {
+        if (a->qbe_type == 'd' || b->qbe_type == 'd')
+            return type_lookup("double");
+        return type_lookup("float");
+    }
+    if (a->is_pointer)
+        return a;
+    if (b->is_pointer)
+        return b;
+    if (a->size < 4)
+        a = type_lookup("int");
+    if (b->size < 4)
+        b = type_lookup("int");
+    if (a->size != b->size)
+        return a->size > b->size ? a : b;
+    return a->is_signed ? b : a;
+}
+
+static int64_t truncate_int(int64_t v, const type_info_t* to)
+{
+    switch (to->is_pointer ? 8 : to->size)
+    {
+    case 1:
+        return to->is_signed ? (int64_t) (int8_t) v : (int64_t) (uint8_t) v;
+    case 2:
+        return to->is_signed ? (int64_t) (int16_t) v : (int64_t) (uint16_t) v;
+    case 4:
+        return to->is_signed ? (int64_t) (int32_t) v : (int64_t) (uint32_t) v;
+    default:
+        return v;
+    }
+}
+
+// Folds a conversion of a literal operand, returns NULL if `val` is not a literal.
+static char* fold_convert(const char* val, const type_info_t* from, const type_info_t* to)
+{
+    bool is_float_lit = (val[0] == 's' || val[0] == 'd') && val[1] == '_';
+    bool is_int_lit   = val[0] == '-' || (val[0] >= '0' && val[0] <= '9');
+    if (!is_float_lit && !is_int_lit)
+        return NULL;
+    char* buf = malloc(40);
+    if (!buf)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for constant");
+    if (to->is_float)
+    {
+        double v = is_float_lit ? strtod(val + 2, NULL)
+                   : from->is_signed ? (double) strtoll(val, NULL, 10)
+                                     : (double) strtoull(val, NULL, 10);
+        if (to->qbe_type == 's')
+            v = (float) v;
+        sprintf(buf, "%c_%.17g", to->qbe_type, v);
+    }
+    else
+    {
+        int64_t v = is_float_lit ? (int64_t) strtod(val + 2, NULL) : strtoll(val, NULL, 10);
+        sprintf(buf, "%lld", (long long) truncate_int(v, to));
+    }
+    return buf;
+}
+
+// Lowers a value conversion to the minimal QBE instruction sequence. Conversions that stay
+// within one QBE class (e.g. int <-> uint, long <-> pointer) emit nothing.
+static gen_result_t gen_convert(gen_result_t res, const type_info_t* to)
+{
+    if (!res.val || !to || !to->qbe_type)
+        return res;
+    const type_info_t* from = result_type(res);
+    if (from == to)
+        return res;
+    if (type_is_vector(from) || type_is_vector(to))
+        return vec_coerce(res, to);
+
+    gen_result_t out = {.qbe_type = to->qbe_type, .type = to};
+    out.val          = fold_convert(res.val, from, to);
+    if (out.val)
+    {
+        free(res.val);
+        return out;
+    }
+
+    char fc = from->qbe_type;
+    char tc = to->qbe_type;
+    if (from->is_float && to->is_float)
+    {
+        if (fc == tc)
+        {
+            res.type = to;
+            return res;
+        }
+        out.val = new_temp();
+        emit("%s =%c %s %s\n", out.val, tc, fc == 's' ? "exts" : "truncd", res.val);
+    }
+    else if (from->is_float)
+    {
+        // Types narrower than a word are converted to an int and extended from their width.
+        bool narrow = to->size < 4;
+        out.val     = new_temp();
+        emit("%s =%c %cto%s %s\n", out.val, tc, fc, to->is_signed || narrow ? "si" : "ui",
+             res.val);
+        if (narrow)
+        {
+            char* wide = out.val;
+            out.val    = new_temp();
+            emit("%s =w ext%c%c %s\n", out.val, to->is_signed ? 's' : 'u',
+                 to->size == 1 ? 'b' : 'h', wide);
+            free(wide);
+        }
+    }
+    else if (to->is_float)
+    {
+        bool is_signed = from->is_signed && !from->is_pointer;
+        out.val        = new_temp();
+        emit("%s =%c %c%ctof %s\n", out.val, tc, is_signed ? 's' : 'u', fc, res.val);
+    }
+    else
+    {
+        if (fc == 'w' && tc == 'l')
+        {
+            out.val = new_temp();
+            emit("%s =l %s %s\n", out.val, from->is_signed ? "extsw" : "extuw", res.val);
+        }
+        bool narrow = !to->is_pointer && to->size < 4 &&
+                      (from->is_pointer || from->size > to->size ||
+                       from->is_signed != to->is_signed);
+        if (narrow)
+        {
+            // NOTE: QBE accepts an l operand where a w is expected, no explicit truncation needed.
+            out.val = new_temp();
+            emit("%s =w ext%c%c %s\n", out.val, to->is_signed ? 's' : 'u',
+                 to->size == 1 ? 'b' : 'h', res.val);
+        }
+        if (!out.val)
+        {
+            res.qbe_type = tc;
+            res.type     = to;
+            return res;
+        }
+    }
+    free(res.val);
+    return out;
+}
+
+static gen_result_t gen_cast(ast_node_t* node)
+{
+    gen_result_t       val  = gen_expr(node->data.cast.expr);
+    const type_info_t* type = str_to_type(node->data.cast.type);
+    if (type->qbe_type == 0)
+    {
+        // (void) expr: evaluate for side effects only
+        free(val.val);
+        return (gen_result_t){0};
+    }
+    return gen_convert(val, type);
+}
+
+// Pointer +/- integer scales by the pointee size, pointer - pointer yields an element count.
+static gen_result_t gen_pointer_arith(token_type_t op, gen_result_t left, gen_result_t right)
+{
+    const type_info_t* lt = result_type(left);
+    const type_info_t* rt = result_type(right);
+    if (lt->is_pointer && rt->is_pointer)
+    {
+        if (op != TOKEN_MINUS)
+            gen_error("Invalid operands to pointer arithmetic");
+        size_t       size = lt->pointee->size ? lt->pointee->size : 1;
+        gen_result_t res  = {.val = new_temp(), .qbe_type = 'l', .type = type_lookup("long")};
+        emit("%s =l sub %s, %s\n", res.val, left.val, right.val);
+        if (size > 1)
+        {
+            char* quot = new_temp();
+            emit("%s =l div %s, %zu\n", quot, res.val, size);
+            free(res.val);
+            res.val = quot;
+        }
+        free(left.val);
+        free(right.val);
+        return res;
+    }
+    if (rt->is_pointer)
+    {
+        if (op == TOKEN_MINUS)
+            gen_error("Cannot subtract a pointer from an integer");
+        gen_result_t tmp = left;
+        left             = right;
+        right            = tmp;
+        lt               = rt;
+    }
+    size_t size = lt->pointee->size ? lt->pointee->size : 1;
+    right       = gen_convert(right, type_lookup("long"));
+    if (size > 1)
+    {
+        char* scaled = new_temp();
+        emit("%s =l mul %s, %zu\n", scaled, right.val, size);
+        free(right.val);
+        right.val = scaled;
+    }
+    gen_result_t res = left;
+    res.val          = new_temp();
+    emit("%s =l %s %s, %s\n", res.val, op == TOKEN_PLUS ? "add" : "sub", left.val, right.val);
+    free(left.val);
+    free(right.val);
+    return res;
+}
+
+static gen_result_t gen_binop(token_type_t op, gen_result_t left, gen_result_t right)
+{
+    gen_result_t res = {0};
+    if (!left.val || !right.val)
+        return res;
+    if (type_is_vector(result_type(left)) || type_is_vector(result_type(right)))
+        return gen_vector_binop(op, left, right);
+    if ((op == TOKEN_PLUS || op == TOKEN_MINUS) &&
+        (result_type(left)->is_pointer || result_type(right)->is_pointer))
+        return gen_pointer_arith(op, left, right);
+    static const struct
+    {
+        token_type_t token;
+        const char*  opstr;
+        const char*  uopstr; // unsigned variant
+        const char*  fopstr; // floating point variant
+        int          is_comp;
+    } ops[] = {{TOKEN_PLUS, "add", "add", "add", 0},      {TOKEN_MINUS, "sub", "sub", "sub", 0},
+               {TOKEN_STAR, "mul", "mul", "mul", 0},      {TOKEN_SLASH, "div", "udiv", "div", 0},
+               {TOKEN_PERCENT, "rem", "urem", NULL, 0},   {TOKEN_EQ, "ceq", "ceq", "ceq", 1},
+               {TOKEN_NEQ, "cne", "cne", "cne", 1},       {TOKEN_LT, "cslt", "cult", "clt", 1},
+               {TOKEN_LTE, "csle", "cule", "cle", 1},     {TOKEN_GT, "csgt", "cugt", "cgt", 1},
+               {TOKEN_GTE, "csge", "cuge", "cge", 1},     {0, NULL, NULL, NULL, 0}};
+    const type_info_t* type    = common_type(result_type(left), result_type(right));
+    const char*        opstr   = NULL;
+    int                is_comp = 0;
+    for (int i = 0; ops[i].opstr; i++)
+    {
+        if (ops[i].token == op)
+        {
+            opstr   = type->is_float                       ? ops[i].fopstr
+                      : (type->is_signed && !type->is_pointer) ? ops[i].opstr
+                                                               : ops[i].uopstr;
+            is_comp = ops[i].is_comp;
+            break;
+        }
+    }
+    if (!opstr)
+    {
+        gen_error("Unimplemented binary operator");
+        free(left.val);
+        free(right.val);
+        return res;
+    }
+    left        = gen_convert(left, type);
+    right       = gen_convert(right, type);
+    char  otype = type->qbe_type;
+    char* tmp   = new_temp();
+    if (is_comp)
+    {
+        emit("%s =w %s%c %s, %s\n", tmp, opstr, otype, left.val, right.val);
+        res.qbe_type = 'w';
+        res.type     = type_lookup("int");
+    }
+    else
+    {
+        emit("%s =%c %s %s, %s\n", tmp, otype, opstr, left.val, right.val);
+        res.qbe_type = otype;
+        res.type     = type;
+    }
+    res.val = tmp;
+    free(left.val);
+    free(right.val);
+    return res;
+}
+
+static gen_result_t gen_binop_node(ast_node_t* node)
+{
+    gen_result_t left  = gen_expr(node->data.binop.left);
+    gen_result_t right = gen_expr(node->data.binop.right);
+    return gen_binop(node->data.binop.op, left, right);
+}
+
+/* ================== */
+/* Vectors            */
+/* ================== */
+static char* vec_addr(const char* base, size_t offset)
+{
+    if (offset == 0)
+    {
+        char* addr = strdup(base);
+        if (!addr)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for address");
+        return addr;
+    }
+    char* addr = new_temp();
+    emit("%s =l add %s, %zu\n", addr, base, offset);
+    return addr;
+}
+
+static void vec_copy(const char* dst, const char* src, const type_info_t* type)
+{
+    for (size_t offset = 0; offset < type->size; offset += 8)
+    {
+        char* from = vec_addr(src, offset);
+        char* to   = vec_addr(dst, offset);
+        char* tmp  = new_temp();
+        emit("%s =l loadl %s\n", tmp, from);
+        emit("storel %s, %s\n", tmp, to);
+        free(from);
+        free(to);
+        free(tmp);
+    }
+}
+
+static gen_result_t vec_load_lane(const char* base, const type_info_t* type, size_t lane)
+{
+    const type_info_t* elem = type->elem;
+    char*              addr = vec_addr(base, lane * elem->size);
+    gen_result_t       res  = {.val = new_temp(), .qbe_type = elem->qbe_type, .type = elem};
+    emit("%s =%c %s %s\n", res.val, elem->qbe_type, type_load_op(elem), addr);
+    free(addr);
+    return res;
+}
+
+static void vec_store_lane(const char* base, const type_info_t* type, size_t lane,
+                           gen_result_t val)
+{
+    val = gen_convert(val, type->elem);
+    if (!val.val)
+        return;
+    char* addr = vec_addr(base, lane * type->elem->size);
+    emit("%s %s, %s\n", type_store_op(type->elem), val.val, addr);
+    free(addr);
+    free(val.val);
+}
+
+// Broadcasts a scalar into every lane of a new vector.
+static gen_result_t vec_splat(gen_result_t val, const type_info_t* type)
+{
+    val = gen_convert(val, type->elem);
+    if (!val.val)
+        return val;
+    char* dst = frame_alloc(type->size, slot_align(type), 0);
+    for (size_t lane = 0; lane < type->lanes; lane++)
+    {
+        char* addr = vec_addr(dst, lane * type->elem->size);
+        emit("%s %s, %s\n", type_store_op(type->elem), val.val, addr);
+        free(addr);
+    }
+    free(val.val);
+    return (gen_result_t){.val = dst, .qbe_type = 'l', .type = type};
+}
+
+// Vectors of the same size are reinterpreted, scalars are broadcast into every lane.
+static gen_result_t vec_coerce(gen_result_t res, const type_info_t* to)
+{
+    if (!res.val)
+        return res;
+    const type_info_t* from = result_type(res);
+    if (from == to)
+        return res;
+    if (type_is_vector(from) && type_is_vector(to) && from->size == to->size)
+    {
+        res.type = to;
+        return res;
+    }
+    if (!type_is_vector(from) && !from->is_pointer && type_is_vector(to))
+        return vec_splat(res, to);
+    gen_error("Invalid conversion between vector types");
+    free(res.val);
+    return (gen_result_t){0};
+}
+
+// Element-wise arithmetic. Uses a native stub when the target ISA has the instruction, otherwise
+// the operation is scalarized lane by lane.
+static gen_result_t gen_vector_binop(token_type_t op, gen_result_t left, gen_result_t right)
+{
+    static const struct
+    {
+        token_type_t token;
+        simd_op_t    op;
+    } ops[] = {{TOKEN_PLUS, SIMD_ADD}, {TOKEN_MINUS, SIMD_SUB}, {TOKEN_STAR, SIMD_MUL},
+               {TOKEN_SLASH, SIMD_DIV}};
+    const type_info_t* lt   = result_type(left);
+    const type_info_t* rt   = result_type(right);
+    const type_info_t* type = type_is_vector(lt) ? lt : rt;
+    int                sop  = -1;
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        if (ops[i].token == op)
+            sop = ops[i].op;
+    }
+    if (sop < 0 || (type_is_vector(lt) && type_is_vector(rt) && lt != rt))
+    {
+        gen_error(sop < 0 ? "Unsupported vector operator" : "Mismatched vector operand types");
+        free(left.val);
+        free(right.val);
+        return (gen_result_t){0};
+    }
+    left  = vec_coerce(left, type);
+    right = vec_coerce(right, type);
+    if (!left.val || !right.val)
+    {
+        free(left.val);
+        free(right.val);
+        return (gen_result_t){0};
+    }
+    char*       dst  = frame_alloc(type->size, slot_align(type), 0);
+    const char* stub = simd_stub((simd_op_t) sop, type, 0, ctx.opts->simd);
+    if (stub)
+    {
+        emit("call $%s (l %s, l %s, l %s)\n", stub, dst, left.val, right.val);
+    }
+    else
+    {
+        for (size_t lane = 0; lane < type->lanes; lane++)
+        {
+            gen_result_t val = gen_binop(op, vec_load_lane(left.val, type, lane),
+                                         vec_load_lane(right.val, type, lane));
+            vec_store_lane(dst, type, lane, val);
+        }
+    }
+    free(left.val);
+    free(right.val);
+    return (gen_result_t){.val = dst, .qbe_type = 'l', .type = type};
+}
+
+static bool lane_index(ast_node_t* arg, size_t lanes, size_t* out)
+{
+    if (arg->type != NODE_NUMBER || arg->data.number.lit_type != TOKEN_NLIT ||
+        arg->data.number.value.i64 < 0 || (size_t) arg->data.number.value.i64 >= lanes)
+    {
+        gen_error("Lane index must be a constant within the vector");
+        return false;
+    }
+    *out = (size_t) arg->data.number.value.i64;
+    return true;
+}
+
+// Lowers shuffle(v, i0, ..., iN), reduce_add(v) and lane(v, i). Returns false if `name` is not a
+// vector builtin.
+static bool gen_vector_builtin(ast_node_t* node, const char* name, gen_result_t* out)
+{
+    bool is_shuffle = strcmp(name, "shuffle") == 0;
+    bool is_reduce  = strcmp(name, "reduce_add") == 0;
+    bool is_lane    = strcmp(name, "lane") == 0;
+    if (!is_shuffle && !is_reduce && !is_lane)
+        return false;
+    *out              = (gen_result_t){0};
+    size_t      argc  = node->data.func_call.arg_count;
+    ast_node_t* args  = node->data.func_call.args;
+    size_t      extra = is_reduce ? 0 : 1;
+    if (argc == 0)
+    {
+        gen_error("Vector builtin expects a vector argument");
+        return true;
+    }
+    gen_result_t       src  = gen_expr(&args[0]);
+    const type_info_t* type = result_type(src);
+    if (!src.val || !type_is_vector(type))
+    {
+        gen_error("Vector builtin expects a vector argument");
+        free(src.val);
+        return true;
+    }
+    if (is_shuffle)
+        extra = type->lanes;
+    size_t index[32];
+    bool   ok = argc == 1 + extra;
+    if (!ok)
+        gen_error("Wrong number of arguments to vector builtin");
+    for (size_t i = 0; ok && i < extra; i++)
+        ok = lane_index(&args[1 + i], type->lanes, &index[i]);
+    if (!ok)
+    {
+        free(src.val);
+        return true;
+    }
+
+    if (is_lane)
+    {
+        *out = vec_load_lane(src.val, type, index[0]);
+    }
+    else if (is_shuffle)
+    {
+        unsigned imm = 0;
+        for (size_t i = 0; i < type->lanes && i < 4; i++)
+            imm |= (unsigned) index[i] << (2 * i);
+        char*       dst  = frame_alloc(type->size, slot_align(type), 0);
+        const char* stub = simd_stub(SIMD_SHUFFLE, type, imm, ctx.opts->simd);
+        if (stub)
+            emit("call $%s (l %s, l %s)\n", stub, dst, src.val);
+        for (size_t i = 0; !stub && i < type->lanes; i++)
+            vec_store_lane(dst, type, i, vec_load_lane(src.val, type, index[i]));
+        *out = (gen_result_t){.val = dst, .qbe_type = 'l', .type = type};
+    }
+    else
+    {
+        const type_info_t* rtype = simd_reduce_type(type);
+        const char*        stub  = simd_stub(SIMD_REDUCE_ADD, type, 0, ctx.opts->simd);
+        if (stub)
+        {
+            *out = (gen_result_t){.val = new_temp(), .qbe_type = rtype->qbe_type, .type = rtype};
+            emit("%s =%c call $%s (l %s)\n", out->val, rtype->qbe_type, stub, src.val);
+        }
+        else
+        {
+            *out = gen_convert(vec_load_lane(src.val, type, 0), rtype);
+            for (size_t i = 1; i < type->lanes; i++)
+                *out = gen_binop(TOKEN_PLUS, *out,
+                                 gen_convert(vec_load_lane(src.val, type, i), rtype));
+        }
+    }
+    free(src.val);
+    return true;
+}
+
+/* ================== */
+/* Memory builtins    */
+/* ================== */
+
+// Calls to the std.mem functions are recognized by name unless the program defines them itself.
+// Small constant sizes are expanded into loads and stores, everything else calls the function,
+// which is the std.mem runtime if the program imports it and the C library otherwise.
+#define MEM_INLINE_MAX 32
+
+static const struct
+{
+    const char* name;
+    const char* ret;
+    const char* params[3];
+    size_t      param_count;
+} mem_builtins[] = {
+    {"memcpy", "void*", {"void*", "void*", "ulong"}, 3},
+    {"memset", "void*", {"void*", "int", "ulong"}, 3},
+    {"memcmp", "int", {"void*", "void*", "ulong"}, 3},
+    {"strlen", "ulong", {"char*"}, 1},
+};
+
+static bool mem_const_size(ast_node_t* arg, size_t* out)
+{
+    if (arg->type != NODE_NUMBER || arg->data.number.lit_type != TOKEN_NLIT ||
+        arg->data.number.value.i64 < 0)
+        return false;
+    *out = (size_t) arg->data.number.value.i64;
+    return true;
+}
+
+// Chunk type for the next `n` bytes: the widest integer that still fits.
+static const type_info_t* mem_chunk_type(size_t n)
+{
+    return type_lookup(n >= 8 ? "ulong" : n >= 4 ? "uint" : n >= 2 ? "ushort" : "uchar");
+}
+
+static char* mem_offset(const char* base, size_t offset)
+{
+    if (offset == 0)
+        return strdup(base);
+    char* addr = new_temp();
+    emit("%s =l add %s, %zu\n", addr, base, offset);
+    return addr;
+}
+
+static void mem_inline_copy(const char* dst, const char* src, size_t n)
+{
+    for (size_t offset = 0; offset < n;)
+    {
+        const type_info_t* chunk = mem_chunk_type(n - offset);
+        char*              from  = mem_offset(src, offset);
+        char*              to    = mem_offset(dst, offset);
+        char*              val   = new_temp();
+        emit("%s =%c %s %s\n", val, chunk->qbe_type, type_load_op(chunk), from);
+        emit("%s %s, %s\n", type_store_op(chunk), val, to);
+        offset += chunk->size;
+        free(from);
+        free(to);
+        free(val);
+    }
+}
+
+// `pattern` is the byte repeated over a long, narrower stores use its low bits.
+static void mem_inline_set(const char* dst, const char* pattern, size_t n)
+{
+    for (size_t offset = 0; offset < n;)
+    {
+        const type_info_t* chunk = mem_chunk_type(n - offset);
+        char*              to    = mem_offset(dst, offset);
+        emit("%s %s, %s\n", type_store_op(chunk), pattern, to);
+        offset += chunk->size;
+        free(to);
+    }
+}
+
+static bool gen_mem_builtin(ast_node_t* node, const char* name, gen_result_t* out)
+{
+    size_t b     = 0;
+    size_t count = sizeof(mem_builtins) / sizeof(mem_builtins[0]);
+    while (b < count && strcmp(mem_builtins[b].name, name) != 0)
+        b++;
+    ast_node_t* user = lookup_func(name);
+    if (b < count && user && !user->data.func_def.is_declaration)
+        remark_emit(REMARK_MISSED, "mem-inline", ctx.func_name, node->line, node->column,
+                    "'%s' not expanded inline: the program defines it", name);
+    if (b == count || (user && !user->data.func_def.is_declaration) ||
+        node->data.func_call.arg_count != mem_builtins[b].param_count)
+        return false;
+    *out                     = (gen_result_t){0};
+    ast_node_t*        args  = node->data.func_call.args;
+    const type_info_t* ret   = type_lookup(mem_builtins[b].ret);
+    bool               is_copy = strcmp(name, "memcpy") == 0;
+    bool               is_set  = strcmp(name, "memset") == 0;
+    size_t             n       = 0;
+    bool               is_small =
+        (is_copy || is_set) && mem_const_size(&args[2], &n) && n <= MEM_INLINE_MAX;
+
+    // strlen of a literal and memcmp of nothing are constants.
+    if (strcmp(name, "strlen") == 0 && args[0].type == NODE_STRING)
+    {
+        out->val = malloc(24);
+        if (!out->val)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for result");
+        sprintf(out->val, "%zu", strnlen(args[0].data.string.value, args[0].data.string.len));
+        out->qbe_type = ret->qbe_type;
+        out->type     = ret;
+        ctx.mem_inlined++;
+        remark_emit(REMARK_PASSED, "mem-inline", ctx.func_name, node->line, node->column,
+                    "strlen of a string literal folded to %s", out->val);
+        return true;
+    }
+
+    gen_result_t vals[3] = {0};
+    for (size_t i = 0; i < mem_builtins[b].param_count; i++)
+    {
+        vals[i] = gen_convert(gen_expr(&args[i]), type_lookup(mem_builtins[b].params[i]));
+        if (!vals[i].val)
+        {
+            for (size_t j = 0; j < i; j++)
+                free(vals[j].val);
+            return true;
+        }
+    }
+    if (strcmp(name, "memcmp") == 0 && mem_const_size(&args[2], &n) && n == 0)
+    {
+        *out = (gen_result_t){.val = strdup("0"), .qbe_type = ret->qbe_type, .type = ret};
+        ctx.mem_inlined++;
+        remark_emit(REMARK_PASSED, "mem-inline", ctx.func_name, node->line, node->column,
+                    "memcmp of 0 bytes folded to 0");
+    }
+    else if (is_small)
+    {
+        if (is_copy)
+        {
+            mem_inline_copy(vals[0].val, vals[1].val, n);
+        }
+        else if (args[1].type == NODE_NUMBER && args[1].data.number.lit_type == TOKEN_NLIT)
+        {
+            char pattern[24];
+            sprintf(pattern, "%lu",
+                    (unsigned long) (uint8_t) args[1].data.number.value.i64 * 0x0101010101010101UL);
+            mem_inline_set(vals[0].val, pattern, n);
+        }
+        else
+        {
+            char* byte    = new_temp();
+            char* pattern = new_temp();
+            emit("%s =l extub %s\n", byte, vals[1].val);
+            emit("%s =l mul %s, %lu\n", pattern, byte, 0x0101010101010101UL);
+            mem_inline_set(vals[0].val, pattern, n);
+            free(byte);
+            free(pattern);
+        }
+        mem_loc_t loc = {vals[0].val, vals[0].base, type_lookup("uchar"), false,
+                         vals[0].is_restrict};
+        cache_invalidate(&loc);
+        *out         = vals[0];
+        out->type    = ret;
+        vals[0].val  = NULL;
+        ctx.mem_inlined++;
+        remark_emit(REMARK_PASSED, "mem-inline", ctx.func_name, node->line, node->column,
+                    "%s of %zu bytes expanded inline", name, n);
+    }
+    else
+    {
+        if (!is_copy && !is_set)
+            remark_emit(REMARK_MISSED, "mem-inline", ctx.func_name, node->line, node->column,
+                        "%s not folded: %s", name,
+                        strcmp(name, "strlen") == 0 ? "the argument is not a string literal"
+                                                    : "the size is not a constant 0");
+        else if (!mem_const_size(&args[2], &n))
+            remark_emit(REMARK_MISSED, "mem-inline", ctx.func_name, node->line, node->column,
+                        "%s not expanded inline: the size is not a constant", name);
+        else
+            remark_emit(REMARK_MISSED, "mem-inline", ctx.func_name, node->line, node->column,
+                        "%s not expanded inline: %zu bytes exceed the limit of %d", name, n,
+                        MEM_INLINE_MAX);
+        out->val      = new_temp();
+        out->qbe_type = ret->qbe_type;
+        out->type     = ret;
+        emit("%s =%c call $%s (", out->val, ret->qbe_type, name);
+        for (size_t i = 0; i < mem_builtins[b].param_count; i++)
+            emit("%s%c %s", i ? ", " : "", vals[i].qbe_type, vals[i].val);
+        emit(")\n");
+        cache_invalidate(NULL);
+    }
+    for (size_t i = 0; i < mem_builtins[b].param_count; i++)
+        free(vals[i].val);
+    return true;
+}
+
+// At -O1 a printf whose result is unused and whose format is a literal is specialized for its
+// format: the text is written with fwrite (or fputc), integers are formatted by
+// $__micro_put_int, %s and %c go to fputs and fputc. Everything goes through stdout, so the
+// output stays in order with other stdio calls. A format without conversions that ends in a
+// newline is printed with puts. Flags, widths, precisions, floating point and the remaining
+// conversions, and arguments not matching their conversion, are left to printf.
+#define PRINTF_PIECES_MAX 16
+
+typedef struct
+{
+    size_t offset; // NOTE: only set for text, its start in the format
+    size_t len;    // NOTE: only set for text, its length with "%%" unescaped
+    char   conv;   // NOTE: 0 for text, else d, u, c or s
+    bool   is_long;
+    bool   escaped; // text containing "%%", written from a literal of its own
+} printf_piece_t;
+
+// Formats a signed or unsigned long in decimal and writes it to a FILE*.
+static const char* put_int_il[] = {
+    "function $__micro_put_int(l %v, w %signed, l %file) {",
+    "@start",
+    "%buf =l alloc8 24",
+    "%pos =l alloc8 8",
+    "%rest =l alloc8 8",
+    "%end =l add %buf, 24",
+    "storel %end, %pos",
+    "storel %v, %rest",
+    "%below =w csltl %v, 0",
+    "%neg =w and %signed, %below",
+    "jnz %neg, @negate, @digits",
+    "@negate",
+    "%abs =l sub 0, %v",
+    "storel %abs, %rest",
+    "@digits",
+    "%u =l loadl %rest",
+    "%p =l loadl %pos",
+    "%next =l sub %p, 1",
+    "%q =l udiv %u, 10",
+    "%q10 =l mul %q, 10",
+    "%r =l sub %u, %q10",
+    "%digit =w add %r, 48",
+    "storeb %digit, %next",
+    "storel %next, %pos",
+    "storel %q, %rest",
+    "%more =w cnel %q, 0",
+    "jnz %more, @digits, @sign",
+    "@sign",
+    "jnz %neg, @minus, @write",
+    "@minus",
+    "%first =l loadl %pos",
+    "%dash =l sub %first, 1",
+    "storeb 45, %dash",
+    "storel %dash, %pos",
+    "@write",
+    "%start =l loadl %pos",
+    "%n =l sub %end, %start",
+    "call $fwrite(l %start, l 1, l %n, l %file)",
+    "ret",
+    "}",
+};
+
+static bool is_printf_call(const ast_node_t* node)
+{
+    if (node->data.func_call.name_len != 6 || strncmp(node->data.func_call.name, "printf", 6) != 0)
+        return false;
+    ast_node_t* user = lookup_func("printf");
+    return ctx.opts->opt_level > 0 && (!user || user->data.func_def.is_declaration) &&
+           node->data.func_call.arg_count > 0 && node->data.func_call.args[0].type == NODE_STRING;
+}
+
+// printf("...\n") prints the same as puts("..."). Also used by collect_strings(), which adds the
+// literal without the newline.
+static bool printf_as_puts(const ast_node_t* node)
+{
+    if (!is_printf_call(node) || node->data.func_call.arg_count != 1)
+        return false;
+    const char* fmt = node->data.func_call.args[0].data.string.value;
+    size_t      len = node->data.func_call.args[0].data.string.len;
+    return len > 0 && strnlen(fmt, len) == len && fmt[len - 1] == '\n' && !memchr(fmt, '%', len);
+}
+
+// Splits the format into text and conversions, `pieces` has room for `len + 1`. The text of a
+// piece, with "%%" unescaped, is copied to `text + offset`, which has room for `len`. Returns
+// false at the first conversion that isn't handled, `bad` and `bad_len` are then its spelling.
+static bool printf_parse(const char* fmt, size_t len, printf_piece_t* pieces, char* text,
+                         size_t* count, const char** bad, size_t* bad_len)
+{
+    size_t n = 0;
+    size_t i = 0;
+    while (i < len)
+    {
+        if (fmt[i] != '%' || (i + 1 < len && fmt[i + 1] == '%'))
+        {
+            if (n == 0 || pieces[n - 1].conv)
+                pieces[n++] = (printf_piece_t){i, 0, 0, false, false};
+            printf_piece_t* p          = &pieces[n - 1];
+            text[p->offset + p->len++] = fmt[i];
+            p->escaped                 = p->escaped || fmt[i] == '%';
+            i += fmt[i] == '%' ? 2 : 1;
+            continue;
+        }
+        size_t j     = i + 1;
+        size_t longs = 0;
+        while (j < len && fmt[j] == 'l' && longs < 2)
+            j++, longs++;
+        char c    = j < len ? fmt[j] : '\0';
+        char conv = c == 'd' || c == 'i' ? 'd' : c == 'u' ? 'u' : '\0';
+        if ((c == 'c' || c == 's') && longs == 0)
+            conv = c;
+        if (!conv)
+        {
+            size_t end = i + 1;
+            while (end < len && strchr("-+ #0123456789.*hlLqjzt", fmt[end]))
+                end++;
+            *bad     = fmt + i;
+            *bad_len = (end < len ? end + 1 : end) - i;
+            return false;
+        }
+        pieces[n++] = (printf_piece_t){0, 0, conv, longs > 0, false};
+        i           = j + 1;
+    }
+    *count = n;
+    return true;
+}
+
+// Adds the literals a specialized printf writes besides its format: the format without its
+// newline for puts, and text in which "%%" was unescaped.
+static void printf_collect(const ast_node_t* node)
+{
+    if (!is_printf_call(node))
+        return;
+    const char* fmt = node->data.func_call.args[0].data.string.value;
+    size_t      len = strnlen(fmt, node->data.func_call.args[0].data.string.len);
+    if (printf_as_puts(node))
+    {
+        collect_literal(fmt, len - 1);
+        return;
+    }
+    printf_piece_t* pieces  = calloc(len + 1, sizeof(printf_piece_t));
+    char*           text    = malloc(len + 1);
+    size_t          count   = 0;
+    const char*     bad     = NULL;
+    size_t          bad_len = 0;
+    if (!pieces || !text)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for format");
+    bool parsed = printf_parse(fmt, len, pieces, text, &count, &bad, &bad_len);
+    for (size_t i = 0; parsed && i < count; i++)
+    {
+        if (pieces[i].escaped && pieces[i].len > 1)
+            collect_literal(text + pieces[i].offset, pieces[i].len);
+    }
+    free(pieces);
+    free(text);
+}
+
+// Writes the pieces to stdout, `vals` are the arguments of the conversions in order. `format` is
+// the literal of the format, `text` what printf_parse() copied.
+static void printf_write(str_info_t* format, const char* text, const printf_piece_t* pieces,
+                         size_t count, gen_result_t* vals)
+{
+    if (count == 0)
+        return;
+    char* file = new_temp();
+    emit("%s =l loadl $stdout\n", file);
+    for (size_t i = 0, a = 0; i < count; i++)
+    {
+        const printf_piece_t* p = &pieces[i];
+        if (!p->conv && p->len == 1)
+        {
+            emit("call $fputc(w %d, l %s)\n", (unsigned char) text[p->offset], file);
+        }
+        else if (!p->conv && p->escaped)
+        {
+            emit("call $fwrite(l %s, l 1, l %zu, l %s)\n",
+                 use_literal(find_literal(text + p->offset, p->len)), p->len, file);
+        }
+        else if (!p->conv)
+        {
+            char* addr = mem_offset(use_literal(format), p->offset);
+            emit("call $fwrite(l %s, l 1, l %zu, l %s)\n", addr, p->len, file);
+            free(addr);
+        }
+        else if (p->conv == 's')
+        {
+            emit("call $fputs(l %s, l %s)\n", vals[a].val, file);
+        }
+        else if (p->conv == 'c')
+        {
+            vals[a] = gen_convert(vals[a], type_lookup("int"));
+            emit("call $fputc(w %s, l %s)\n", vals[a].val, file);
+        }
+        else
+        {
+            // Like printf the argument is read as an int or long, then widened for the helper.
+            bool        is_signed = p->conv == 'd';
+            const char* width     = is_signed ? (p->is_long ? "long" : "int")
+                                              : (p->is_long ? "ulong" : "uint");
+            vals[a] = gen_convert(gen_convert(vals[a], type_lookup(width)),
+                                  type_lookup(is_signed ? "long" : "ulong"));
+            emit("call $__micro_put_int(l %s, w %d, l %s)\n", vals[a].val, is_signed, file);
+            ctx.put_int_used = true;
+        }
+        a += p->conv != 0;
+    }
+    free(file);
+}
+
+static bool gen_printf_stmt(ast_node_t* node)
+{
+    if (!is_printf_call(node))
+        return false;
+    ast_node_t* args  = node->data.func_call.args;
+    const char* fmt   = args[0].data.string.value;
+    size_t      len   = strnlen(fmt, args[0].data.string.len);
+    size_t      nargs = node->data.func_call.arg_count - 1;
+    if (printf_as_puts(node))
+    {
+        str_info_t* si = find_literal(fmt, len - 1);
+        if (!si)
+            return false;
+        emit("call $puts(l %s)\n", use_literal(si));
+        cache_invalidate(NULL);
+        ctx.printf_lowered++;
+        remark_emit(REMARK_PASSED, "printf", ctx.func_name, node->line, node->column,
+                    "printf without conversions lowered to puts");
+        return true;
+    }
+
+    printf_piece_t* pieces  = calloc(len + 1, sizeof(printf_piece_t));
+    char*           buf     = malloc(len + 1);
+    size_t          count   = 0;
+    size_t          convs   = 0;
+    const char*     bad     = NULL;
+    size_t          bad_len = 0;
+    if (!pieces || !buf)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for format");
+    bool        parsed    = printf_parse(fmt, len, pieces, buf, &count, &bad, &bad_len);
+    str_info_t* format    = find_literal(args[0].data.string.value, args[0].data.string.len);
+    bool        collected = format != NULL; // NOTE: collect_strings() saw the call
+    for (size_t i = 0; parsed && i < count; i++)
+    {
+        convs += pieces[i].conv != 0;
+        if (pieces[i].escaped && pieces[i].len > 1)
+            collected = collected && find_literal(buf + pieces[i].offset, pieces[i].len);
+    }
+    if (!parsed)
+        remark_emit(REMARK_MISSED, "printf", ctx.func_name, node->line, node->column,
+                    "printf not specialized: the conversion '%.*s' is not supported",
+                    (int) bad_len, bad);
+    else if (convs != nargs)
+        remark_emit(REMARK_MISSED, "printf", ctx.func_name, node->line, node->column,
+                    "printf not specialized: %zu conversion%s but %zu argument%s", convs,
+                    convs == 1 ? "" : "s", nargs, nargs == 1 ? "" : "s");
+    else if (count > PRINTF_PIECES_MAX)
+        remark_emit(REMARK_MISSED, "printf", ctx.func_name, node->line, node->column,
+                    "printf not specialized: %zu pieces exceed the limit of %d", count,
+                    PRINTF_PIECES_MAX);
+    if (!parsed || convs != nargs || count > PRINTF_PIECES_MAX || !collected)
+    {
+        free(pieces);
+        free(buf);
+        return false;
+    }
+
+    // printf evaluates all arguments before it prints, so output from them comes first.
+    gen_result_t* vals = calloc(nargs + 1, sizeof(gen_result_t));
+    if (!vals)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for arguments");
+    size_t evaluated = 0;
+    while (evaluated < nargs && (vals[evaluated] = gen_expr(&args[evaluated + 1])).val)
+        evaluated++;
+    size_t mismatch = nargs;
+    for (size_t i = 0, a = 0; evaluated == nargs && i < count; i++)
+    {
+        if (!pieces[i].conv)
+            continue;
+        const type_info_t* type = result_type(vals[a]);
+        bool fits = pieces[i].conv == 's' ? type->is_pointer : type_is_integer(type);
+        if (!fits && mismatch == nargs)
+            mismatch = a;
+        a++;
+    }
+    if (evaluated == nargs && mismatch < nargs)
+    {
+        remark_emit(REMARK_MISSED, "printf", ctx.func_name, node->line, node->column,
+                    "printf not specialized: argument %zu has type '%s'", mismatch + 2,
+                    result_type(vals[mismatch])->name);
+        emit("call $printf(l %s, ...", use_literal(format));
+        for (size_t i = 0; i < nargs; i++)
+        {
+            // default argument promotion for variadic arguments
+            if (vals[i].qbe_type == 's')
+                vals[i] = gen_convert(vals[i], type_lookup("double"));
+            emit(", %c %s", vals[i].qbe_type ? vals[i].qbe_type : 'w', vals[i].val);
+        }
+        emit(")\n");
+    }
+    else if (evaluated == nargs)
+    {
+        printf_write(format, buf, pieces, count, vals);
+        ctx.printf_lowered++;
+        if (count == 0)
+            remark_emit(REMARK_PASSED, "printf", ctx.func_name, node->line, node->column,
+                        "printf of an empty format removed");
+        else
+            remark_emit(REMARK_PASSED, "printf", ctx.func_name, node->line, node->column,
+                        "printf specialized for its format into %zu write%s", count,
+                        count == 1 ? "" : "s");
+    }
+    cache_invalidate(NULL);
+    for (size_t i = 0; i < nargs; i++)
+        free(vals[i].val);
+    free(vals);
+    free(pieces);
+    free(buf);
+    return true;
+}
+
+/* ================== */
+/* Globals            */
+/* ================== */
+
+// Globals are addressed by symbol. Thread-local globals defined in the program use the
+// local-exec TLS model (QBE addresses them %fs-relative, a single instruction per access).
+// Extern thread-local globals may live in a shared object, so they use the initial-exec model:
+// their offset from the thread pointer is loaded from the GOT.
+static var_info_t global_var(global_t* g)
+{
+    const char* type_name = g->node->data.assign.type;
+    if (g->ptr)
+        return (var_info_t){g->ptr, g->type->qbe_type, g->type, type_is_restrict(type_name), true};
+
+    // The thread pointer doesn't change within a function, so the address is computed once in
+    // the start block and kept like a parameter in the function's outermost scope.
+    scope_t* outer = ctx.current_scope;
+    while (outer && outer->prev)
+        outer = outer->prev;
+    if (!outer || !ctx.frame)
+    {
+        gen_error("Thread-local variable used outside of a function");
+        return (var_info_t){NULL, 0, NULL, false, false};
+    }
+    const char* name = g->node->data.assign.name;
+    char*       text = malloc(strlen(name) + 64);
+    if (!text)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for thread-local access");
+    sprintf(text, "\tmovq %s@gottpoff(%%rip), %%rax\n\taddq %%fs:0, %%rax\n", name);
+    FILE* body = ctx.out;
+    ctx.out    = ctx.frame;
+    char* addr = emit_asm_marker(text, 'l', NULL, 0);
+    ctx.out    = body;
+
+    scope_t* scope    = ctx.current_scope;
+    ctx.current_scope = outer;
+    add_sym(name, g->node->data.assign.name_len, addr, type_name);
+    outer->entries->escaped = true;
+    ctx.current_scope       = scope;
+    return (var_info_t){outer->entries->ptr, g->type->qbe_type, g->type,
+                        type_is_restrict(type_name), true};
+}
+
+// Writes the initializer of a global, which must be a constant.
+static bool global_init(const type_info_t* type, ast_node_t* value)
+{
+    static const char int_class[] = {[1] = 'b', [2] = 'h', [4] = 'w', [8] = 'l'};
+    if (!value)
+    {
+        emit("z %u", type->size);
+        return true;
+    }
+    if (value->type == NODE_STRING && type->is_pointer)
+    {
+        gen_result_t str = gen_string(value);
+        emit("l %s", str.val);
+        free(str.val);
+        return true;
+    }
+    if (value->type != NODE_NUMBER)
+        return false;
+    bool is_float = value->data.number.lit_type != TOKEN_NLIT;
+    if (type->is_float)
+    {
+        double v = is_float ? value->data.number.value.f64 : (double) value->data.number.value.i64;
+        emit("%c %c_%.17g", type->qbe_type, type->qbe_type, v);
+        return true;
+    }
+    if (is_float)
+        return false;
+    emit("%c %ld", int_class[type->is_pointer ? 8 : type->size],
+         (long) value->data.number.value.i64);
+    return true;
+}
+
+// With -fdata-sections every data item gets its own section, so the linker can drop the unused
+// ones. The assembler derives the section type and flags from the name prefix.
+static void emit_data_section(const char* prefix, const char* name)
+{
+    if (ctx.opts->data_sections)
+        emit("section \"%s.%s\" ", prefix, name);
+}
+
+// Globals of imported modules are declared as extern, they are defined in the module's object.
+static void gen_globals(ast_node_t* root, bool external)
+{
+    for (size_t i = 0; i < root->data.program.func_def_count; i++)
+    {
+        ast_node_t* node = &root->data.program.func_defs[i];
+        if (node->type != NODE_ASSIGN)
+            continue;
+        ast_assign_t*      def  = &node->data.assign;
+        const type_info_t* type = str_to_type(def->type);
+        if (!type->qbe_type || type_is_vector(type))
+        {
+            gen_error("Globals must have a scalar or pointer type");
+            continue;
+        }
+        for (global_t* g = ctx.globals; g; g = g->next)
+        {
+            if (strcmp(g->node->data.assign.name, def->name) == 0)
+                gen_error("Global variable defined twice");
+        }
+        global_t* g = calloc(1, sizeof(global_t));
+        if (!g)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for global");
+        g->node = node;
+        g->type = type;
+        bool is_extern = def->is_extern || external;
+        if (!def->is_thread_local || !is_extern)
+        {
+            g->ptr = malloc(def->name_len + 10);
+            if (!g->ptr)
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for global");
+            sprintf(g->ptr, "%s$%s", def->is_thread_local ? "thread " : "", def->name);
+        }
+        g->next     = ctx.globals;
+        ctx.globals = g;
+        if (is_extern)
+            continue;
+        if (def->is_thread_local)
+            emit_data_section(def->value ? ".tdata" : ".tbss", def->name);
+        else
+            emit_data_section(def->value ? ".data" : ".bss", def->name);
+        emit("export %sdata $%s = align %u { ", def->is_thread_local ? "thread " : "", def->name,
+             type->size);
+        if (!global_init(type, def->value))
+            gen_error("Global initializers must be constants");
+        emit(" }\n");
+    }
+}
+
+static void free_globals(void)
+{
+    while (ctx.globals)
+    {
+        global_t* next = ctx.globals->next;
+        free(ctx.globals->ptr);
+        free(ctx.globals);
+        ctx.globals = next;
+    }
+}
+
+/* ================== */
+/* Generics           */
+/* ================== */
+
+// Binds the type parameter named by `param_type` (e.g. "T" or "T*") from an argument type.
+static void infer_binding(ast_node_t* func, const char* param_type, const type_info_t* arg_type,
+                          const type_info_t** types)
+{
+    size_t len = strlen(param_type);
+    while (len > 9 && strncmp(param_type + len - 9, " restrict", 9) == 0)
+        len -= 9;
+    while (len > 0 && param_type[len - 1] == '*')
+    {
+        if (!arg_type->is_pointer || !arg_type->pointee)
+            return;
+        arg_type = arg_type->pointee;
+        len--;
+    }
+    for (size_t i = 0; i < func->data.func_def.type_param_count; i++)
+    {
+        const char* name = func->data.func_def.type_params[i];
+        if (strlen(name) == len && strncmp(name, param_type, len) == 0 && !types[i])
+            types[i] = arg_type;
+    }
+}
+
+static char* mangle_instance(ast_node_t* func, const type_info_t** types)
+{
+    size_t len = func->data.func_def.name_len + 1;
+    for (size_t i = 0; i < func->data.func_def.type_param_count; i++)
+        len += strlen(types[i]->name) + 2;
+    char* name = malloc(len);
+    if (!name)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for instance name");
+    size_t pos = (size_t) sprintf(name, "%.*s_", (int) func->data.func_def.name_len,
+                                  func->data.func_def.name);
+    for (size_t i = 0; i < func->data.func_def.type_param_count; i++)
+    {
+        name[pos++] = '_';
+        for (const char* c = types[i]->name; *c; c++)
+            name[pos++] = *c == '*' ? 'p' : *c;
+    }
+    name[pos] = '\0';
+    return name;
+}
+
+// Returns the instantiation of generic `func` for a call, creating it on first use. Each distinct
+// set of type arguments is instantiated (and emitted) once per program.
+static instance_t* instantiate(ast_node_t* func, ast_node_t* call, gen_result_t* args)
+{
+    size_t              count = func->data.func_def.type_param_count;
+    const type_info_t** types = calloc(count, sizeof(const type_info_t*));
+    if (!types)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for type arguments");
+    if (call->data.func_call.type_args)
+    {
+        if (call->data.func_call.type_arg_count != count)
+        {
+            gen_error("Wrong number of type arguments for generic function");
+            free(types);
+            return NULL;
+        }
+        for (size_t i = 0; i < count; i++)
+            types[i] = str_to_type(call->data.func_call.type_args[i]);
+    }
+    else
+    {
+        param_node_t* param = func->data.func_def.params;
+        for (size_t i = 0; param && !param->is_variadic && i < call->data.func_call.arg_count;
+             i++, param = param->next)
+            infer_binding(func, param->type, result_type(args[i]), types);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!types[i])
+        {
+            gen_error("Cannot infer type argument of generic function");
+            free(types);
+            return NULL;
+        }
+    }
+
+    ctx.instance_requests++;
+    instance_t** link = &ctx.instances;
+    for (; *link; link = &(*link)->next)
+    {
+        instance_t* inst = *link;
+        if (inst->func == func && memcmp(inst->env.types, types, count * sizeof(*types)) == 0)
+        {
+            free(types);
+            return inst;
+        }
+    }
+    instance_t* inst = calloc(1, sizeof(instance_t));
+    if (!inst)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for generic instance");
+    inst->func      = func;
+    inst->env.names = func->data.func_def.type_params;
+    inst->env.types = types;
+    inst->env.count = count;
+    inst->name      = mangle_instance(func, types);
+    *link           = inst;
+    return inst;
+}
+
+static void free_instances(void)
+{
+    while (ctx.instances)
+    {
+        instance_t* next = ctx.instances->next;
+        free(ctx.instances->env.types);
+        free(ctx.instances->name);
+        free(ctx.instances);
+        ctx.instances = next;
+    }
+    ctx.instance_requests = 0;
+}
+
+static gen_result_t gen_func_call(ast_node_t* node)
+{
+    gen_result_t res  = {0};
+    char*        name = strndup(node->data.func_call.name, node->data.func_call.name_len);
+    if (!name)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function name");
+    if (!lookup_func(name) && gen_vector_builtin(node, name, &res))
+    {
+        free(name);
+        return res;
+    }
+    if (gen_mem_builtin(node, name, &res) ||
+        (!lookup_func(name) && gen_atomic_builtin(node, name, &res)))
+    {
+        free(name);
+        return res;
+    }
+    ast_node_t* func        = find_func(name);
+    bool        is_variadic = false;
+    if (func)
+    {
+        for (param_node_t* param = func->data.func_def.params; param; param = param->next)
+        {
+            if (param->is_variadic)
+            {
+                is_variadic = true;
+                break;
+            }
+        }
+    }
+    param_node_t* param       = func ? func->data.func_def.params : NULL;
+    size_t        param_count = 0;
+    for (param_node_t* p = param; p && !p->is_variadic; p = p->next)
+        param_count++;
+    gen_result_t* args = calloc(node->data.func_call.arg_count, sizeof(gen_result_t));
+    if (!args)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for arguments");
+    for (size_t i = 0; i < node->data.func_call.arg_count; i++)
+    {
+        args[i] = gen_expr(&node->data.func_call.args[i]);
+        if (!args[i].val)
+        {
+            for (size_t j = 0; j < i; j++)
+                free(args[j].val);
+            free(args);
+            free(name);
+            return res;
+        }
+    }
+
+    // Calls to generic functions go to the instantiation for the (explicit or inferred) type
+    // arguments, the callee's parameter types are resolved in that instantiation.
+    const type_env_t* callee_env = NULL;
+    const char*       symbol     = name;
+    if (func && func->data.func_def.type_params)
+    {
+        instance_t* inst = instantiate(func, node, args);
+        if (!inst)
+        {
+            for (size_t i = 0; i < node->data.func_call.arg_count; i++)
+                free(args[i].val);
+            free(args);
+            free(name);
+            return res;
+        }
+        callee_env = &inst->env;
+        symbol     = inst->name;
+    }
+    const type_info_t* ret_info =
+        func ? resolve_type(func->data.func_def.return_type, callee_env) : type_lookup("long");
+    char ret_type = ret_info->qbe_type;
+
+    param_node_t* conv_param = param;
+    for (size_t i = 0; i < node->data.func_call.arg_count; i++)
+    {
+        if (conv_param && i < param_count)
+        {
+            args[i]    = gen_convert(args[i], resolve_type(conv_param->type, callee_env));
+            conv_param = conv_param->next;
+        }
+        else if (args[i].qbe_type == 's')
+        {
+            // default argument promotion for variadic arguments
+            args[i] = gen_convert(args[i], type_lookup("double"));
+        }
+    }
+    char* tmp = NULL;
+    if (ret_type != 0)
+    {
+        tmp = new_temp();
+        emit("%s =%c call $%s (", tmp, ret_type, symbol);
+    }
+    else
+    {
+        emit("call $%s (", symbol);
+    }
+    for (size_t i = 0; i < node->data.func_call.arg_count; i++)
+    {
+        if (is_variadic && i == param_count)
+            emit("..., ");
+        emit("%c %s", args[i].qbe_type ? args[i].qbe_type : 'w', args[i].val);
+        if (i < node->data.func_call.arg_count - 1)
+            emit(", ");
+        free(args[i].val);
+    }
+    emit(")\n");
+    cache_invalidate(NULL);
+    record_call(symbol);
+    free(args);
+    free(name);
+    if (ret_type != 0)
+    {
+        res.val      = tmp;
+        res.qbe_type = ret_type;
+        res.type     = ret_info;
+    }
+    return res;
+}
+
+static void gen_func_call_stmt(ast_node_t* node)
+{
+    if (gen_printf_stmt(node))
+        return;
+    gen_result_t res = gen_func_call(node);
+    if (res.val)
+        free(res.val);
+}
+
+static gen_result_t gen_store_through(ast_node_t* node)
+{
+    gen_result_t res = {0};
+    gen_result_t ptr = gen_expr(node->data.assign.target->data.deref.expr);
+    gen_result_t val = gen_expr(node->data.assign.value);
+    if (!ptr.val || !val.val)
+    {
+        free(ptr.val);
+        free(val.val);
+        return res;
+    }
+    const type_info_t* type = result_type(ptr);
+    if (!type->is_pointer)
+    {
+        gen_error("Cannot store through a non-pointer value");
+        free(ptr.val);
+        free(val.val);
+        return res;
+    }
+    mem_loc_t loc = {ptr.val, ptr.base, type->pointee, false, ptr.is_restrict};
+    val           = gen_convert(val, type->pointee);
+    if (type_is_vector(type->pointee))
+    {
+        if (val.val)
+            vec_copy(ptr.val, val.val, type->pointee);
+        cache_invalidate(&loc);
+    }
+    else
+    {
+        gen_store(&loc, val.val);
+    }
+    free(ptr.val);
+    return val;
+}
+
+static gen_result_t gen_assign(ast_node_t* node)
+{
+    if (node->data.assign.target)
+        return gen_store_through(node);
+    gen_result_t res  = {0};
+    char*        name = strndup(node->data.assign.name, node->data.assign.name_len);
+    if (!name)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for variable name");
+    gen_result_t val = {0};
+    if (node->data.assign.is_thread_local || node->data.assign.is_extern)
+    {
+        gen_error("thread_local and extern are only allowed on globals");
+        free(name);
+        return res;
+    }
+    if (node->data.assign.value)
+    {
+        val = gen_expr(node->data.assign.value);
+        if (!val.val)
+        {
+            free(name);
+            return res;
         }
-        else
+    }
+    if (node->data.assign.type)
+    {
+        const type_info_t* type    = str_to_type(node->data.assign.type);
+        bool               promote = is_promotable(type, name, node->data.assign.name_len, node);
+        char*              ptr =
+            frame_alloc(type->size, slot_align(type), promote ? type->qbe_type : 0);
+        add_sym(name, node->data.assign.name_len, ptr, node->data.assign.type);
+        if (!node->data.assign.value)
         {
-            emit("store%c 0, %s\n", vtype, ptr);
-            res.val = strdup("0");
-            if (!res.val)
+            val.val = strdup("0");
+            if (!val.val)
                 ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for result");
-            res.qbe_type = vtype;
         }
     }
+    var_info_t vi = find_sym(name);
+    if (!vi.ptr)
+    {
+        free(name);
+        if (val.val)
+            free(val.val);
+        return res;
+    }
+    mem_loc_t loc = {vi.ptr, vi.ptr, vi.type, !vi.escaped, false};
+    val           = gen_convert(val, vi.type);
+    if (!val.val)
+    {
+        free(name);
+        return res;
+    }
+    if (type_is_vector(vi.type))
+    {
+        vec_copy(vi.ptr, val.val, vi.type);
+        cache_invalidate(&loc);
+    }
     else
     {
-        var_info_t vi = find_sym(name);
-        if (!vi.ptr)
-        {
-            free(name);
-            if (val.val)
-                free(val.val);
-            return res;
-        }
-        emit("store%c %s, %s\n", vi.vtype, val.val, vi.ptr);
-        res.val = strdup(val.val);
-        if (!res.val)
-            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for result");
-        res.qbe_type = vi.vtype;
+        gen_store(&loc, val.val);
     }
+    res.val = strdup(val.val);
+    if (!res.val)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for result");
+    res.qbe_type = vi.vtype;
+    res.type     = vi.type;
     free(name);
     if (val.val)
         free(val.val);
@@ -572,74 +2481,804 @@ static void gen_assign_stmt(ast_node_t* node)
 static gen_result_t gen_expr(ast_node_t* node)
 {
     if (!node)
-        return (gen_result_t){NULL, 0};
+        return (gen_result_t){0};
     typedef gen_result_t (*expr_handler_t)(ast_node_t*);
     static const expr_handler_t handlers[] = {
         [NODE_NUMBER] = gen_number,    [NODE_STRING] = gen_string,       [NODE_IDENT] = gen_ident,
         [NODE_BINOP] = gen_binop_node, [NODE_FUNC_CALL] = gen_func_call, [NODE_ASSIGN] = gen_assign,
+        [NODE_CAST] = gen_cast,        [NODE_ADDR_OF] = gen_addr_of,     [NODE_DEREF] = gen_deref,
     };
+    // Diagnostics point at the innermost expression being generated.
+    uint32_t line   = ctx.line;
+    uint32_t column = ctx.column;
+    locate(node);
+    gen_result_t res = {0};
     if (node->type < sizeof(handlers) / sizeof(handlers[0]) && handlers[node->type])
-        return handlers[node->type](node);
-    ERROR_FATAL(NULL, 0, 0, "Unimplemented expression type");
-    return (gen_result_t){NULL, 0};
+        res = handlers[node->type](node);
+    else
+        gen_error("Unimplemented expression type");
+    ctx.line   = line;
+    ctx.column = column;
+    return res;
+}
+
+static void gen_return(ast_node_t* node)
+{
+    if (node->data.return_stmt.expr)
+    {
+        gen_result_t val = gen_convert(gen_expr(node->data.return_stmt.expr), ctx.ret_type);
+        if (val.val)
+        {
+            emit("ret %s\n", val.val);
+            free(val.val);
+        }
+    }
+    else
+    {
+        emit("ret\n");
+    }
+    ctx.terminated = true;
+}
+
+static void gen_conditional(ast_node_t* node, char* cont_lab)
+{
+    int manage_cont = (cont_lab == NULL);
+    if (manage_cont)
+        cont_lab = new_label();
+    gen_result_t cond = gen_expr(node->type == NODE_IF ? node->data.if_stmt.condition
+                                                       : node->data.elseif_stmt.condition);
+    if (!cond.val)
+    {
+        if (manage_cont)
+            free(cont_lab);
+        return;
+    }
+    char* then_lab = new_label();
+    char* next_lab = new_label();
+    emit("jnz %s, %s, %s\n", cond.val, then_lab, next_lab);
+    free(cond.val);
+    emit_label(then_lab);
+    gen_block(node->type == NODE_IF ? node->data.if_stmt.then_block
+                                    : node->data.elseif_stmt.then_block);
+    emit_jump(cont_lab);
+    emit_label(next_lab);
+    ast_node_t* else_block =
+        node->type == NODE_IF ? node->data.if_stmt.else_block : node->data.elseif_stmt.else_block;
+    if (else_block)
+    {
+        // The parser chains `else if` as a nested NODE_IF
+        if (else_block->type == NODE_ELSEIF || else_block->type == NODE_IF)
+            gen_conditional(else_block, cont_lab);
+        else if (else_block->type == NODE_ELSE)
+        {
+            gen_block(else_block->data.else_stmt.block);
+            emit_jump(cont_lab);
+        }
+    }
+    free(then_lab);
+    free(next_lab);
+    if (manage_cont)
+    {
+        emit_label(cont_lab);
+        free(cont_lab);
+    }
+}
+
+static void gen_while(ast_node_t* node)
+{
+    char* cond_lab = new_label();
+    char* body_lab = new_label();
+    char* end_lab  = new_label();
+    emit_label(cond_lab);
+    gen_result_t cond = gen_expr(node->data.while_stmt.condition);
+    if (cond.val)
+    {
+        emit("jnz %s, %s, %s\n", cond.val, body_lab, end_lab);
+        free(cond.val);
+        emit_label(body_lab);
+        ctx.loop_depth++;
+        gen_block(node->data.while_stmt.body);
+        ctx.loop_depth--;
+        emit_jump(cond_lab);
+        emit_label(end_lab);
+    }
+    free(cond_lab);
+    free(body_lab);
+    free(end_lab);
+}
+
+/* ================== */
+/* Inline assembly    */
+/* ================== */
+
+// An asm statement is emitted as a call to a marker symbol, with the inputs passed in the SysV
+// argument registers and the output in rax. Once QBE has produced the assembly, the call is
+// replaced by the expanded template, so the statement costs no call at run time.
+enum
+{
+    REG_RAX,
+    REG_RBX,
+    REG_RCX,
+    REG_RDX,
+    REG_RSI,
+    REG_RDI,
+    REG_R8,
+    REG_R9,
+    REG_R10,
+    REG_R11,
+    REG_R12,
+    REG_R13,
+    REG_R14,
+    REG_R15,
+    REG_COUNT
+};
+
+static const struct
+{
+    const char* names[4]; // 8, 4, 2 and 1 byte views
+    char        letter;   // constraint letter, 0 if the register can only be picked by "r"
+    bool        callee_saved;
+} asm_regs[REG_COUNT] = {
+    [REG_RAX] = {{"rax", "eax", "ax", "al"}, 'a', false},
+    [REG_RBX] = {{"rbx", "ebx", "bx", "bl"}, 'b', true},
+    [REG_RCX] = {{"rcx", "ecx", "cx", "cl"}, 'c', false},
+    [REG_RDX] = {{"rdx", "edx", "dx", "dl"}, 'd', false},
+    [REG_RSI] = {{"rsi", "esi", "si", "sil"}, 'S', false},
+    [REG_RDI] = {{"rdi", "edi", "di", "dil"}, 'D', false},
+    [REG_R8]  = {{"r8", "r8d", "r8w", "r8b"}, 0, false},
+    [REG_R9]  = {{"r9", "r9d", "r9w", "r9b"}, 0, false},
+    [REG_R10] = {{"r10", "r10d", "r10w", "r10b"}, 0, false},
+    [REG_R11] = {{"r11", "r11d", "r11w", "r11b"}, 0, false},
+    [REG_R12] = {{"r12", "r12d", "r12w", "r12b"}, 0, true},
+    [REG_R13] = {{"r13", "r13d", "r13w", "r13b"}, 0, true},
+    [REG_R14] = {{"r14", "r14d", "r14w", "r14b"}, 0, true},
+    [REG_R15] = {{"r15", "r15d", "r15w", "r15b"}, 0, true},
+};
+
+static const int arg_regs[] = {REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9};
+#define ARG_REG_COUNT (sizeof(arg_regs) / sizeof(arg_regs[0]))
+
+typedef struct asm_binding
+{
+    int                reg; // -1 for immediates
+    const type_info_t* type;
+    char*              imm;  // NOTE: only set for "i" operands
+    mem_loc_t          loc;  // NOTE: outputs only, the lvalue written
+    int                slot; // NOTE: outputs only, argument carrying the lvalue's address
+} asm_binding_t;
+
+static const char* asm_reg_name(int reg, size_t size)
+{
+    return asm_regs[reg].names[size >= 8 ? 0 : size == 4 ? 1 : size == 2 ? 2 : 3];
+}
+
+static int asm_reg_lookup(const char* name)
+{
+    if (name[0] == '%')
+        name++;
+    for (int reg = 0; reg < REG_COUNT; reg++)
+    {
+        for (int view = 0; view < 4; view++)
+        {
+            if (strcmp(asm_regs[reg].names[view], name) == 0)
+                return reg;
+        }
+    }
+    return -1;
+}
+
+static int asm_constraint_reg(char letter)
+{
+    for (int reg = 0; reg < REG_COUNT; reg++)
+    {
+        if (asm_regs[reg].letter == letter)
+            return reg;
+    }
+    return -1;
+}
+
+static int asm_arg_slot(int reg)
+{
+    for (size_t i = 0; i < ARG_REG_COUNT; i++)
+    {
+        if (arg_regs[i] == reg)
+            return (int) i;
+    }
+    return -1;
+}
+
+static bool asm_operand_type_ok(const type_info_t* type)
+{
+    return type->is_pointer || type_is_integer(type);
+}
+
+// Resolves an output lvalue to the location it names.
+static bool asm_output_loc(ast_node_t* expr, mem_loc_t* loc)
+{
+    if (expr->type == NODE_IDENT)
+    {
+        var_info_t vi = find_sym(expr->data.ident.name);
+        if (!vi.ptr)
+            return false;
+        *loc = (mem_loc_t){strdup(vi.ptr), strdup(vi.ptr), vi.type, !vi.escaped, false};
+        return true;
+    }
+    if (expr->type == NODE_DEREF)
+    {
+        gen_result_t       ptr  = gen_expr(expr->data.deref.expr);
+        const type_info_t* type = result_type(ptr);
+        if (!ptr.val || !type->is_pointer)
+        {
+            free(ptr.val);
+            return false;
+        }
+        *loc = (mem_loc_t){ptr.val, ptr.base ? strdup(ptr.base) : NULL, type->pointee, false,
+                           ptr.is_restrict};
+        return true;
+    }
+    return false;
+}
+
+// Appends the template with %N / %bN / %wN / %kN / %qN replaced by the bound operands.
+static bool asm_expand(FILE* out, const char* text, const asm_binding_t* ops, size_t count)
+{
+    fputc('\t', out);
+    for (const char* p = text; *p; p++)
+    {
+        if (*p == '\n')
+        {
+            fputc('\n', out);
+            if (p[1] != '\t')
+                fputc('\t', out);
+            continue;
+        }
+        if (*p != '%')
+        {
+            fputc(*p, out);
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            fputc('%', out);
+            p++;
+            continue;
+        }
+        size_t size = 0;
+        if (p[1] && strchr("bwkq", p[1]) && p[2] >= '0' && p[2] <= '9')
+        {
+            size = p[1] == 'b' ? 1 : p[1] == 'w' ? 2 : p[1] == 'k' ? 4 : 8;
+            p++;
+        }
+        if (p[1] < '0' || p[1] > '9')
+        {
+            fputc('%', out);
+            continue;
+        }
+        char*  end = NULL;
+        size_t n   = strtoul(p + 1, &end, 10);
+        p          = end - 1;
+        if (n >= count)
+        {
+            gen_error("Asm operand number out of range");
+            return false;
+        }
+        if (ops[n].reg < 0)
+            fputs(ops[n].imm, out);
+        else
+            fprintf(out, "%%%s",
+                    asm_reg_name(ops[n].reg, size ? size
+                                             : ops[n].type->is_pointer ? 8
+                                                                       : ops[n].type->size));
+    }
+    fputc('\n', out);
+    return true;
+}
+
+// Records an expanded asm block (taking ownership of `text`) and emits the call to its marker
+// with `args` in the argument registers; NULL values pass 0. Returns the temp receiving rax, if
+// `ret_class` is set. The call is a barrier for QBE and clears the load cache.
+static char* emit_asm_marker(char* text, char ret_class, const gen_result_t* args, size_t argc)
+{
+    char** blocks = realloc(ctx.asm_blocks, (ctx.asm_block_count + 1) * sizeof(char*));
+    if (!blocks)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for inline asm");
+    ctx.asm_blocks                        = blocks;
+    ctx.asm_blocks[ctx.asm_block_count++] = text;
+
+    size_t count = 0;
+    for (size_t j = 0; j < argc; j++)
+    {
+        if (args[j].val)
+            count = j + 1;
+    }
+    char* ret = NULL;
+    if (ret_class)
+    {
+        ret = new_temp();
+        emit("%s =%c ", ret, ret_class);
+    }
+    emit("call $__micro_asm_%zu (", ctx.asm_block_count - 1);
+    for (size_t j = 0; j < count; j++)
+    {
+        emit("%s%c %s", j ? ", " : "", args[j].val ? args[j].qbe_type : 'l',
+             args[j].val ? args[j].val : "0");
+    }
+    emit(")\n");
+    cache_invalidate(NULL);
+    return ret;
+}
+
+static void gen_asm(ast_node_t* node)
+{
+    ast_asm_t*     as    = &node->data.asm_stmt;
+    size_t         count = as->output_count + as->input_count;
+    asm_binding_t* ops   = calloc(count ? count : 1, sizeof(asm_binding_t));
+    gen_result_t   slots[ARG_REG_COUNT] = {0};
+    bool           written[REG_COUNT]   = {0}; // outputs and clobbers
+    bool           saved[REG_COUNT]     = {0}; // callee-saved registers to preserve
+    int            ret_out              = -1;  // output returned in rax
+    int            moves[REG_COUNT];           // prologue moves: register <- argument slot
+    char*          text = NULL;
+    size_t         text_len = 0;
+    bool           ok       = ops != NULL;
+    for (int reg = 0; reg < REG_COUNT; reg++)
+        moves[reg] = -1;
+
+    for (size_t i = 0; ok && i < as->clobber_count; i++)
+    {
+        const char* clobber = as->clobbers[i];
+        if (strcmp(clobber, "memory") == 0 || strcmp(clobber, "cc") == 0)
+            continue;
+        int reg = asm_reg_lookup(clobber);
+        if (reg < 0)
+        {
+            gen_error("Unknown register in asm clobber list");
+            ok = false;
+            break;
+        }
+        written[reg] = true;
+    }
+
+    // Outputs: explicit registers first, then "r" (rax if free, else a scratch register).
+    for (int pass = 0; pass < 2 && ok; pass++)
+    {
+        for (size_t i = 0; ok && i < as->output_count; i++)
+        {
+            const char* c = as->outputs[i].constraint;
+            if ((c[0] != '=' && c[0] != '+') || !c[1])
+            {
+                gen_error("Asm output constraint must start with '=' or '+'");
+                ok = false;
+                break;
+            }
+            if ((c[1] == 'r') != (pass == 1))
+                continue;
+            int reg = c[1] == 'r' ? -1 : asm_constraint_reg(c[1]);
+            if (c[1] == 'r')
+            {
+                static const int scratch[] = {REG_RAX, REG_R10, REG_R11, REG_R8, REG_R9,
+                                              REG_RCX, REG_RDX, REG_RSI, REG_RDI};
+                for (size_t j = 0; j < sizeof(scratch) / sizeof(scratch[0]) && reg < 0; j++)
+                {
+                    if (!written[scratch[j]])
+                        reg = scratch[j];
+                }
+            }
+            if (reg < 0 || written[reg])
+            {
+                gen_error(reg < 0 ? "Unsupported asm output constraint"
+                                  : "Asm output register is already in use");
+                ok = false;
+                break;
+            }
+            ops[i].reg   = reg;
+            ops[i].slot  = -1;
+            written[reg] = true;
+            if (reg == REG_RAX)
+                ret_out = (int) i;
+            if (!asm_output_loc(as->outputs[i].expr, &ops[i].loc))
+            {
+                gen_error("Asm output must be a variable or a dereference");
+                ok = false;
+                break;
+            }
+            ops[i].type = ops[i].loc.type;
+            if (!asm_operand_type_ok(ops[i].type))
+            {
+                gen_error("Asm operands must be integers or pointers");
+                ok = false;
+            }
+        }
+    }
+
+    // Inputs: fixed argument registers first, then everything else takes a free argument slot.
+    // Read-write outputs are inputs in their own register.
+    size_t in_count = as->input_count + as->output_count;
+    for (int pass = 0; pass < 2 && ok; pass++)
+    {
+        for (size_t k = 0; ok && k < in_count; k++)
+        {
+            bool        is_tied = k >= as->input_count;
+            size_t      op      = is_tied ? k - as->input_count : as->output_count + k;
+            const char* c = is_tied ? as->outputs[op].constraint : as->inputs[k].constraint;
+            if (is_tied && c[0] != '+')
+                continue;
+            if (!is_tied && c[0] == 'i')
+            {
+                ast_node_t* expr = as->inputs[k].expr;
+                if (pass == 1)
+                    continue;
+                if (expr->type != NODE_NUMBER || expr->data.number.lit_type != TOKEN_NLIT)
+                {
+                    gen_error("Asm \"i\" operand must be an integer constant");
+                    ok = false;
+                    break;
+                }
+                ops[op].reg = -1;
+                ops[op].imm = malloc(32);
+                if (!ops[op].imm)
+                    ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for asm immediate");
+                sprintf(ops[op].imm, "$%ld", (long) expr->data.number.value.i64);
+                ops[op].type = type_lookup("long");
+                continue;
+            }
+            int reg  = is_tied ? ops[op].reg : c[0] == 'r' ? -1 : asm_constraint_reg(c[0]);
+            int slot = reg >= 0 ? asm_arg_slot(reg) : -1;
+            if ((slot >= 0) != (pass == 0))
+                continue;
+            if (!is_tied && c[0] != 'r' && reg < 0)
+            {
+                gen_error("Unsupported asm input constraint");
+                ok = false;
+                break;
+            }
+            for (size_t j = 0; slot < 0 && j < ARG_REG_COUNT; j++)
+            {
+                if (!slots[j].val)
+                    slot = (int) j;
+            }
+            if (slot < 0 || slots[slot].val)
+            {
+                gen_error("Too many asm inputs or conflicting input registers");
+                ok = false;
+                break;
+            }
+            gen_result_t val = {0};
+            if (is_tied)
+            {
+                mem_loc_t loc = ops[op].loc;
+                val           = gen_load(&loc);
+            }
+            else
+            {
+                val = gen_expr(as->inputs[k].expr);
+            }
+            if (!val.val || !asm_operand_type_ok(result_type(val)))
+            {
+                if (val.val)
+                    gen_error("Asm operands must be integers or pointers");
+                free(val.val);
+                ok = false;
+                break;
+            }
+            slots[slot] = val;
+            if (reg < 0)
+                reg = arg_regs[slot];
+            else if (arg_regs[slot] != reg)
+                moves[reg] = slot;
+            if (!is_tied)
+            {
+                ops[op].reg  = reg;
+                ops[op].type = result_type(val);
+            }
+        }
+    }
+
+    // Outputs not returned in rax are stored through their address, passed in an argument
+    // register the statement doesn't write.
+    for (size_t i = 0; ok && i < as->output_count; i++)
+    {
+        if ((int) i == ret_out)
+            continue;
+        for (size_t j = 0; j < ARG_REG_COUNT && ops[i].slot < 0; j++)
+        {
+            if (!slots[j].val && !written[arg_regs[j]])
+                ops[i].slot = (int) j;
+        }
+        if (ops[i].slot < 0)
+        {
+            gen_error("Too many asm operands");
+            ok = false;
+            break;
+        }
+        slots[ops[i].slot] = (gen_result_t){.val = strdup(ops[i].loc.addr), .qbe_type = 'l'};
+    }
+
+    FILE* out = ok ? open_memstream(&text, &text_len) : NULL;
+    if (out)
+    {
+        for (int reg = 0; reg < REG_COUNT; reg++)
+        {
+            saved[reg] = asm_regs[reg].callee_saved && (written[reg] || moves[reg] >= 0);
+            if (saved[reg])
+                fprintf(out, "\tpushq %%%s\n", asm_regs[reg].names[0]);
+        }
+        for (int reg = 0; reg < REG_COUNT; reg++)
+        {
+            if (moves[reg] >= 0)
+                fprintf(out, "\tmovq %%%s, %%%s\n", asm_regs[arg_regs[moves[reg]]].names[0],
+                        asm_regs[reg].names[0]);
+        }
+        ok = asm_expand(out, as->text, ops, count);
+        for (size_t i = 0; i < as->output_count; i++)
+        {
+            if (ops[i].slot < 0)
+                continue;
+            size_t      size     = ops[i].type->is_pointer ? 8 : ops[i].type->size;
+            const char* suffix[] = {[1] = "b", [2] = "w", [4] = "l", [8] = "q"};
+            fprintf(out, "\tmov%s %%%s, (%%%s)\n", suffix[size], asm_reg_name(ops[i].reg, size),
+                    asm_regs[arg_regs[ops[i].slot]].names[0]);
+        }
+        for (int reg = REG_COUNT - 1; reg >= 0; reg--)
+        {
+            if (saved[reg])
+                fprintf(out, "\tpopq %%%s\n", asm_regs[reg].names[0]);
+        }
+        fclose(out);
+    }
+
+    if (ok)
+    {
+        char* ret = emit_asm_marker(text, ret_out >= 0 ? ops[ret_out].type->qbe_type : 0, slots,
+                                    ARG_REG_COUNT);
+        text      = NULL;
+        for (size_t i = 0; i < as->output_count; i++)
+        {
+            if ((int) i == ret_out)
+                gen_store(&ops[i].loc, ret);
+            else
+                cache_invalidate(&ops[i].loc);
+        }
+        free(ret);
+    }
+
+    free(text);
+    for (size_t j = 0; j < ARG_REG_COUNT; j++)
+        free(slots[j].val);
+    for (size_t i = 0; ops && i < count; i++)
+    {
+        free(ops[i].imm);
+        free((char*) ops[i].loc.addr);
+        free((char*) ops[i].loc.base);
+    }
+    free(ops);
+}
+
+/* ================== */
+/* Atomics            */
+/* ================== */
+
+// Atomic builtins are asm blocks working on the object at rdi, with the operands in rsi/rdx and
+// the result in rax. Under x86-TSO plain loads and stores already have acquire and release
+// semantics, so only seq_cst stores (xchg) and seq_cst fences (mfence) cost more than a mov.
+// Every atomic, including a relaxed one or a fence that needs no instruction, is a marker call
+// QBE can't move memory accesses across, and it clears the load cache.
+typedef enum
+{
+    ORDER_RELAXED,
+    ORDER_ACQUIRE,
+    ORDER_RELEASE,
+    ORDER_ACQ_REL,
+    ORDER_SEQ_CST
+} mem_order_t;
+
+static const char* order_names[] = {
+    [ORDER_RELAXED] = "relaxed", [ORDER_ACQUIRE] = "acquire", [ORDER_RELEASE] = "release",
+    [ORDER_ACQ_REL] = "acq_rel", [ORDER_SEQ_CST] = "seq_cst",
+};
+
+typedef enum
+{
+    ATOMIC_LOAD,
+    ATOMIC_STORE,
+    ATOMIC_EXCHANGE,
+    ATOMIC_FETCH_ADD,
+    ATOMIC_CAS,
+    ATOMIC_FENCE
+} atomic_op_t;
+
+static const struct
+{
+    const char* name;
+    size_t      operands; // values besides the pointer and the order
+    unsigned    orders;   // NOTE: bit set of the memory orders the operation accepts
+} atomic_ops[] = {
+    [ATOMIC_LOAD] = {"atomic_load", 0,
+                     1u << ORDER_RELAXED | 1u << ORDER_ACQUIRE | 1u << ORDER_SEQ_CST},
+    [ATOMIC_STORE] = {"atomic_store", 1,
+                      1u << ORDER_RELAXED | 1u << ORDER_RELEASE | 1u << ORDER_SEQ_CST},
+    [ATOMIC_EXCHANGE]  = {"atomic_exchange", 1, 0x1f},
+    [ATOMIC_FETCH_ADD] = {"atomic_fetch_add", 1, 0x1f},
+    [ATOMIC_CAS]       = {"atomic_cas", 2, 0x1f},
+    [ATOMIC_FENCE]     = {"atomic_fence", 0, 0x1f},
+};
+
+static bool atomic_order(ast_node_t* arg, mem_order_t* out)
+{
+    for (int order = 0; arg->type == NODE_IDENT && order <= ORDER_SEQ_CST; order++)
+    {
+        if (strcmp(arg->data.ident.name, order_names[order]) == 0)
+        {
+            *out = (mem_order_t) order;
+            return true;
+        }
+    }
+    gen_error("Expected a memory order (relaxed, acquire, release, acq_rel or seq_cst)");
+    return false;
+}
+
+// Widens the low `size` bytes of `reg` into eax/rax, as the marker call returns a w or l.
+static void atomic_result(FILE* out, int reg, const type_info_t* type)
+{
+    size_t size = type->is_pointer ? 8 : type->size;
+    if (size >= 4)
+    {
+        if (reg != REG_RAX)
+            fprintf(out, "\tmov%c %%%s, %%%s\n", size == 8 ? 'q' : 'l', asm_reg_name(reg, size),
+                    asm_reg_name(REG_RAX, size));
+        return;
+    }
+    fprintf(out, "\tmov%c%cl %%%s, %%eax\n", type->is_signed ? 's' : 'z', size == 1 ? 'b' : 'w',
+            asm_reg_name(reg, size));
 }
 
-static void gen_return(ast_node_t* node)
+// Lowers atomic_load(p, order), atomic_store(p, v, order), atomic_exchange(p, v, order),
+// atomic_fetch_add(p, v, order), atomic_cas(p, expected, desired, order) and atomic_fence(order).
+// atomic_cas returns the previous value, the exchange happened if it equals `expected`.
+static bool gen_atomic_builtin(ast_node_t* node, const char* name, gen_result_t* out)
 {
-    if (node->data.return_stmt.expr)
+    size_t      op    = 0;
+    size_t      count = sizeof(atomic_ops) / sizeof(atomic_ops[0]);
+    ast_node_t* args  = node->data.func_call.args;
+    size_t      argc  = node->data.func_call.arg_count;
+    while (op < count && strcmp(atomic_ops[op].name, name) != 0)
+        op++;
+    if (op == count)
+        return false;
+    *out               = (gen_result_t){0};
+    size_t      expect = op == ATOMIC_FENCE ? 1 : 2 + atomic_ops[op].operands;
+    mem_order_t order  = ORDER_SEQ_CST;
+    if (argc != expect)
     {
-        gen_result_t val = gen_expr(node->data.return_stmt.expr);
-        if (val.val)
-        {
-            emit("ret %s\n", val.val);
-            free(val.val);
-        }
+        gen_error("Wrong number of arguments to atomic builtin");
+        return true;
     }
-    else
+    if (!atomic_order(&args[argc - 1], &order))
+        return true;
+    if (!(atomic_ops[op].orders & (1u << order)))
     {
-        emit("ret\n");
+        gen_error("Memory order not allowed for this atomic operation");
+        return true;
     }
-}
 
-static void gen_conditional(ast_node_t* node, char* cont_lab)
-{
-    int manage_cont = (cont_lab == NULL);
-    if (manage_cont)
-        cont_lab = new_label();
-    gen_result_t cond = gen_expr(node->type == NODE_IF ? node->data.if_stmt.condition
-                                                       : node->data.elseif_stmt.condition);
-    if (!cond.val)
+    char*  text = NULL;
+    size_t len  = 0;
+    FILE*  asm_out;
+    if (op == ATOMIC_FENCE)
     {
-        if (manage_cont)
-            free(cont_lab);
-        return;
+        asm_out = open_memstream(&text, &len);
+        if (!asm_out)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for atomic");
+        if (order == ORDER_SEQ_CST)
+            fprintf(asm_out, "\tmfence\n");
+        fclose(asm_out);
+        free(emit_asm_marker(text, 0, NULL, 0));
+        return true;
     }
-    char* then_lab = new_label();
-    char* next_lab = new_label();
-    emit("jnz %s, %s, %s\n", cond.val, then_lab, next_lab);
-    free(cond.val);
-    emit("%s\n", then_lab);
-    gen_block(node->type == NODE_IF ? node->data.if_stmt.then_block
-                                    : node->data.elseif_stmt.then_block);
-    emit("jmp %s\n", cont_lab);
-    emit("%s\n", next_lab);
-    ast_node_t* else_block =
-        node->type == NODE_IF ? node->data.if_stmt.else_block : node->data.elseif_stmt.else_block;
-    if (else_block)
+
+    gen_result_t vals[3] = {0};
+    vals[0]              = gen_expr(&args[0]);
+    const type_info_t* ptr_type = result_type(vals[0]);
+    if (!vals[0].val || !ptr_type->is_pointer || !ptr_type->pointee ||
+        !(ptr_type->pointee->is_pointer || type_is_integer(ptr_type->pointee)))
     {
-        if (else_block->type == NODE_ELSEIF)
-            gen_conditional(else_block, cont_lab);
-        else if (else_block->type == NODE_ELSE)
+        if (vals[0].val)
+            gen_error("Atomic builtins need a pointer to an integer or pointer");
+        free(vals[0].val);
+        return true;
+    }
+    const type_info_t* type = ptr_type->pointee;
+    size_t             size = type->is_pointer ? 8 : type->size;
+    for (size_t i = 1; i <= atomic_ops[op].operands; i++)
+    {
+        vals[i] = gen_convert(gen_expr(&args[i]), type);
+        if (!vals[i].val)
         {
-            gen_block(else_block->data.else_stmt.block);
-            emit("jmp %s\n", cont_lab);
+            for (size_t j = 0; j < i; j++)
+                free(vals[j].val);
+            return true;
         }
     }
-    if (manage_cont)
+
+    static const char suffix[] = {[1] = 'b', [2] = 'w', [4] = 'l', [8] = 'q'};
+    const char*       val      = asm_reg_name(REG_RSI, size);
+    asm_out                    = open_memstream(&text, &len);
+    if (!asm_out)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for atomic");
+    switch ((atomic_op_t) op)
     {
-        emit("%s\n", cont_lab);
-        free(cont_lab);
+    case ATOMIC_LOAD:
+        fprintf(asm_out, "\tmov%c (%%rdi), %%%s\n", suffix[size], asm_reg_name(REG_RAX, size));
+        atomic_result(asm_out, REG_RAX, type);
+        break;
+    case ATOMIC_STORE:
+        // A seq_cst store must not be reordered with later loads, xchg is a full barrier.
+        fprintf(asm_out, "\t%s%c %%%s, (%%rdi)\n", order == ORDER_SEQ_CST ? "xchg" : "mov",
+                suffix[size], val);
+        break;
+    case ATOMIC_EXCHANGE:
+        fprintf(asm_out, "\txchg%c %%%s, (%%rdi)\n", suffix[size], val);
+        atomic_result(asm_out, REG_RSI, type);
+        break;
+    case ATOMIC_FETCH_ADD:
+        fprintf(asm_out, "\tlock xadd%c %%%s, (%%rdi)\n", suffix[size], val);
+        atomic_result(asm_out, REG_RSI, type);
+        break;
+    case ATOMIC_CAS:
+        fprintf(asm_out, "\tmovq %%rsi, %%rax\n");
+        fprintf(asm_out, "\tlock cmpxchg%c %%%s, (%%rdi)\n", suffix[size],
+                asm_reg_name(REG_RDX, size));
+        atomic_result(asm_out, REG_RAX, type);
+        break;
+    default:
+        break;
     }
+    fclose(asm_out);
+
+    char* ret = emit_asm_marker(text, op == ATOMIC_STORE ? 0 : type->qbe_type, vals, 3);
+    if (ret)
+        *out = (gen_result_t){.val = ret, .qbe_type = type->qbe_type, .type = type};
+    for (size_t i = 0; i < 3; i++)
+        free(vals[i].val);
+    return true;
+}
+
+// Replaces the marker calls in QBE's assembly output with the expanded asm statements.
+static int splice_inline_asm(const char* asm_path)
+{
+    if (ctx.asm_block_count == 0)
+        return 0;
+    FILE* in = fopen(asm_path, "r");
+    if (!in)
+        return 1;
+    char*  asm_text = NULL;
+    size_t asm_len  = 0;
+    FILE*  buf      = open_memstream(&asm_text, &asm_len);
+    char   line[4096];
+    while (buf && fgets(line, sizeof(line), in))
+    {
+        const char* marker = strstr(line, "__micro_asm_");
+        const char* call   = strstr(line, "call");
+        size_t      id     = marker ? strtoul(marker + strlen("__micro_asm_"), NULL, 10) : 0;
+        if (marker && call && call < marker && id < ctx.asm_block_count)
+            fprintf(buf, "#APP\n%s#NO_APP\n", ctx.asm_blocks[id]);
+        else
+            fputs(line, buf);
+    }
+    fclose(in);
+    if (!buf)
+        return 1;
+    fclose(buf);
+    FILE* out = fopen(asm_path, "w");
+    if (!out)
+    {
+        free(asm_text);
+        return 1;
+    }
+    fwrite(asm_text, 1, asm_len, out);
+    fclose(out);
+    free(asm_text);
+    return 0;
 }
 
 static void gen_stmt(ast_node_t* node)
@@ -652,6 +3291,8 @@ static void gen_stmt(ast_node_t* node)
         [NODE_FUNC_CALL] = gen_func_call_stmt,
         [NODE_ASSIGN]    = gen_assign_stmt,
         [NODE_BLOCK]     = gen_block,
+        [NODE_WHILE]     = gen_while,
+        [NODE_ASM]       = gen_asm,
     };
     if (node->type == NODE_IF)
     {
@@ -660,12 +3301,13 @@ static void gen_stmt(ast_node_t* node)
     }
     if (node->type == NODE_IMPORT)
         return;
+    locate(node);
     if (node->type < sizeof(handlers) / sizeof(handlers[0]) && handlers[node->type])
     {
         handlers[node->type](node);
         return;
     }
-    ERROR_FATAL(NULL, 0, 0, "Unimplemented statement type");
+    gen_error("Unimplemented statement type");
 }
 
 static void gen_block(ast_node_t* node)
@@ -673,22 +3315,20 @@ static void gen_block(ast_node_t* node)
     if (!node || node->type != NODE_BLOCK)
         return;
     push_scope();
-    for (size_t i = 0; i < node->data.block.stmt_count; i++)
+    // Statements after a return are unreachable.
+    for (size_t i = 0; i < node->data.block.stmt_count && !ctx.terminated; i++)
         gen_stmt(&node->data.block.stmts[i]);
     pop_scope();
 }
 
-static void gen_func_def(ast_node_t* node)
+// Emits one function body. For generic functions `env` binds the type parameters and `name` is
+// the mangled symbol of the instantiation.
+static void gen_function(ast_node_t* node, const char* name, const type_env_t* env)
 {
-    if (!node || node->type != NODE_FUNC_DEF)
-        return;
-    if (node->data.func_def.is_declaration)
-        return;
-    char* name = strndup(node->data.func_def.name, node->data.func_def.name_len);
-    if (!name)
-        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function name");
+    ctx.env       = env;
     char ret_type = str_to_qbe_type(node->data.func_def.return_type);
-    if (strcmp(name, "main") == 0)
+    // Objects export every function for the modules importing them, instances stay local.
+    if (strcmp(name, "main") == 0 || (ctx.opts->compile_only && !env))
         emit("export ");
     emit("function ");
     if (ret_type != 0)
@@ -713,26 +3353,272 @@ static void gen_func_def(ast_node_t* node)
         param = param->next;
     }
     emit(") {\n@start\n");
-    free(name);
+    ctx.ret_type = str_to_type(node->data.func_def.return_type);
+    if (type_is_vector(ctx.ret_type))
+        gen_error("Functions cannot return vectors, store through a pointer instead");
+
+    // The body is generated into a buffer, so the stack slots it needs can be emitted first.
+    FILE*  out       = ctx.out;
+    char*  body_buf  = NULL;
+    size_t body_len  = 0;
+    char*  frame_buf = NULL;
+    size_t frame_len = 0;
+    ctx.out          = open_memstream(&body_buf, &body_len);
+    ctx.frame        = open_memstream(&frame_buf, &frame_len);
+    if (!ctx.out || !ctx.frame)
+        ERROR_FATAL(NULL, 0, 0, "Failed to open function buffer");
+    ctx.terminated = false;
+
+    ast_walk(node->data.func_def.root, collect_escaped, NULL);
     push_scope();
     param = node->data.func_def.params;
     while (param && !param->is_variadic)
     {
-        char  ptype      = str_to_qbe_type(param->type);
-        char* param_name = strndup(param->name, param->name_len);
-        if (!param_name)
-            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for parameter name");
-        char* param_ptr = malloc(param->name_len + 2);
-        if (!param_ptr)
-            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for parameter pointer");
-        sprintf(param_ptr, "%%%.*s", (int) param->name_len, param->name);
-        add_sym(param->name, param->name_len, param_ptr, ptype);
-        free(param_name);
+        // Parameters get a stack slot like any other local, so they can be assigned and addressed.
+        const type_info_t* ptype     = str_to_type(param->type);
+        bool               promote   = is_promotable(ptype, param->name, param->name_len, node);
+        char*              param_ptr =
+            frame_alloc(ptype->size, slot_align(ptype), promote ? ptype->qbe_type : 0);
+        char               param_val[128];
+        add_sym(param->name, param->name_len, param_ptr, param->type);
+        var_info_t vi  = find_sym(ctx.current_scope->entries->name);
+        mem_loc_t  loc = {vi.ptr, vi.ptr, vi.type, !vi.escaped, false};
+        snprintf(param_val, sizeof(param_val), "%%%.*s", (int) param->name_len, param->name);
+        if (type_is_vector(ptype))
+            vec_copy(vi.ptr, param_val, ptype);
+        else
+            gen_store(&loc, param_val);
         param = param->next;
     }
     gen_block(node->data.func_def.root);
     pop_scope();
+    if (!ctx.terminated)
+        emit(ctx.ret_type->qbe_type ? "ret 0\n" : "ret\n");
     emit("}\n");
+    frame_emit();
+
+    fclose(ctx.out);
+    fclose(ctx.frame);
+    ctx.out   = out;
+    ctx.frame = NULL;
+    fwrite(frame_buf, 1, frame_len, ctx.out);
+    fwrite(body_buf, 1, body_len, ctx.out);
+    free(frame_buf);
+    free(body_buf);
+    cache_clear();
+    free_escaped();
+    ctx.env = NULL;
+}
+
+/* ================== */
+/* Function layout    */
+/* ================== */
+
+// Calls are recorded per (caller, callee) pair so the functions can be ordered by call graph once
+// all of them are generated. Without a profile, a call inside a loop is taken to run 10 times per
+// nesting level.
+static void record_call(const char* callee)
+{
+    if (ctx.opts->opt_level == 0 || !ctx.func_name)
+        return;
+    uint64_t weight = 1;
+    for (int i = 0; i < ctx.loop_depth && i < 4; i++)
+        weight *= 10;
+    for (call_edge_t* e = ctx.call_edges; e; e = e->next)
+    {
+        if (strcmp(e->caller, ctx.func_name) == 0 && strcmp(e->callee, callee) == 0)
+        {
+            e->weight += weight;
+            return;
+        }
+    }
+    call_edge_t* e = calloc(1, sizeof(call_edge_t));
+    if (!e)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for call edge");
+    e->caller = strdup(ctx.func_name);
+    e->callee = strdup(callee);
+    if (!e->caller || !e->callee)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for call edge");
+    e->weight      = weight;
+    e->next        = ctx.call_edges;
+    ctx.call_edges = e;
+}
+
+// Generates a function into its own buffer, to be written out by write_functions().
+static size_t gen_function_text(ast_node_t* node, const char* name, const type_env_t* env)
+{
+    FILE*        out = ctx.out;
+    func_text_t* ft  = calloc(1, sizeof(func_text_t));
+    if (!ft)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function text");
+    ft->name   = strdup(name);
+    ft->line   = node->line;
+    ft->column = node->column;
+    ctx.out    = open_memstream(&ft->text, &ft->len);
+    if (!ft->name || !ctx.out)
+        ERROR_FATAL(NULL, 0, 0, "Failed to open function buffer");
+    ctx.func_name       = name;
+    ctx.loop_depth      = 0;
+    ctx.forwarded_loads = 0;
+    size_t frame_bytes  = ctx.frame_bytes;
+    int    slot_objects = ctx.slot_objects;
+    int    slot_count   = ctx.slot_count;
+    trace_begin(name, "function");
+    gen_function(node, name, env);
+    trace_end();
+    remark_emit(REMARK_ANALYSIS, "frame", name, node->line, node->column,
+                "%zu frame bytes, %d stack objects in %d slots", ctx.frame_bytes - frame_bytes,
+                ctx.slot_objects - slot_objects, ctx.slot_count - slot_count);
+    if (ctx.forwarded_loads > 0)
+        remark_emit(REMARK_PASSED, "load-forward", name, node->line, node->column,
+                    "redundant loads replaced by earlier values: %d", ctx.forwarded_loads);
+    fclose(ctx.out);
+    ctx.out       = out;
+    ctx.func_name = NULL;
+
+    func_text_t** link = &ctx.func_texts;
+    while (*link)
+        link = &(*link)->next;
+    *link = ft;
+    return ft->len;
+}
+
+static size_t func_index(func_text_t** funcs, size_t count, const char* name)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(funcs[i]->name, name) == 0)
+            return i;
+    }
+    return count;
+}
+
+// At -O1 functions are laid out along the call graph: callers and their hottest callees end up
+// next to each other at the front of .text, and functions main never reaches (or the profile
+// never saw run) go to .text.unlikely.
+static void write_functions(void)
+{
+    size_t count = 0;
+    for (func_text_t* ft = ctx.func_texts; ft; ft = ft->next)
+        count++;
+    if (count == 0)
+        return;
+    func_text_t**  funcs  = calloc(count, sizeof(func_text_t*));
+    layout_func_t* layout = calloc(count, sizeof(layout_func_t));
+    size_t*        order  = calloc(count, sizeof(size_t));
+    if (!funcs || !layout || !order)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function layout");
+    size_t i = 0;
+    for (func_text_t* ft = ctx.func_texts; ft; ft = ft->next)
+        funcs[i++] = ft;
+    for (i = 0; i < count; i++)
+        order[i] = i;
+
+    if (ctx.opts->opt_level > 0)
+    {
+        layout_profile_t* profile =
+            ctx.opts->profile ? layout_profile_load(ctx.opts->profile) : NULL;
+        bool has_main = func_index(funcs, count, "main") < count;
+        for (i = 0; i < count; i++)
+        {
+            layout[i].name     = funcs[i]->name;
+            layout[i].is_entry =
+                !has_main || ctx.opts->compile_only || strcmp(funcs[i]->name, "main") == 0;
+            layout_profile_count(profile, funcs[i]->name, &layout[i].count);
+        }
+        size_t edge_count = 0;
+        for (call_edge_t* e = ctx.call_edges; e; e = e->next)
+            edge_count++;
+        layout_edge_t* edges = calloc(edge_count ? edge_count : 1, sizeof(layout_edge_t));
+        if (!edges)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function layout");
+        size_t n = 0;
+        for (call_edge_t* e = ctx.call_edges; e; e = e->next)
+        {
+            // Calls to external functions (libc, runtime modules) are not laid out here.
+            size_t caller = func_index(funcs, count, e->caller);
+            size_t callee = func_index(funcs, count, e->callee);
+            if (caller == count || callee == count)
+                continue;
+            uint64_t weight = e->weight;
+            if (profile && !layout_profile_edge(profile, e->caller, e->callee, &weight))
+                weight = 0;
+            edges[n++] = (layout_edge_t){caller, callee, weight};
+        }
+        layout_order(layout, count, edges, n, order);
+        free(edges);
+        layout_profile_free(profile);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        func_text_t* ft      = funcs[order[i]];
+        const char*  section = layout[order[i]].cold ? ".text.unlikely" : ".text";
+        if (ctx.opts->function_sections)
+            fprintf(ctx.out, "section \"%s.%s\" ", section, ft->name);
+        else if (layout[order[i]].cold)
+            fprintf(ctx.out, "section \"%s\" ", section);
+        ctx.cold_funcs += layout[order[i]].cold;
+        if (layout[order[i]].cold)
+            remark_emit(REMARK_PASSED, "layout", ft->name, ft->line, ft->column,
+                        "'%s' moved to .text.unlikely, %s", ft->name,
+                        ctx.opts->profile ? "the profile never saw it run"
+                                          : "no call from an entry point reaches it");
+        fwrite(ft->text, 1, ft->len, ctx.out);
+    }
+    free(funcs);
+    free(layout);
+    free(order);
+}
+
+static void free_functions(void)
+{
+    while (ctx.func_texts)
+    {
+        func_text_t* next = ctx.func_texts->next;
+        free(ctx.func_texts->name);
+        free(ctx.func_texts->text);
+        free(ctx.func_texts);
+        ctx.func_texts = next;
+    }
+    while (ctx.call_edges)
+    {
+        call_edge_t* next = ctx.call_edges->next;
+        free(ctx.call_edges->caller);
+        free(ctx.call_edges->callee);
+        free(ctx.call_edges);
+        ctx.call_edges = next;
+    }
+    ctx.cold_funcs = 0;
+}
+
+static void gen_func_def(ast_node_t* node)
+{
+    if (!node || node->type != NODE_FUNC_DEF)
+        return;
+    // Generic functions are only emitted through their instantiations.
+    if (node->data.func_def.is_declaration || node->data.func_def.type_params)
+        return;
+    char* name = strndup(node->data.func_def.name, node->data.func_def.name_len);
+    if (!name)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function name");
+    gen_function_text(node, name, NULL);
+    free(name);
+}
+
+// Diagnostics in a generic function of an imported module are located in that module.
+static void instance_origin(const ast_node_t* func)
+{
+    for (size_t i = 0; ctx.opts->import_paths && i < ctx.opts->import_count; i++)
+    {
+        const ast_node_t* module = ctx.opts->imports[i];
+        if (func >= module->data.program.func_defs &&
+            func < module->data.program.func_defs + module->data.program.func_def_count)
+        {
+            error_origin(ctx.opts->import_paths[i], ctx.opts->import_sources[i]);
+            return;
+        }
+    }
 }
 
 static void gen_program(ast_node_t* node)
@@ -741,8 +3627,70 @@ static void gen_program(ast_node_t* node)
         return;
     for (size_t i = 0; i < node->data.program.func_def_count; i++)
         gen_func_def(&node->data.program.func_defs[i]);
+    // Instances can request further instances, so emit until the list stops growing.
+    bool pending = true;
+    while (pending)
+    {
+        pending = false;
+        for (instance_t* inst = ctx.instances; inst; inst = inst->next)
+        {
+            if (inst->emitted)
+                continue;
+            int start_lines = ctx.il_lines;
+            inst->emitted   = true;
+            instance_origin(inst->func);
+            inst->il_bytes = (long) gen_function_text(inst->func, inst->name, &inst->env);
+            inst->il_lines = ctx.il_lines - start_lines;
+            pending        = true;
+            error_origin(NULL, NULL);
+        }
+    }
+    write_functions();
+    if (ctx.put_int_used)
+    {
+        if (ctx.opts->function_sections)
+            emit("section \".text.__micro_put_int\" ");
+        for (size_t i = 0; i < sizeof(put_int_il) / sizeof(put_int_il[0]); i++)
+            emit("%s\n", put_int_il[i]);
+    }
+}
+
+static void print_stats(ast_node_t* root)
+{
+    size_t functions = 0, generics = 0, instances = 0;
+    for (size_t i = 0; i < root->data.program.func_def_count; i++)
+    {
+        ast_node_t* func = &root->data.program.func_defs[i];
+        if (func->type != NODE_FUNC_DEF || func->data.func_def.is_declaration)
+            continue;
+        if (func->data.func_def.type_params)
+            generics++;
+        else
+            functions++;
+    }
+    for (instance_t* inst = ctx.instances; inst; inst = inst->next)
+        instances++;
+    printf("=== Stats ===\n");
+    printf("Functions: %zu\n", functions);
+    printf("Generic functions: %zu\n", generics);
+    printf("Instantiations: %zu (%d requests)\n", instances, ctx.instance_requests);
+    printf("Inlined memory builtins: %d\n", ctx.mem_inlined);
+    printf("Specialized printf calls: %d\n", ctx.printf_lowered);
+    printf("IL lines: %d\n", ctx.il_lines);
+    printf("Stack objects: %d in %d slots (%zu frame bytes)\n", ctx.slot_objects, ctx.slot_count,
+           ctx.frame_bytes);
+    if (ctx.opts->opt_level > 0)
+        printf("Cold functions: %d\n", ctx.cold_funcs);
+    for (instance_t* inst = ctx.instances; inst; inst = inst->next)
+    {
+        printf("  %.*s<", (int) inst->func->data.func_def.name_len, inst->func->data.func_def.name);
+        for (size_t i = 0; i < inst->env.count; i++)
+            printf("%s%s", i ? ", " : "", inst->env.types[i]->name);
+        printf("> -> $%s (%d IL lines, %ld bytes)\n", inst->name, inst->il_lines, inst->il_bytes);
+    }
 }
 
+// Leaves a clean context for the next compilation in the same process (compile server, batch).
 static void free_context(void)
 {
     free_strings();
@@ -755,92 +3703,275 @@ static void free_context(void)
     }
     while (ctx.current_scope)
         pop_scope();
-    ctx.temp_count  = 0;
-    ctx.label_count = 0;
-    ctx.str_count   = 0;
+    cache_clear();
+    free_escaped();
+    free_instances();
+    free_globals();
+    free_functions();
+    for (size_t i = 0; i < ctx.asm_block_count; i++)
+        free(ctx.asm_blocks[i]);
+    free(ctx.asm_blocks);
+    ctx = (codegen_context_t){0}; // NOTE: counters and flags too, e.g. after a failed function
+    simd_reset();
+    types_reset();
 }
 
-int codegen_generate(ast_node_t* root, const char* output_path)
+static void count_output(const char* path)
 {
-    if (!root || root->type != NODE_PROGRAM)
+    struct stat st;
+    if (stat(path, &st) == 0)
+        timing_add(COUNTER_BYTES_OUT, st.st_size);
+}
+
+static void register_funcs(ast_node_t* root)
+{
+    for (size_t i = 0; i < root->data.program.func_def_count; i++)
     {
-        ERROR_FATAL(NULL, 0, 0, "Root node must be a program");
-        return 1;
+        if (root->data.program.func_defs[i].type != NODE_FUNC_DEF)
+            continue;
+        func_entry_t* fe = calloc(1, sizeof(func_entry_t));
+        if (!fe)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function entry");
+        fe->name = strndup(root->data.program.func_defs[i].data.func_def.name,
+                           root->data.program.func_defs[i].data.func_def.name_len);
+        if (!fe->name)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function name");
+        fe->node  = &root->data.program.func_defs[i];
+        fe->next  = ctx.funcs;
+        ctx.funcs = fe;
     }
-    char* qbe_path = malloc(strlen(output_path) + 5);
-    if (!qbe_path)
-        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for QBE path");
-    char* asm_path = malloc(strlen(output_path) + 5);
-    if (!asm_path)
-        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for ASM path");
-    sprintf(qbe_path, "%s.qbe", output_path);
-    sprintf(asm_path, "%s.asm", output_path);
+}
+
+// Runs the stages up to the one selected by opts->emit, see codegen_generate().
+static int generate_output(ast_node_t* root, const char* output_path, const char* qbe_path,
+                           const char* asm_path)
+{
+    unsigned errors = error_count();
+    timing_begin(PHASE_CODEGEN);
     ctx.out = fopen(qbe_path, "w");
     if (!ctx.out)
     {
         ERROR_FATAL(NULL, 0, 0, "Failed to open QBE output file");
-        free(qbe_path);
-        free(asm_path);
+        timing_end(PHASE_CODEGEN);
         return 1;
     }
     collect_strings(root);
+    for (size_t i = 0; i < ctx.opts->import_count; i++)
+    {
+        // Generic functions of imported modules are instantiated here, with their literals.
+        ast_node_t* module = ctx.opts->imports[i];
+        for (size_t j = 0; j < module->data.program.func_def_count; j++)
+        {
+            ast_node_t* func = &module->data.program.func_defs[j];
+            if (func->type == NODE_FUNC_DEF && func->data.func_def.type_params)
+                collect_strings(func);
+        }
+    }
+    // Imported modules are registered first, so the module's own definitions take precedence.
+    for (size_t i = 0; i < ctx.opts->import_count; i++)
+    {
+        gen_globals(ctx.opts->imports[i], true);
+        register_funcs(ctx.opts->imports[i]);
+    }
+    gen_globals(root, false);
+    register_funcs(root);
+    gen_program(root);
+    // Literals are emitted once the code is generated, leaving out those it doesn't reference,
+    // e.g. the format of a printf that was specialized.
     for (str_info_t* si = ctx.strings; si; si = si->next)
     {
+        if (!si->used)
+            continue;
+        emit_data_section(".data", si->gname + 1);
         emit("data %s = { ", si->gname);
         for (size_t j = 0; j < si->len; j++)
             emit("b %d, ", (unsigned char) si->value[j]);
         emit("b 0 }\n");
     }
-    for (size_t i = 0; i < root->data.program.func_def_count; i++)
-    {
-        func_entry_t* fe = calloc(1, sizeof(func_entry_t));
-        if (!fe)
-            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function entry");
-        fe->name = strndup(root->data.program.func_defs[i].data.func_def.name,
-                           root->data.program.func_defs[i].data.func_def.name_len);
-        if (!fe->name)
-            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function name");
-        fe->node  = &root->data.program.func_defs[i];
-        fe->next  = ctx.funcs;
-        ctx.funcs = fe;
-    }
-    gen_program(root);
+    if (ctx.opts->print_stats)
+        print_stats(root);
+    timing_add(COUNTER_IL_LINES, ctx.il_lines);
+    timing_add(COUNTER_IL_BYTES, ftell(ctx.out));
     fclose(ctx.out);
-    ctx.out       = NULL;
+    ctx.out = NULL;
+    timing_end(PHASE_CODEGEN);
+    // Semantic errors are reported while generating, the IL is incomplete then.
+    if (error_count() != errors)
+        return 1;
+    if (ctx.opts->emit == CODEGEN_EMIT_QBE)
+        return 0;
     char* qbe_cmd = malloc(strlen(qbe_path) + strlen(asm_path) + 20);
     if (!qbe_cmd)
         ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for QBE command");
     sprintf(qbe_cmd, "qbe -o %s %s", asm_path, qbe_path);
+    timing_begin(PHASE_QBE);
     int qbe_result = system(qbe_cmd);
+    timing_end(PHASE_QBE);
     free(qbe_cmd);
     if (qbe_result != 0)
     {
         ERROR_FATAL(NULL, 0, 0, "QBE failed to generate assembly");
-        free_context();
-        free(qbe_path);
-        free(asm_path);
         return 1;
     }
-    char* cc_cmd = malloc(strlen(asm_path) + strlen(output_path) + 30);
+    if (splice_inline_asm(asm_path) != 0)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to insert inline assembly");
+        return 1;
+    }
+    FILE* asm_out = fopen(asm_path, "a");
+    if (!asm_out)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to open assembly output file");
+        return 1;
+    }
+    simd_write_stubs(asm_out, ctx.opts->function_sections);
+    for (size_t i = 0; i < root->data.program.func_def_count; i++)
+    {
+        // Runtime modules are linked in once, however often they are imported.
+        ast_node_t* stmt  = &root->data.program.func_defs[i];
+        bool        first = stmt->type == NODE_IMPORT;
+        for (size_t j = 0; first && j < i; j++)
+        {
+            ast_node_t* prev = &root->data.program.func_defs[j];
+            first = prev->type != NODE_IMPORT ||
+                    strcmp(prev->data.import.module, stmt->data.import.module) != 0;
+        }
+        if (first)
+            runtime_write(asm_out, stmt->data.import.module, ctx.opts->simd);
+    }
+    fclose(asm_out);
+    if (ctx.opts->emit == CODEGEN_EMIT_ASM)
+        return 0;
+    char* cc_cmd = malloc(strlen(asm_path) + strlen(output_path) + 50);
     if (!cc_cmd)
         ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for CC command");
-    sprintf(cc_cmd, "clang -o %s %s", output_path, asm_path);
+    if (ctx.opts->compile_only)
+        sprintf(cc_cmd, "clang -c -o %s %s", output_path, asm_path);
+    else
+        sprintf(cc_cmd, "clang -o %s %s%s", output_path, asm_path,
+                ctx.opts->gc_sections ? " -Wl,--gc-sections" : "");
+    timing_begin(PHASE_CLANG);
     int cc_result = system(cc_cmd);
+    timing_end(PHASE_CLANG);
     free(cc_cmd);
     if (cc_result != 0)
     {
-        ERROR_FATAL(NULL, 0, 0, "Clang failed to link executable");
+        ERROR_FATAL(NULL, 0, 0,
+                    ctx.opts->compile_only ? "Clang failed to assemble object"
+                                           : "Clang failed to link executable");
         unlink(qbe_path);
         unlink(asm_path);
-        free_context();
-        free(qbe_path);
-        free(asm_path);
         return 1;
     }
     // unlink(qbe_path);
     // unlink(asm_path);
+    return 0;
+}
+
+static bool copy_to_stdout(const char* path)
+{
+    FILE* in = fopen(path, "rb");
+    if (!in)
+        return false;
+    char   buf[4096];
+    size_t n;
+    bool   ok = true;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+        ok = fwrite(buf, 1, n, stdout) == n;
+    fclose(in);
+    return fflush(stdout) == 0 && ok;
+}
+
+// Compiles `root` to `output_path`: an executable (or object), or the IL or assembly with
+// opts->emit. The earlier stages leave their files next to it (.qbe, .asm). With "-" everything
+// is built in temporary files and the output is written to stdout.
+int codegen_generate(ast_node_t* root, const char* output_path, const codegen_options_t* opts)
+{
+    static const codegen_options_t default_opts = {0};
+    ctx.opts = opts ? opts : &default_opts;
+    if (!root || root->type != NODE_PROGRAM)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Root node must be a program");
+        return 1;
+    }
+    char stream_path[] = "/tmp/cmicro-XXXXXX";
+    bool stream        = strcmp(output_path, "-") == 0;
+    if (stream)
+    {
+        int fd = mkstemp(stream_path);
+        if (fd < 0)
+        {
+            ERROR_FATAL(NULL, 0, 0, "Failed to create temporary output file");
+            return 1;
+        }
+        close(fd);
+        output_path = stream_path;
+    }
+    char* qbe_path = malloc(strlen(output_path) + 5);
+    if (!qbe_path)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for QBE path");
+    char* asm_path = malloc(strlen(output_path) + 5);
+    if (!asm_path)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for ASM path");
+    sprintf(qbe_path, "%s.qbe", output_path);
+    sprintf(asm_path, "%s.asm", output_path);
+    if (ctx.opts->emit == CODEGEN_EMIT_QBE)
+        strcpy(qbe_path, output_path);
+    else if (ctx.opts->emit == CODEGEN_EMIT_ASM)
+        strcpy(asm_path, output_path);
+
+    int result = generate_output(root, output_path, qbe_path, asm_path);
+    if (result == 0)
+        count_output(output_path);
+    if (!remark_write(stream ? "-" : output_path))
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to write optimization record");
+        result = 1;
+    }
+    if (stream)
+    {
+        if (result == 0 && !copy_to_stdout(output_path))
+        {
+            ERROR_FATAL(NULL, 0, 0, "Failed to write output to stdout");
+            result = 1;
+        }
+        unlink(output_path);
+        unlink(qbe_path);
+        unlink(asm_path);
+    }
     free_context();
     free(qbe_path);
     free(asm_path);
+    return result;
+}
+
+// Links the objects of a multi-module build into one executable.
+int codegen_link(const char* const* objects, size_t count, const char* output_path,
+                 const codegen_options_t* opts)
+{
+    size_t len = strlen(output_path) + 50;
+    for (size_t i = 0; i < count; i++)
+        len += strlen(objects[i]) + 1;
+    char* cmd = malloc(len);
+    if (!cmd)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for link command");
+        return 1;
+    }
+    size_t n = sprintf(cmd, "clang -o %s", output_path);
+    for (size_t i = 0; i < count; i++)
+        n += sprintf(cmd + n, " %s", objects[i]);
+    if (opts && opts->gc_sections)
+        sprintf(cmd + n, " -Wl,--gc-sections");
+    timing_begin(PHASE_LINK);
+    int result = system(cmd);
+    timing_end(PHASE_LINK);
+    free(cmd);
+    if (result != 0)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Clang failed to link executable");
+        return 1;
+    }
+    count_output(output_path);
     return 0;
-}
\ No newline at end of file
+}
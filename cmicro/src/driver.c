@@ -0,0 +1,1091 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#define _GNU_SOURCE
+#include <driver.h>
+#include <lexer.h>
+#include <parser.h>
+#include <timing.h>
+#include <trace.h>
+#include <remark.h>
+#include <error.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define MEM_CATEGORY MEM_SOURCE
+#include <mem.h>
+
+typedef enum
+{
+    MODULE_PENDING,
+    MODULE_RUNNING,
+    MODULE_DONE,
+    MODULE_FAILED,
+    MODULE_SKIPPED // NOTE: not compiled because an imported module failed
+} module_state_t;
+
+// The parsed form of a source file. Owned by the module, or by the cache when there is one.
+typedef struct unit
+{
+    char*       source;
+    size_t      len;
+    token_t*    tokens;
+    size_t      token_count;
+    ast_node_t* ast;
+} unit_t;
+
+typedef struct cache_entry
+{
+    char*               path; // NOTE: absolute, as returned by realpath()
+    struct timespec     mtime;
+    off_t               size;
+    uint64_t            hash; // FNV-1a of the source
+    unit_t*             unit;
+    struct cache_entry* next;
+} cache_entry_t;
+
+struct module_cache
+{
+    cache_entry_t* entries;
+    unsigned       hits;
+    unsigned       misses;
+};
+
+// What the previous build recorded in a module's manifest (<object>.d).
+typedef struct manifest
+{
+    bool      valid;
+    uint64_t  source;    // hash of the module's source
+    uint64_t  options;   // hash of the code generation options
+    uint64_t  interface; // interface hash of the module itself
+    size_t    import_count;
+    char**    import_names;
+    uint64_t* import_hashes; // interface hashes of the imports the object was compiled against
+} manifest_t;
+
+typedef struct module
+{
+    const char*    path;
+    char*          name;   // file name without directory and extension, as used by imports
+    char*          object; // path of the object file
+    unit_t*        unit;
+    bool           owns_unit;
+    ast_node_t*    ast;
+    size_t*        deps; // indices of the imported modules
+    size_t         dep_count;
+    uint64_t       source_hash;
+    uint64_t       interface_hash; // NOTE: what importers see, see interface_hash()
+    manifest_t     recorded;
+    bool           fresh; // source, options and object unchanged since the recorded build
+    module_state_t state;
+    pid_t          pid;
+    FILE*          out;    // captured stdout of the compile job
+    FILE*          err;    // captured stderr of the compile job
+    FILE*          timing; // phase timings, allocation counts and trace of the compile job
+    error_sink_t*  diags;  // NOTE: diagnostics of the finished compile job until reported
+} module_t;
+
+/* ================== */
+/* Loading            */
+/* ================== */
+
+static char* module_name(const char* path)
+{
+    const char* base = strrchr(path, '/');
+    base             = base ? base + 1 : path;
+    const char* ext  = strrchr(base, '.');
+    return strndup(base, ext && ext != base ? (size_t) (ext - base) : strlen(base));
+}
+
+static char* object_path(const char* path)
+{
+    const char* base = strrchr(path, '/');
+    const char* ext  = strrchr(base ? base : path, '.');
+    size_t      len  = ext ? (size_t) (ext - path) : strlen(path);
+    char*       obj  = malloc(len + 3);
+    if (!obj)
+        return NULL;
+    memcpy(obj, path, len);
+    strcpy(obj + len, ".o");
+    return obj;
+}
+
+static char* read_file(const char* path, size_t* len)
+{
+    timing_begin(PHASE_READ);
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Failed to open source file '%s'\n", path);
+        timing_end(PHASE_READ);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    rewind(f);
+    char* source = malloc(file_size + 1);
+    if (!source)
+    {
+        fprintf(stderr, "Error: Memory allocation failed for source buffer\n");
+        fclose(f);
+        timing_end(PHASE_READ);
+        return NULL;
+    }
+    *len = fread(source, 1, file_size, f);
+    fclose(f);
+    source[*len] = '\0';
+    timing_add(COUNTER_BYTES_IN, *len);
+    timing_end(PHASE_READ);
+    return source;
+}
+
+static void unit_free(unit_t* unit)
+{
+    if (!unit)
+        return;
+    if (unit->ast)
+        ast_free(unit->ast);
+    for (size_t i = 0; i < unit->token_count; i++)
+    {
+        if (unit->tokens[i].type == TOKEN_SLIT)
+            free((char*) unit->tokens[i].value.str.x);
+    }
+    free(unit->tokens);
+    free(unit->source);
+    free(unit);
+}
+
+static bool unit_lex_parse(unit_t* unit)
+{
+    lexer_t lex      = {unit->source, unit->len, 0, 1, 1};
+    size_t  capacity = 0;
+    timing_begin(PHASE_LEX);
+    for (;;)
+    {
+        token_t tok = lexer_next(&lex);
+        if (tok.type == TOKEN_ERROR)
+        {
+            ERROR_FATAL(NULL, 0, 0, "Lexing failed");
+            timing_end(PHASE_LEX);
+            return false;
+        }
+        if (unit->token_count >= capacity)
+        {
+            capacity            = capacity ? capacity * 2 : 64;
+            token_t* new_tokens =
+                mem_realloc(unit->tokens, capacity * sizeof(token_t), MEM_TOKENS);
+            if (!new_tokens)
+            {
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for token buffer");
+                timing_end(PHASE_LEX);
+                return false;
+            }
+            unit->tokens = new_tokens;
+        }
+        unit->tokens[unit->token_count++] = tok;
+        if (tok.type == TOKEN_EOF)
+            break;
+    }
+    timing_end(PHASE_LEX);
+    timing_add(COUNTER_TOKENS, unit->token_count);
+    timing_begin(PHASE_PARSE);
+    unit->ast = ast_gen(unit->tokens);
+    timing_end(PHASE_PARSE);
+    if (!unit->ast)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to generate AST");
+        return false;
+    }
+    timing_add(COUNTER_AST_NODES, ast_node_count(unit->ast));
+    return true;
+}
+
+// Lexes and parses `source`, which the returned unit takes ownership of. The diagnostics of a
+// module are written out together, sorted by position.
+static unit_t* unit_parse(const char* path, char* source, size_t len)
+{
+    unit_t* unit = calloc(1, sizeof(unit_t));
+    if (!unit)
+    {
+        fprintf(stderr, "Error: Memory allocation failed for module\n");
+        free(source);
+        return NULL;
+    }
+    unit->source = source;
+    unit->len    = len;
+    error_begin(path, source, len);
+    bool ok = unit_lex_parse(unit);
+    error_flush();
+    if (!ok)
+    {
+        unit_free(unit);
+        return NULL;
+    }
+    return unit;
+}
+
+// FNV-1a, continuing from `hash`.
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t len)
+{
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// A cached unit is reused while the file's mtime and size are unchanged. If they changed, the
+// file is read again and only parsed if its contents changed too (e.g. not after a `touch`).
+static unit_t* cache_lookup(module_cache_t* cache, const char* path, bool verbose)
+{
+    struct stat st;
+    char*       full = realpath(path, NULL);
+    if (!full || stat(full, &st) != 0)
+    {
+        fprintf(stderr, "Error: Failed to open source file '%s'\n", path);
+        free(full);
+        return NULL;
+    }
+    cache_entry_t* entry = cache->entries;
+    while (entry && strcmp(entry->path, full) != 0)
+        entry = entry->next;
+    if (entry && entry->size == st.st_size && entry->mtime.tv_sec == st.st_mtim.tv_sec &&
+        entry->mtime.tv_nsec == st.st_mtim.tv_nsec)
+    {
+        free(full);
+        cache->hits++;
+        if (verbose)
+            printf("[*] Reusing cached '%s'\n", path);
+        return entry->unit;
+    }
+
+    size_t len    = 0;
+    char*  source = read_file(full, &len);
+    if (!source)
+    {
+        free(full);
+        return NULL;
+    }
+    uint64_t hash = hash_bytes(0xcbf29ce484222325ull, source, len);
+    if (entry && entry->hash == hash)
+    {
+        free(source);
+        free(full);
+        entry->mtime = st.st_mtim;
+        entry->size  = st.st_size;
+        cache->hits++;
+        if (verbose)
+            printf("[*] Reusing cached '%s', contents are unchanged\n", path);
+        return entry->unit;
+    }
+    unit_t* unit = unit_parse(path, source, len);
+    if (!unit)
+    {
+        free(full);
+        return NULL;
+    }
+    if (!entry)
+    {
+        entry = calloc(1, sizeof(cache_entry_t));
+        if (!entry)
+        {
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for module cache");
+            free(full);
+            unit_free(unit);
+            return NULL;
+        }
+        entry->next    = cache->entries;
+        cache->entries = entry;
+    }
+    else
+    {
+        free(entry->path);
+        unit_free(entry->unit);
+    }
+    entry->path  = full;
+    entry->mtime = st.st_mtim;
+    entry->size  = st.st_size;
+    entry->hash  = hash;
+    entry->unit  = unit;
+    cache->misses++;
+    return unit;
+}
+
+static bool module_load(module_t* m, const driver_options_t* driver)
+{
+    trace_set_module(m->path);
+    if (driver->cache)
+    {
+        m->unit = cache_lookup(driver->cache, m->path, driver->verbose);
+    }
+    else
+    {
+        size_t len    = 0;
+        char*  source = read_file(m->path, &len);
+        m->unit       = source ? unit_parse(m->path, source, len) : NULL;
+        m->owns_unit  = true;
+    }
+    m->ast = m->unit ? m->unit->ast : NULL;
+    return m->ast != NULL;
+}
+
+static void module_free(module_t* m)
+{
+    if (m->owns_unit)
+        unit_free(m->unit);
+    for (size_t i = 0; i < m->recorded.import_count; i++)
+        free(m->recorded.import_names[i]);
+    free(m->recorded.import_names);
+    free(m->recorded.import_hashes);
+    free(m->name);
+    free(m->object);
+    free(m->deps);
+}
+
+module_cache_t* module_cache_create(void)
+{
+    return calloc(1, sizeof(module_cache_t));
+}
+
+void module_cache_free(module_cache_t* cache)
+{
+    while (cache && cache->entries)
+    {
+        cache_entry_t* next = cache->entries->next;
+        free(cache->entries->path);
+        unit_free(cache->entries->unit);
+        free(cache->entries);
+        cache->entries = next;
+    }
+    free(cache);
+}
+
+/* ================== */
+/* Dependency graph   */
+/* ================== */
+
+// Imports naming another module of the build make it a dependency, the other imports are runtime
+// or C library modules.
+static bool resolve_imports(module_t* modules, size_t count, size_t index)
+{
+    module_t* m = &modules[index];
+    for (size_t i = 0; i < m->ast->data.program.func_def_count; i++)
+    {
+        ast_node_t* stmt = &m->ast->data.program.func_defs[i];
+        if (stmt->type != NODE_IMPORT)
+            continue;
+        for (size_t j = 0; j < count; j++)
+        {
+            if (strcmp(modules[j].name, stmt->data.import.module) != 0)
+                continue;
+            if (j == index)
+            {
+                fprintf(stderr, "Error: Module '%s' imports itself\n", m->name);
+                return false;
+            }
+            bool seen = false;
+            for (size_t k = 0; k < m->dep_count; k++)
+                seen = seen || m->deps[k] == j;
+            if (seen)
+                break;
+            size_t* deps = realloc(m->deps, (m->dep_count + 1) * sizeof(size_t));
+            if (!deps)
+            {
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for module dependencies");
+                return false;
+            }
+            m->deps                 = deps;
+            m->deps[m->dep_count++] = j;
+            break;
+        }
+    }
+    return true;
+}
+
+// Orders the modules so every module comes after the modules it imports. Among the modules that
+// are ready at the same time the command line order is kept, so the order only depends on the
+// inputs. Returns false if the imports form a cycle.
+static bool topo_sort(const module_t* modules, size_t count, size_t* order)
+{
+    bool* placed = calloc(count, sizeof(bool));
+    if (!placed)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for module order");
+        return false;
+    }
+    size_t n = 0;
+    while (n < count)
+    {
+        size_t next = count;
+        for (size_t i = 0; i < count && next == count; i++)
+        {
+            bool ready = !placed[i];
+            for (size_t k = 0; ready && k < modules[i].dep_count; k++)
+                ready = placed[modules[i].deps[k]];
+            if (ready)
+                next = i;
+        }
+        if (next == count)
+            break;
+        placed[next] = true;
+        order[n++]   = next;
+    }
+    free(placed);
+    return n == count;
+}
+
+/* ================== */
+/* Manifests          */
+/* ================== */
+
+// Hashes what a module exposes to its importers: everything at the top level (signatures,
+// globals, imports) plus the bodies of generic functions, which are instantiated by the importer.
+// Other function bodies, comments and layout don't change the hash, so editing them doesn't
+// rebuild the importers.
+static uint64_t interface_hash(const token_t* tokens, size_t count)
+{
+    uint64_t hash    = 0xcbf29ce484222325ull;
+    int      depth   = 0;
+    bool     generic = false; // NOTE: the current top-level declaration has type parameters
+    for (size_t i = 0; i < count && tokens[i].type != TOKEN_EOF; i++)
+    {
+        const token_t* tok = &tokens[i];
+        if (depth == 0 && tok->type == TOKEN_LT)
+            generic = true;
+        if (depth == 0 || generic)
+        {
+            hash = hash_bytes(hash, tok->lexeme, tok->len);
+            hash = hash_bytes(hash, " ", 1);
+        }
+        if (tok->type == TOKEN_LBRACE)
+            depth++;
+        else if (tok->type == TOKEN_RBRACE && depth > 0 && --depth == 0)
+            generic = false;
+        else if (tok->type == TOKEN_SEMI && depth == 0)
+            generic = false;
+    }
+    return hash;
+}
+
+// Everything besides the sources that changes the generated object.
+static uint64_t options_hash(const codegen_options_t* opts)
+{
+    char     buf[128];
+    uint64_t hash = 0xcbf29ce484222325ull;
+    int      len  = snprintf(buf, sizeof(buf), "O%d simd%d fs%d ds%d", opts->opt_level,
+                             (int) opts->simd, opts->function_sections, opts->data_sections);
+    hash          = hash_bytes(hash, buf, len);
+    if (opts->profile)
+    {
+        size_t size    = 0;
+        char*  profile = read_file(opts->profile, &size);
+        hash           = profile ? hash_bytes(hash, profile, size) : hash;
+        free(profile);
+    }
+    return hash;
+}
+
+static char* manifest_path(const module_t* m)
+{
+    char* path = malloc(strlen(m->object) + 3);
+    if (path)
+        sprintf(path, "%s.d", m->object);
+    return path;
+}
+
+static void manifest_read(module_t* m)
+{
+    manifest_t* r    = &m->recorded;
+    char*       path = manifest_path(m);
+    FILE*       f    = path ? fopen(path, "r") : NULL;
+    free(path);
+    if (!f)
+        return;
+    char line[512];
+    int  fields = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        char     name[256];
+        uint64_t hash = 0;
+        if (sscanf(line, "# cmicro source %" SCNx64, &r->source) == 1)
+            fields |= 1;
+        else if (sscanf(line, "# cmicro options %" SCNx64, &r->options) == 1)
+            fields |= 2;
+        else if (sscanf(line, "# cmicro interface %" SCNx64, &r->interface) == 1)
+            fields |= 4;
+        else if (sscanf(line, "# cmicro import %255s %" SCNx64, name, &hash) == 2)
+        {
+            char**    names  = realloc(r->import_names, (r->import_count + 1) * sizeof(char*));
+            uint64_t* hashes = names ? realloc(r->import_hashes,
+                                               (r->import_count + 1) * sizeof(uint64_t))
+                                     : NULL;
+            if (names)
+                r->import_names = names;
+            if (!names || !hashes)
+                break;
+            r->import_hashes                  = hashes;
+            r->import_names[r->import_count]  = strdup(name);
+            r->import_hashes[r->import_count] = hash;
+            r->import_count++;
+        }
+    }
+    fclose(f);
+    r->valid = fields == 7;
+}
+
+// Writes a make-compatible dependency rule for the object, followed by the hashes the next
+// build compares to decide whether the module has to be compiled again.
+static void manifest_write(const module_t* modules, const module_t* m, uint64_t options)
+{
+    char* path = manifest_path(m);
+    FILE* f    = path ? fopen(path, "w") : NULL;
+    if (!f)
+    {
+        fprintf(stderr, "Error: Failed to write dependency manifest for '%s'\n", m->path);
+        free(path);
+        return;
+    }
+    fprintf(f, "%s: %s", m->object, m->path);
+    for (size_t i = 0; i < m->dep_count; i++)
+        fprintf(f, " %s", modules[m->deps[i]].path);
+    fprintf(f, "\n# cmicro source %016" PRIx64 "\n", m->source_hash);
+    fprintf(f, "# cmicro options %016" PRIx64 "\n", options);
+    fprintf(f, "# cmicro interface %016" PRIx64 "\n", m->interface_hash);
+    for (size_t i = 0; i < m->dep_count; i++)
+    {
+        const module_t* dep = &modules[m->deps[i]];
+        fprintf(f, "# cmicro import %s %016" PRIx64 "\n", dep->name, dep->interface_hash);
+    }
+    fclose(f);
+    free(path);
+}
+
+// A module whose source, options and object are unchanged takes its imports and interface from
+// the manifest, so it isn't even parsed unless it has to be compiled again.
+static bool load_recorded(module_t* modules, size_t count, module_t* m)
+{
+    for (size_t i = 0; i < m->recorded.import_count; i++)
+    {
+        size_t j = 0;
+        while (j < count && strcmp(modules[j].name, m->recorded.import_names[i]) != 0)
+            j++;
+        if (j == count)
+            return false;
+        size_t* deps = realloc(m->deps, (m->dep_count + 1) * sizeof(size_t));
+        if (!deps)
+            return false;
+        m->deps                 = deps;
+        m->deps[m->dep_count++] = j;
+    }
+    m->interface_hash = m->recorded.interface;
+    return true;
+}
+
+// The module is up to date if every import still has the interface it was compiled against,
+// however much the implementations behind them changed.
+static bool up_to_date(const module_t* modules, const module_t* m)
+{
+    if (!m->fresh)
+        return false;
+    for (size_t i = 0; i < m->dep_count; i++)
+    {
+        if (modules[m->deps[i]].interface_hash != m->recorded.import_hashes[i])
+            return false;
+    }
+    return true;
+}
+
+/* ================== */
+/* Job scheduling     */
+/* ================== */
+
+// Forks a worker for `module` with its stdout and stderr captured in `out` and `err`. Returns the
+// pid, 0 in the worker and -1 on failure. The worker starts with empty timings, allocation counts
+// and trace, the driver holds those of this process so far.
+static pid_t fork_job(FILE** out, FILE** err, FILE** stats, const char* module)
+{
+    *out   = tmpfile();
+    *err   = tmpfile();
+    *stats = tmpfile();
+    if (!*out || !*err || !*stats)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to create job output files");
+        return -1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to start compile job");
+        return -1;
+    }
+    if (pid > 0)
+        return pid;
+
+    dup2(fileno(*out), STDOUT_FILENO);
+    dup2(fileno(*err), STDERR_FILENO);
+    timing_reset();
+    mem_stats_reset();
+    trace_reset();
+    trace_set_module(module);
+    remark_set_file(module);
+    return 0;
+}
+
+_Noreturn static void exit_job(FILE* stats, int result)
+{
+    timing_save(stats);
+    mem_stats_save(stats);
+    trace_save(stats);
+    error_save(stats);
+    fflush(stats);
+    fflush(stdout);
+    fflush(stderr);
+    _exit(result == 0 ? 0 : 1);
+}
+
+// Merges the timings, allocation counts and trace of a finished worker and loads its
+// diagnostics, which are replayed once the job is reported.
+static void merge_job(FILE** stats, error_sink_t** diags)
+{
+    rewind(*stats);
+    if (timing_merge(*stats) && mem_stats_merge(*stats) && trace_merge(*stats))
+        *diags = error_load(*stats);
+    fclose(*stats);
+    *stats = NULL;
+}
+
+// Every module is compiled in a forked worker, so the compiler's global state never has to be
+// shared between jobs. A worker's output is captured and replayed in topological order, which
+// keeps the output of a build the same for any number of jobs.
+static bool start_job(module_t* modules, module_t* m, bool link, const codegen_options_t* opts,
+                      const driver_options_t* driver)
+{
+    m->pid = fork_job(&m->out, &m->err, &m->timing, m->path);
+    if (m->pid < 0)
+        return false;
+    if (m->pid > 0)
+    {
+        m->state = MODULE_RUNNING;
+        return true;
+    }
+
+    size_t       n       = m->dep_count ? m->dep_count : 1;
+    ast_node_t** imports = calloc(n, sizeof(ast_node_t*));
+    const char** paths   = calloc(n, sizeof(char*));
+    const char** sources = calloc(n, sizeof(char*));
+    if (!imports || !paths || !sources)
+        _exit(1);
+    for (size_t i = 0; i < m->dep_count; i++)
+    {
+        imports[i] = modules[m->deps[i]].ast;
+        paths[i]   = modules[m->deps[i]].path;
+        sources[i] = modules[m->deps[i]].unit->source;
+    }
+    codegen_options_t module_opts = *opts;
+    module_opts.compile_only      = link;
+    module_opts.imports           = imports;
+    module_opts.import_paths      = paths;
+    module_opts.import_sources    = sources;
+    module_opts.import_count      = m->dep_count;
+    if (driver->verbose)
+        printf("[*] Compiling '%s' to '%s'...\n", m->path, m->object);
+    error_begin(m->path, m->unit->source, m->unit->len);
+    exit_job(m->timing, codegen_generate(m->ast, m->object, &module_opts));
+}
+
+static void replay(FILE* captured, FILE* to)
+{
+    char   buf[4096];
+    size_t n;
+    rewind(captured);
+    while ((n = fread(buf, 1, sizeof(buf), captured)) > 0)
+        fwrite(buf, 1, n, to);
+    fclose(captured);
+}
+
+int driver_build(const char* const* sources, size_t count, const char* output_path,
+                 const codegen_options_t* opts, const driver_options_t* driver)
+{
+    module_t* modules = calloc(count, sizeof(module_t));
+    size_t*   order   = calloc(count, sizeof(size_t));
+    if (!modules || !order)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for modules");
+        free(modules);
+        free(order);
+        return 1;
+    }
+
+    // Modules are loaded in command line order, so parse errors are reported deterministically.
+    // A single module is compiled straight to the executable.
+    bool     ok      = true;
+    bool     link    = count > 1;
+    uint64_t options = driver->manifest ? options_hash(opts) : 0;
+    for (size_t i = 0; i < count && ok; i++)
+    {
+        modules[i].path   = sources[i];
+        modules[i].name   = module_name(sources[i]);
+        modules[i].object = link ? object_path(sources[i]) : strdup(output_path);
+        if (!modules[i].name || !modules[i].object)
+        {
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for module");
+            ok = false;
+            break;
+        }
+        for (size_t j = 0; j < i && ok; j++)
+        {
+            if (strcmp(modules[j].name, modules[i].name) == 0)
+            {
+                fprintf(stderr, "Error: Modules '%s' and '%s' have the same name\n",
+                        modules[j].path, modules[i].path);
+                ok = false;
+            }
+        }
+        if (ok && driver->manifest)
+        {
+            module_t* m      = &modules[i];
+            size_t    len    = 0;
+            char*     source = read_file(m->path, &len);
+            ok               = source != NULL;
+            m->source_hash   = hash_bytes(0xcbf29ce484222325ull, source ? source : "", len);
+            free(source);
+            manifest_read(m);
+            m->fresh = m->recorded.valid && m->recorded.source == m->source_hash &&
+                       m->recorded.options == options && access(m->object, F_OK) == 0;
+        }
+        ok = ok && (modules[i].fresh || module_load(&modules[i], driver));
+    }
+    for (size_t i = 0; i < count && ok; i++)
+    {
+        module_t* m = &modules[i];
+        if (m->fresh && !load_recorded(modules, count, m))
+        {
+            m->fresh     = false;
+            m->dep_count = 0;
+            ok           = module_load(m, driver);
+        }
+        if (ok && !m->fresh)
+        {
+            ok                = resolve_imports(modules, count, i);
+            m->interface_hash = interface_hash(m->unit->tokens, m->unit->token_count);
+        }
+    }
+    if (ok && !topo_sort(modules, count, order))
+    {
+        fprintf(stderr, "Error: Import cycle between modules\n");
+        ok = false;
+    }
+
+    size_t finished = 0;
+    size_t reported = 0;
+    size_t rebuilt  = 0;
+    int    running  = 0;
+    int    jobs     = driver->jobs > 0 ? driver->jobs : 1;
+    while (ok && finished < count)
+    {
+        for (size_t i = 0; i < count && running < jobs; i++)
+        {
+            module_t* m = &modules[order[i]];
+            if (m->state != MODULE_PENDING)
+                continue;
+            bool ready  = true;
+            bool failed = false;
+            for (size_t k = 0; k < m->dep_count; k++)
+            {
+                module_state_t dep = modules[m->deps[k]].state;
+                ready              = ready && dep == MODULE_DONE;
+                failed             = failed || dep == MODULE_FAILED || dep == MODULE_SKIPPED;
+            }
+            if (failed)
+            {
+                m->state = MODULE_SKIPPED;
+                finished++;
+            }
+            else if (ready && up_to_date(modules, m))
+            {
+                m->state = MODULE_DONE;
+                finished++;
+            }
+            else if (ready)
+            {
+                // Modules taken from their manifest are parsed once they have to be compiled.
+                bool loaded = m->ast || module_load(m, driver);
+                for (size_t k = 0; loaded && k < m->dep_count; k++)
+                    loaded = modules[m->deps[k]].ast || module_load(&modules[m->deps[k]], driver);
+                if (!loaded || !start_job(modules, m, link, opts, driver))
+                {
+                    m->state = MODULE_FAILED;
+                    finished++;
+                    continue;
+                }
+                running++;
+                rebuilt++;
+            }
+        }
+        if (running > 0)
+        {
+            int   status = 0;
+            pid_t pid    = waitpid(-1, &status, 0);
+            for (size_t i = 0; i < count; i++)
+            {
+                if (modules[i].state != MODULE_RUNNING || modules[i].pid != pid)
+                    continue;
+                bool success     = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                modules[i].state = success ? MODULE_DONE : MODULE_FAILED;
+                merge_job(&modules[i].timing, &modules[i].diags);
+                if (success && driver->manifest)
+                    manifest_write(modules, &modules[i], options);
+                running--;
+                finished++;
+            }
+        }
+
+        // Report finished modules in topological order, holding back those that finished early.
+        while (reported < count && modules[order[reported]].state >= MODULE_DONE)
+        {
+            module_t* m = &modules[order[reported++]];
+            if (m->state == MODULE_DONE && !m->out && driver->verbose)
+                printf("[*] '%s' is up to date\n", m->path);
+            if (m->out)
+                replay(m->out, stdout);
+            if (m->err)
+                replay(m->err, stderr);
+            error_replay(m->diags);
+            m->diags = NULL;
+            if (m->state == MODULE_FAILED)
+                fprintf(stderr, "Error: Failed to compile '%s'\n", m->path);
+            else if (m->state == MODULE_SKIPPED)
+                fprintf(stderr, "Error: Skipped '%s', an imported module failed\n", m->path);
+        }
+    }
+
+    for (size_t i = 0; i < count && ok; i++)
+        ok = modules[i].state == MODULE_DONE;
+    if (ok && link && driver->manifest && rebuilt == 0 && access(output_path, F_OK) == 0)
+    {
+        if (driver->verbose)
+            printf("[*] '%s' is up to date\n", output_path);
+    }
+    else if (ok && link)
+    {
+        // Objects are linked in command line order, independent of when they were finished.
+        const char** objects = calloc(count, sizeof(char*));
+        if (!objects)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for object list");
+        for (size_t i = 0; objects && i < count; i++)
+            objects[i] = modules[i].object;
+        if (driver->verbose)
+            printf("[*] Linking %zu objects to '%s'...\n", count, output_path);
+        trace_set_module(output_path);
+        ok = objects && codegen_link(objects, count, output_path, opts) == 0;
+        free(objects);
+    }
+
+    for (size_t i = 0; i < count; i++)
+        module_free(&modules[i]);
+    free(modules);
+    free(order);
+    return ok ? 0 : 1;
+}
+
+/* ================== */
+/* Batch              */
+/* ================== */
+
+typedef struct batch_entry
+{
+    char*          input;
+    char*          output;
+    module_state_t state;
+    pid_t          pid;
+    FILE*          out;   // captured stdout of the compile job
+    FILE*          err;   // captured stderr of the compile job
+    FILE*          stats; // phase timings, allocation counts and trace of the compile job
+    error_sink_t*  diags; // NOTE: diagnostics of the finished compile job until reported
+} batch_entry_t;
+
+static char* trim(char* s)
+{
+    while (isspace((unsigned char) *s))
+        s++;
+    char* end = s + strlen(s);
+    while (end > s && isspace((unsigned char) end[-1]))
+        end--;
+    *end = '\0';
+    return s;
+}
+
+static void batch_free(batch_entry_t* entries, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(entries[i].input);
+        free(entries[i].output);
+        if (entries[i].out)
+            fclose(entries[i].out);
+        if (entries[i].err)
+            fclose(entries[i].err);
+        if (entries[i].stats)
+            fclose(entries[i].stats);
+    }
+    free(entries);
+}
+
+// Reads `input -> output` lines, skipping blank lines and `#` comments.
+static batch_entry_t* batch_read(const char* path, size_t* count)
+{
+    FILE* f = fopen(path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Failed to open batch file '%s'\n", path);
+        return NULL;
+    }
+    batch_entry_t* entries  = calloc(1, sizeof(batch_entry_t));
+    size_t         capacity = 1;
+    char*          line     = NULL;
+    size_t         line_cap = 0;
+    size_t         line_no  = 0;
+    bool           ok       = entries != NULL;
+    *count                  = 0;
+    while (ok && getline(&line, &line_cap, f) != -1)
+    {
+        line_no++;
+        char* text = trim(line);
+        if (!*text || *text == '#')
+            continue;
+        char* arrow = strstr(text, "->");
+        if (arrow)
+            *arrow = '\0';
+        char* input  = trim(text);
+        char* output = arrow ? trim(arrow + 2) : "";
+        if (!*input || !*output)
+        {
+            fprintf(stderr, "Error: %s:%zu: Expected 'input -> output'\n", path, line_no);
+            ok = false;
+            break;
+        }
+        if (*count >= capacity)
+        {
+            capacity *= 2;
+            batch_entry_t* new_entries = realloc(entries, capacity * sizeof(batch_entry_t));
+            if (!new_entries)
+            {
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for batch entries");
+                ok = false;
+                break;
+            }
+            entries = new_entries;
+        }
+        entries[*count] = (batch_entry_t){.input = strdup(input), .output = strdup(output)};
+        ok              = entries[*count].input && entries[*count].output;
+        (*count)++;
+        if (!ok)
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for batch entry");
+    }
+    free(line);
+    fclose(f);
+    if (!entries)
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for batch entries");
+    if (!ok && entries)
+    {
+        batch_free(entries, *count);
+        return NULL;
+    }
+    return entries;
+}
+
+static void batch_start(batch_entry_t* e, batch_compile_t compile, void* data)
+{
+    e->pid = fork_job(&e->out, &e->err, &e->stats, e->input);
+    if (e->pid == 0)
+        exit_job(e->stats, compile(e->input, e->output, data));
+    e->state = e->pid > 0 ? MODULE_RUNNING : MODULE_FAILED;
+}
+
+// Compiles every program of the batch file in this process, sparing the startup of one compiler
+// process per program. Each program is compiled on its own, the compiler's state is reset in
+// between. With several jobs the programs are compiled by forked workers, whose output is
+// replayed in the order of the batch file.
+int driver_batch(const char* list_path, batch_compile_t compile, void* data,
+                 const driver_options_t* driver)
+{
+    size_t         count   = 0;
+    batch_entry_t* entries = batch_read(list_path, &count);
+    if (!entries)
+        return 1;
+
+    size_t failed = 0;
+    int    jobs   = driver->jobs > 0 ? driver->jobs : 1;
+    if (jobs == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            trace_set_module(entries[i].input);
+            remark_set_file(entries[i].input);
+            if (compile(entries[i].input, entries[i].output, data) != 0)
+            {
+                fprintf(stderr, "Error: Failed to compile '%s'\n", entries[i].input);
+                failed++;
+            }
+        }
+    }
+    size_t started  = 0;
+    size_t reported = 0;
+    int    running  = 0;
+    while (jobs > 1 && reported < count)
+    {
+        for (; started < count && running < jobs; started++)
+        {
+            batch_start(&entries[started], compile, data);
+            running += entries[started].state == MODULE_RUNNING;
+        }
+        if (running > 0)
+        {
+            int   status = 0;
+            pid_t pid    = waitpid(-1, &status, 0);
+            for (size_t i = 0; i < started; i++)
+            {
+                if (entries[i].state != MODULE_RUNNING || entries[i].pid != pid)
+                    continue;
+                bool success     = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                entries[i].state = success ? MODULE_DONE : MODULE_FAILED;
+                merge_job(&entries[i].stats, &entries[i].diags);
+                running--;
+            }
+        }
+        while (reported < count && entries[reported].state >= MODULE_DONE)
+        {
+            batch_entry_t* e = &entries[reported++];
+            if (e->out)
+                replay(e->out, stdout);
+            if (e->err)
+                replay(e->err, stderr);
+            error_replay(e->diags);
+            e->out   = NULL;
+            e->err   = NULL;
+            e->diags = NULL;
+            if (e->state == MODULE_FAILED)
+            {
+                fprintf(stderr, "Error: Failed to compile '%s'\n", e->input);
+                failed++;
+            }
+        }
+    }
+    if (driver->verbose)
+        printf("[*] Compiled %zu of %zu programs\n", count - failed, count);
+    batch_free(entries, count);
+    return failed ? 1 : 0;
+}
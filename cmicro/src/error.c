@@ -5,50 +5,136 @@
  * Licensed under the Apache License, Version 2.0
  */
 
+#define _GNU_SOURCE
 #include <error.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#define MEM_CATEGORY MEM_OTHER
+#include <mem.h>
 
 #define COLOR_RED "\x1b[31m"
 #define COLOR_YELLOW "\x1b[33m"
 #define COLOR_BLUE "\x1b[34m"
 #define COLOR_RESET "\x1b[0m"
 
-static const char* get_source_line(const char* src, uint32_t line)
+// Between error_begin() and error_flush() diagnostics are collected in a sink, which belongs to
+// one compile task (a module or a single-file compilation) and names its module. The flush sorts
+// them by position and writes them out in one piece. A forked worker saves its sink instead, and
+// the driver replays the sinks of all jobs in topological order, so a parallel build reports
+// the same diagnostics in the same order as a serial one. Outside of a task (driver, server)
+// diagnostics are written as they are reported.
+//
+// Source lines are found through an index of line starts, built on the first lookup, and copied
+// into the diagnostic, so the source can be freed before the sink is written.
+//
+// Code of another module compiled as part of the task (generic functions of an import) is
+// bracketed by error_origin(), its diagnostics name that module and quote its source.
+typedef struct diagnostic
 {
-    if (!src)
-        return NULL;
-    const char* p       = src;
-    uint32_t    current = 1;
-    const char* start   = p;
+    error_level_t level;
+    uint32_t      line;
+    uint32_t      column;
+    uint32_t      length;
+    uint32_t      seq; // order of reporting, ties and diagnostics without a position keep it
+    char*         message;
+    char*         text;   // NOTE: NULL without a source line
+    char*         module; // NOTE: NULL for the module of the sink
+} diagnostic_t;
+
+struct error_sink
+{
+    char*         module; // NOTE: NULL for diagnostics outside of a module
+    diagnostic_t* items;
+    size_t        count;
+    size_t        capacity;
+};
+
+typedef struct diagnostics
+{
+    bool         active;
+    const char*  source;
+    size_t       len;
+    size_t*      line_starts; // NOTE: NULL until the first lookup
+    size_t       line_count;
+    const char*  origin;        // NOTE: NULL for the task's own module, see error_origin()
+    const char*  origin_source; // NOTE: only set with origin
+    error_sink_t sink;
+} diagnostics_t;
+
+static diagnostics_t diags       = {0};
+static unsigned      error_limit = 0;
+static unsigned      errors      = 0; // errors written so far, for the limit
+static unsigned      reported    = 0; // errors reported so far, written or not
+
+/* ================== */
+/* Source lines       */
+/* ================== */
 
-    while (*p && current < line)
+static bool build_index(void)
+{
+    size_t count = 1;
+    for (size_t i = 0; i < diags.len; i++)
+        count += diags.source[i] == '\n';
+    diags.line_starts = malloc(count * sizeof(size_t));
+    if (!diags.line_starts)
+        return false;
+    diags.line_starts[0] = 0;
+    diags.line_count     = 1;
+    for (size_t i = 0; i < diags.len; i++)
     {
-        if (*p == '\n')
-            current++, start = p + 1;
-        p++;
+        if (diags.source[i] == '\n')
+            diags.line_starts[diags.line_count++] = i + 1;
     }
+    return true;
+}
 
-    const char* end = start;
-    while (*end && *end != '\n')
-        end++;
-
-    static char buf[512];
-    size_t      len = end - start;
-    if (len >= sizeof(buf))
-        len = sizeof(buf) - 1;
-    strncpy(buf, start, len);
-    buf[len] = '\0';
-    return buf;
+// Copies line `line` of `src`. The source of the compilation is looked up in its index, any
+// other source (and the compilation's without memory for the index) is scanned.
+static char* copy_source_line(const char* src, uint32_t line)
+{
+    if (!src && diags.active)
+        src = diags.source;
+    if (!src || line == 0)
+        return NULL;
+    const char* start = NULL;
+    const char* end   = NULL;
+    if (src == diags.source && (diags.line_starts || build_index()))
+    {
+        if (line > diags.line_count)
+            return NULL;
+        start = src + diags.line_starts[line - 1];
+        end   = line < diags.line_count ? src + diags.line_starts[line] - 1 : src + diags.len;
+    }
+    else
+    {
+        uint32_t current = 1;
+        start            = src;
+        for (const char* p = src; *p && current < line; p++)
+        {
+            if (*p == '\n')
+                current++, start = p + 1;
+        }
+        if (current < line)
+            return NULL;
+        end = start + strcspn(start, "\n");
+    }
+    if (end > start && end[-1] == '\r')
+        end--;
+    return strndup(start, end - start);
 }
 
-void report_error(const error_t* err)
+/* ================== */
+/* Rendering          */
+/* ================== */
+
+static void render(FILE* out, const diagnostic_t* d, const char* module)
 {
     const char* color = COLOR_RED;
     const char* label = "Error";
 
-    switch (err->level)
+    switch (d->level)
     {
     case ERROR_FATAL:
         color = COLOR_RED;
@@ -68,21 +154,290 @@ void report_error(const error_t* err)
         break;
     }
 
-    const char* line_text = get_source_line(err->source, err->line);
+    fprintf(out, "%s%s%s: %s", color, label, COLOR_RESET, d->message);
+    if (module)
+        fprintf(out, " in '%s'", module);
+
+    if (d->text && d->text[0] != '\0')
+    {
+        fprintf(out, " at line %u, column %u\n", d->line, d->column);
+        fprintf(out, "%s\n", d->text);
+        for (uint32_t i = 1; i < d->column; i++)
+            fputc(' ', out);
+        fprintf(out, "%s^", color);
+        for (uint32_t i = 1; i < d->length; i++)
+            fputc('~', out);
+        fprintf(out, "\n" COLOR_RESET);
+    }
+    else
+    {
+        fputc('\n', out);
+    }
+}
+
+// Renders the diagnostic unless the error limit was reached, which is reported once.
+static void render_limited(FILE* out, const diagnostic_t* d, const char* module)
+{
+    if (error_limit && errors >= error_limit)
+    {
+        if (d->level == ERROR_FATAL && errors++ == error_limit)
+        {
+            char message[96];
+            snprintf(message, sizeof(message),
+                     "Too many errors emitted, stopping now (-ferror-limit=%u)", error_limit);
+            render(out, &(diagnostic_t){.level = ERROR_FATAL, .message = message}, NULL);
+        }
+        return;
+    }
+    errors += d->level == ERROR_FATAL;
+    render(out, d, module);
+}
 
-    fprintf(stderr, "%s%s%s: %s ", color, label, COLOR_RESET, err->message);
+// Writes the rendered text with one call, so diagnostics of concurrent processes don't mix.
+static void write_rendered(char* buf, size_t len)
+{
+    fwrite(buf, 1, len, stderr);
+    fflush(stderr);
+    free(buf);
+}
 
-    if (line_text && line_text[0] != '\0')
+static bool sink_add(error_sink_t* sink, diagnostic_t d)
+{
+    if (sink->count == sink->capacity)
     {
-        fprintf(stderr, "at line %u, column %u\n", err->line, err->column);
-        fprintf(stderr, "%s\n", line_text);
-        for (uint32_t i = 1; i < err->column; i++)
-            fputc(' ', stderr);
-        fprintf(stderr, "%s^\n", color);
-        fprintf(stderr, COLOR_RESET);
+        size_t        capacity = sink->capacity ? sink->capacity * 2 : 16;
+        diagnostic_t* items    = realloc(sink->items, capacity * sizeof(diagnostic_t));
+        if (!items)
+            return false;
+        sink->items    = items;
+        sink->capacity = capacity;
+    }
+    sink->items[sink->count++] = d;
+    return true;
+}
+
+static void sink_clear(error_sink_t* sink)
+{
+    for (size_t i = 0; i < sink->count; i++)
+    {
+        free(sink->items[i].message);
+        free(sink->items[i].text);
+        free(sink->items[i].module);
+    }
+    free(sink->items);
+    free(sink->module);
+    *sink = (error_sink_t){0};
+}
+
+void report_error(const error_t* err)
+{
+    diagnostic_t d = {err->level, err->line, err->column, err->length, 0, NULL, NULL, NULL};
+    reported += err->level == ERROR_FATAL;
+    d.text         = copy_source_line(err->source ? err->source : diags.origin_source, err->line);
+    if (!diags.active)
+    {
+        char*  buf = NULL;
+        size_t len = 0;
+        FILE*  out = open_memstream(&buf, &len);
+        d.message  = (char*) err->message;
+        if (!out)
+        {
+            render_limited(stderr, &d, diags.origin);
+            free(d.text);
+            return;
+        }
+        render_limited(out, &d, diags.origin);
+        fclose(out);
+        write_rendered(buf, len);
+        free(d.text);
+        return;
+    }
+    d.seq     = (uint32_t) diags.sink.count;
+    d.message = strdup(err->message ? err->message : "");
+    d.module  = diags.origin ? strdup(diags.origin) : NULL;
+    if (!d.message || !sink_add(&diags.sink, d))
+    {
+        free(d.message);
+        free(d.text);
+        free(d.module);
+    }
+}
+
+/* ================== */
+/* Sinks              */
+/* ================== */
+
+void error_begin(const char* module, const char* source, size_t len)
+{
+    if (diags.active)
+        error_flush();
+    diags.active      = true;
+    diags.source      = source;
+    diags.len         = len;
+    diags.sink.module = module ? strdup(module) : NULL;
+}
+
+// Attributes the diagnostics reported until the next call to `module`, whose source is `source`.
+// NULL returns to the module of the task.
+void error_origin(const char* module, const char* source)
+{
+    diags.origin        = module;
+    diags.origin_source = module ? source : NULL;
+}
+
+// Diagnostics with a position come in source order, those in other modules after the module's
+// own, grouped by module, and the others (e.g. a summary of a failed phase) last, in the order
+// they were reported.
+static int compare_diagnostics(const void* a, const void* b)
+{
+    const diagnostic_t* x = a;
+    const diagnostic_t* y = b;
+    if ((x->line == 0) != (y->line == 0))
+        return x->line == 0 ? 1 : -1;
+    if ((x->module == NULL) != (y->module == NULL))
+        return x->module ? 1 : -1;
+    int module = x->module ? strcmp(x->module, y->module) : 0;
+    if (module != 0)
+        return module;
+    if (x->line != y->line)
+        return x->line < y->line ? -1 : 1;
+    if (x->column != y->column)
+        return x->column < y->column ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+// Ends the current task and hands out its sorted sink.
+static error_sink_t* end_task(void)
+{
+    error_sink_t* sink = malloc(sizeof(error_sink_t));
+    if (sink)
+    {
+        *sink = diags.sink;
+        if (sink->count > 1)
+            qsort(sink->items, sink->count, sizeof(diagnostic_t), compare_diagnostics);
     }
     else
     {
-        printf("\n");
+        sink_clear(&diags.sink);
     }
-}
\ No newline at end of file
+    free(diags.line_starts);
+    diags = (diagnostics_t){0};
+    return sink;
+}
+
+void error_flush(void)
+{
+    if (diags.active)
+        error_replay(end_task());
+}
+
+void error_replay(error_sink_t* sink)
+{
+    if (!sink)
+        return;
+    char*  buf = NULL;
+    size_t len = 0;
+    FILE*  out = open_memstream(&buf, &len);
+    for (size_t i = 0; i < sink->count; i++)
+        render_limited(out ? out : stderr, &sink->items[i],
+                       sink->items[i].module ? sink->items[i].module : sink->module);
+    if (out)
+    {
+        fclose(out);
+        write_rendered(buf, len);
+    }
+    sink_clear(sink);
+    free(sink);
+}
+
+static bool save_string(FILE* out, const char* s)
+{
+    uint32_t len = s ? (uint32_t) strlen(s) : UINT32_MAX;
+    return fwrite(&len, sizeof(len), 1, out) == 1 && (!s || fwrite(s, 1, len, out) == len);
+}
+
+static bool load_string(FILE* in, char** s)
+{
+    uint32_t len = 0;
+    *s           = NULL;
+    if (fread(&len, sizeof(len), 1, in) != 1)
+        return false;
+    if (len == UINT32_MAX)
+        return true;
+    *s = malloc((size_t) len + 1);
+    if (!*s || fread(*s, 1, len, in) != len)
+        return false;
+    (*s)[len] = '\0';
+    return true;
+}
+
+// Forked workers save their sink for the driver, which replays it in the order of the build. A
+// worker without a task saves an empty sink.
+bool error_save(FILE* out)
+{
+    error_sink_t* sink  = diags.active ? end_task() : NULL;
+    uint64_t      count = sink ? sink->count : 0;
+    bool          ok    = fwrite(&count, sizeof(count), 1, out) == 1 &&
+                save_string(out, sink ? sink->module : NULL);
+    for (size_t i = 0; ok && i < count; i++)
+    {
+        const diagnostic_t* d         = &sink->items[i];
+        uint32_t            header[5] = {d->level, d->line, d->column, d->length, d->seq};
+        ok = fwrite(header, sizeof(header), 1, out) == 1 && save_string(out, d->message) &&
+             save_string(out, d->text) && save_string(out, d->module);
+    }
+    if (sink)
+    {
+        sink_clear(sink);
+        free(sink);
+    }
+    return ok;
+}
+
+error_sink_t* error_load(FILE* in)
+{
+    uint64_t      count = 0;
+    error_sink_t* sink  = calloc(1, sizeof(error_sink_t));
+    if (!sink)
+        return NULL;
+    bool ok = fread(&count, sizeof(count), 1, in) == 1 && load_string(in, &sink->module);
+    for (uint64_t i = 0; ok && i < count; i++)
+    {
+        uint32_t     header[5];
+        diagnostic_t d = {0};
+        ok = fread(header, sizeof(header), 1, in) == 1 && load_string(in, &d.message) &&
+             load_string(in, &d.text) && load_string(in, &d.module) && d.message;
+        d.level  = (error_level_t) header[0];
+        d.line   = header[1];
+        d.column = header[2];
+        d.length = header[3];
+        d.seq    = header[4];
+        if (!ok || !sink_add(sink, d))
+        {
+            free(d.message);
+            free(d.text);
+            free(d.module);
+            ok = false;
+        }
+    }
+    if (!ok)
+    {
+        sink_clear(sink);
+        free(sink);
+        return NULL;
+    }
+    return sink;
+}
+
+void error_set_limit(unsigned limit)
+{
+    error_limit = limit;
+    errors      = 0;
+}
+
+// Errors reported by this process, a phase compares the count before and after it to see
+// whether it failed.
+unsigned error_count(void)
+{
+    return reported;
+}
@@ -0,0 +1,327 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#define _GNU_SOURCE
+#include <layout.h>
+#include <error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define MEM_CATEGORY MEM_OTHER
+#include <mem.h>
+
+/* ================== */
+/* Function ordering  */
+/* ================== */
+
+typedef struct pair_weight
+{
+    size_t   a; // NOTE: a < b
+    size_t   b;
+    uint64_t weight;
+} pair_weight_t;
+
+static int compare_pairs(const void* x, const void* y)
+{
+    const pair_weight_t* p = x;
+    const pair_weight_t* q = y;
+    if (p->weight != q->weight)
+        return p->weight < q->weight ? 1 : -1;
+    if (p->a != q->a)
+        return p->a < q->a ? -1 : 1;
+    return p->b < q->b ? -1 : (p->b > q->b);
+}
+
+static void reverse(size_t* chain, size_t len)
+{
+    for (size_t i = 0; i < len / 2; i++)
+    {
+        size_t t           = chain[i];
+        chain[i]           = chain[len - 1 - i];
+        chain[len - 1 - i] = t;
+    }
+}
+
+static size_t position(const size_t* chain, size_t len, size_t func)
+{
+    size_t i = 0;
+    while (i < len && chain[i] != func)
+        i++;
+    return i;
+}
+
+// Pettis-Hansen: functions start as one chain each. Going through the call graph edges from
+// the heaviest, the chains of caller and callee are concatenated, oriented so the two functions
+// end up as close as possible. Chains are then laid out hottest first. Functions no entry point
+// reaches (or never executed, with a profile) are cold and left in source order at the end.
+// `order` receives the function indices in layout order.
+void layout_order(layout_func_t* funcs, size_t count, const layout_edge_t* edges,
+                  size_t edge_count, size_t* order)
+{
+    if (count == 0)
+        return;
+    uint64_t*      heat   = calloc(count, sizeof(uint64_t));
+    size_t*        queue  = calloc(count, sizeof(size_t));
+    size_t*        owner  = calloc(count, sizeof(size_t)); // chain of each function
+    size_t**       chains = calloc(count, sizeof(size_t*));
+    size_t*        lens   = calloc(count, sizeof(size_t));
+    bool*          done   = calloc(count, sizeof(bool));
+    pair_weight_t* pairs  = calloc(edge_count ? edge_count : 1, sizeof(pair_weight_t));
+    if (!heat || !queue || !owner || !chains || !lens || !done || !pairs)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function layout");
+        for (size_t i = 0; i < count; i++)
+            order[i] = i;
+        free(heat);
+        free(queue);
+        free(owner);
+        free(chains);
+        free(lens);
+        free(done);
+        free(pairs);
+        return;
+    }
+
+    // Hot functions are those reachable through executed calls from an entry point.
+    size_t head = 0;
+    size_t tail = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        heat[i]       = funcs[i].count;
+        funcs[i].cold = true;
+        if (funcs[i].is_entry || funcs[i].count > 0)
+        {
+            funcs[i].cold = false;
+            queue[tail++] = i;
+        }
+    }
+    for (size_t e = 0; e < edge_count; e++)
+        heat[edges[e].callee] += edges[e].weight;
+    while (head < tail)
+    {
+        size_t f = queue[head++];
+        for (size_t e = 0; e < edge_count; e++)
+        {
+            if (edges[e].caller == f && edges[e].weight > 0 && funcs[edges[e].callee].cold)
+            {
+                funcs[edges[e].callee].cold = false;
+                queue[tail++]               = edges[e].callee;
+            }
+        }
+    }
+
+    // Calls in both directions count for the same pair.
+    size_t pair_count = 0;
+    for (size_t e = 0; e < edge_count; e++)
+    {
+        size_t a = edges[e].caller < edges[e].callee ? edges[e].caller : edges[e].callee;
+        size_t b = edges[e].caller < edges[e].callee ? edges[e].callee : edges[e].caller;
+        if (a == b || funcs[a].cold || funcs[b].cold || edges[e].weight == 0)
+            continue;
+        size_t p = 0;
+        while (p < pair_count && (pairs[p].a != a || pairs[p].b != b))
+            p++;
+        if (p == pair_count)
+            pairs[pair_count++] = (pair_weight_t){a, b, 0};
+        pairs[p].weight += edges[e].weight;
+    }
+    qsort(pairs, pair_count, sizeof(pair_weight_t), compare_pairs);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        owner[i]  = i;
+        chains[i] = malloc(sizeof(size_t));
+        if (!chains[i])
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function layout");
+        chains[i][0] = i;
+        lens[i]      = 1;
+    }
+    for (size_t p = 0; p < pair_count; p++)
+    {
+        size_t ca = owner[pairs[p].a];
+        size_t cb = owner[pairs[p].b];
+        if (ca == cb)
+            continue;
+        size_t la = lens[ca];
+        size_t lb = lens[cb];
+        size_t pa = position(chains[ca], la, pairs[p].a);
+        size_t pb = position(chains[cb], lb, pairs[p].b);
+        // Distance between a and b for A+B, A+rev(B), rev(A)+B and rev(A)+rev(B).
+        size_t dist[4] = {la - 1 - pa + pb, la - 1 - pa + lb - 1 - pb, pa + pb, pa + lb - 1 - pb};
+        int    best    = 0;
+        for (int k = 1; k < 4; k++)
+        {
+            if (dist[k] < dist[best])
+                best = k;
+        }
+        size_t* merged = realloc(chains[ca], (la + lb) * sizeof(size_t));
+        if (!merged)
+        {
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function layout");
+            continue;
+        }
+        if (best >= 2)
+            reverse(merged, la);
+        if (best == 1 || best == 3)
+            reverse(chains[cb], lb);
+        memcpy(merged + la, chains[cb], lb * sizeof(size_t));
+        for (size_t i = 0; i < lb; i++)
+            owner[chains[cb][i]] = ca;
+        free(chains[cb]);
+        chains[cb] = NULL;
+        chains[ca] = merged;
+        lens[ca]   = la + lb;
+        lens[cb]   = 0;
+    }
+
+    // Hottest chain first; ties keep source order.
+    size_t n = 0;
+    for (;;)
+    {
+        size_t   best      = count;
+        uint64_t best_heat = 0;
+        for (size_t c = 0; c < count; c++)
+        {
+            if (!lens[c] || done[c] || funcs[chains[c][0]].cold)
+                continue;
+            uint64_t h = 0;
+            for (size_t i = 0; i < lens[c]; i++)
+                h += heat[chains[c][i]];
+            if (best == count || h > best_heat)
+            {
+                best      = c;
+                best_heat = h;
+            }
+        }
+        if (best == count)
+            break;
+        done[best] = true;
+        for (size_t i = 0; i < lens[best]; i++)
+            order[n++] = chains[best][i];
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (funcs[i].cold)
+            order[n++] = i;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        free(chains[i]);
+    free(heat);
+    free(queue);
+    free(owner);
+    free(chains);
+    free(lens);
+    free(done);
+    free(pairs);
+}
+
+/* ================== */
+/* Profiles           */
+/* ================== */
+
+// A profile is a text file with one "function count" or "caller callee count" line per entry,
+// e.g. produced from perf or gprof call graph output.
+typedef struct profile_entry
+{
+    char*                 caller; // NOTE: NULL for function counts
+    char*                 name;
+    uint64_t              count;
+    struct profile_entry* next;
+} profile_entry_t;
+
+struct layout_profile
+{
+    profile_entry_t* entries;
+};
+
+layout_profile_t* layout_profile_load(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to open profile");
+        return NULL;
+    }
+    layout_profile_t* p = calloc(1, sizeof(layout_profile_t));
+    if (!p)
+    {
+        fclose(f);
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for profile");
+        return NULL;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f))
+    {
+        char               a[200], b[200];
+        unsigned long long count = 0;
+        int                fields = sscanf(line, "%199s %199s %llu", a, b, &count);
+        if (line[0] == '#' || fields < 2)
+            continue;
+        profile_entry_t* e = calloc(1, sizeof(profile_entry_t));
+        if (!e)
+        {
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for profile");
+            break;
+        }
+        if (fields == 3)
+        {
+            e->caller = strdup(a);
+            e->name   = strdup(b);
+            e->count  = count;
+        }
+        else
+        {
+            e->name  = strdup(a);
+            e->count = strtoull(b, NULL, 10);
+        }
+        e->next    = p->entries;
+        p->entries = e;
+    }
+    fclose(f);
+    return p;
+}
+
+bool layout_profile_count(const layout_profile_t* p, const char* name, uint64_t* out)
+{
+    for (profile_entry_t* e = p ? p->entries : NULL; e; e = e->next)
+    {
+        if (!e->caller && e->name && strcmp(e->name, name) == 0)
+        {
+            *out = e->count;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool layout_profile_edge(const layout_profile_t* p, const char* caller, const char* callee,
+                         uint64_t* out)
+{
+    for (profile_entry_t* e = p ? p->entries : NULL; e; e = e->next)
+    {
+        if (e->caller && e->name && strcmp(e->caller, caller) == 0 && strcmp(e->name, callee) == 0)
+        {
+            *out = e->count;
+            return true;
+        }
+    }
+    return false;
+}
+
+void layout_profile_free(layout_profile_t* p)
+{
+    while (p && p->entries)
+    {
+        profile_entry_t* next = p->entries->next;
+        free(p->entries->caller);
+        free(p->entries->name);
+        free(p->entries);
+        p->entries = next;
+    }
+    free(p);
+}
@@ -11,6 +11,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <error.h>
+#define MEM_CATEGORY MEM_TOKENS
+#include <mem.h>
 
 /* ================== */
 /* Helper tables      */
@@ -27,9 +29,17 @@ static const keyword_t keywords[] = {
 
     {"return", TOKEN_KEYWORD}, {"if", TOKEN_KEYWORD},      {"else", TOKEN_KEYWORD},
     {"while", TOKEN_KEYWORD},  {"for", TOKEN_KEYWORD},     {"void", TOKEN_KEYWORD},
+    {"asm", TOKEN_KEYWORD},    {"extern", TOKEN_KEYWORD},  {"thread_local", TOKEN_KEYWORD},
 
-    {"char", TOKEN_KEYWORD},   {"int", TOKEN_KEYWORD},     {"uint", TOKEN_KEYWORD},
-    {"float", TOKEN_KEYWORD},  {"double", TOKEN_KEYWORD},
+    {"char", TOKEN_KEYWORD},   {"uchar", TOKEN_KEYWORD},   {"short", TOKEN_KEYWORD},
+    {"ushort", TOKEN_KEYWORD}, {"int", TOKEN_KEYWORD},     {"uint", TOKEN_KEYWORD},
+    {"long", TOKEN_KEYWORD},   {"ulong", TOKEN_KEYWORD},   {"float", TOKEN_KEYWORD},
+    {"double", TOKEN_KEYWORD}, {"restrict", TOKEN_KEYWORD},
+
+    {"v8u8", TOKEN_KEYWORD},   {"v16u8", TOKEN_KEYWORD},   {"v32u8", TOKEN_KEYWORD},
+    {"v8i16", TOKEN_KEYWORD},  {"v4i32", TOKEN_KEYWORD},   {"v8i32", TOKEN_KEYWORD},
+    {"v2i64", TOKEN_KEYWORD},  {"v4f32", TOKEN_KEYWORD},   {"v8f32", TOKEN_KEYWORD},
+    {"v2f64", TOKEN_KEYWORD},  {"v4f64", TOKEN_KEYWORD},
 
     {"true", TOKEN_BLIT},      {"false", TOKEN_BLIT},
 };
@@ -47,6 +57,7 @@ static const op_t operators[] = {
     {"<=", TOKEN_LTE},    {">=", TOKEN_GTE},   {"<", TOKEN_LT},         {">", TOKEN_GT},
     {"(", TOKEN_LPAREN},  {")", TOKEN_RPAREN}, {"{", TOKEN_LBRACE},     {"}", TOKEN_RBRACE},
     {";", TOKEN_SEMI},    {",", TOKEN_COMMA},  {"...", TOKEN_ELLIPSIS}, {".", TOKEN_DOT},
+    {"&", TOKEN_AMP},     {":", TOKEN_COLON},
 };
 static const size_t op_count = sizeof(operators) / sizeof(operators[0]);
 
@@ -76,25 +87,6 @@ static inline char lexer_advance(lexer_t* lex)
     return c;
 }
 
-static const char* lexer_current_line(lexer_t* lex)
-{
-    size_t start = lex->pos;
-    while (start > 0 && lex->src[start - 1] != '\n')
-        start--;
-
-    size_t end = lex->pos;
-    while (end < lex->len && lex->src[end] != '\n')
-        end++;
-
-    static char line_buf[512];
-    size_t      len = end - start;
-    if (len >= sizeof(line_buf))
-        len = sizeof(line_buf) - 1;
-    strncpy(line_buf, &lex->src[start], len);
-    line_buf[len] = '\0';
-    return line_buf;
-}
-
 static token_t lexer_error(lexer_t* lex, size_t start, const char* message)
 {
     token_t tok = {0};
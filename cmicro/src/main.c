@@ -13,6 +13,14 @@
 #include <parser.h>
 #include <typechecker.h>
 #include <codegen.h>
+#include <driver.h>
+#include <server.h>
+#include <timing.h>
+#include <trace.h>
+#include <remark.h>
+#include <error.h>
+#define MEM_CATEGORY MEM_SOURCE
+#include <mem.h>
 
 /* AST Printing */
 static void print_ast_indent(ast_node_t* node, int indent_level)
@@ -48,9 +56,17 @@ static void print_ast_indent(ast_node_t* node, int indent_level)
         printf("Ident(%.*s)", (int) node->data.ident.name_len, node->data.ident.name);
         break;
     case NODE_ASSIGN:
-        if (node->data.assign.type)
-            printf("Definition(%s, %.*s,\n", node->data.assign.type,
-                   (int) node->data.assign.name_len, node->data.assign.name);
+        if (node->data.assign.target)
+        {
+            printf("Store(\n");
+            print_ast_indent(node->data.assign.target, indent_level + 1);
+            printf(",\n");
+        }
+        else if (node->data.assign.type)
+            printf("Definition(%s%s%s, %.*s,\n", node->data.assign.is_extern ? "extern " : "",
+                   node->data.assign.is_thread_local ? "thread_local " : "",
+                   node->data.assign.type, (int) node->data.assign.name_len,
+                   node->data.assign.name);
         else
             printf("Assignment(%.*s,\n", (int) node->data.assign.name_len, node->data.assign.name);
         print_ast_indent(node->data.assign.value, indent_level + 1);
@@ -165,9 +181,67 @@ static void print_ast_indent(ast_node_t* node, int indent_level)
             printf("  ");
         printf(")");
         break;
+    case NODE_WHILE:
+        printf("While(\n");
+        print_ast_indent(node->data.while_stmt.condition, indent_level + 1);
+        printf(",\n");
+        print_ast_indent(node->data.while_stmt.body, indent_level + 1);
+        printf("\n");
+        for (int i = 0; i < indent_level; i++)
+            printf("  ");
+        printf(")");
+        break;
+    case NODE_ASM:
+        printf("Asm(\"%.*s\"", (int) node->data.asm_stmt.text_len, node->data.asm_stmt.text);
+        for (size_t i = 0; i < node->data.asm_stmt.output_count; i++)
+        {
+            printf(",\n");
+            for (int j = 0; j <= indent_level; j++)
+                printf("  ");
+            printf("Out(\"%s\",\n", node->data.asm_stmt.outputs[i].constraint);
+            print_ast_indent(node->data.asm_stmt.outputs[i].expr, indent_level + 2);
+            printf(")");
+        }
+        for (size_t i = 0; i < node->data.asm_stmt.input_count; i++)
+        {
+            printf(",\n");
+            for (int j = 0; j <= indent_level; j++)
+                printf("  ");
+            printf("In(\"%s\",\n", node->data.asm_stmt.inputs[i].constraint);
+            print_ast_indent(node->data.asm_stmt.inputs[i].expr, indent_level + 2);
+            printf(")");
+        }
+        for (size_t i = 0; i < node->data.asm_stmt.clobber_count; i++)
+            printf(", Clobber(\"%s\")", node->data.asm_stmt.clobbers[i]);
+        printf(")");
+        break;
     case NODE_IMPORT:
         printf("Import(\"%s\")", node->data.import.module);
         break;
+    case NODE_CAST:
+        printf("Cast(%s,\n", node->data.cast.type);
+        print_ast_indent(node->data.cast.expr, indent_level + 1);
+        printf("\n");
+        for (int i = 0; i < indent_level; i++)
+            printf("  ");
+        printf(")");
+        break;
+    case NODE_ADDR_OF:
+        printf("AddrOf(\n");
+        print_ast_indent(node->data.addr_of.expr, indent_level + 1);
+        printf("\n");
+        for (int i = 0; i < indent_level; i++)
+            printf("  ");
+        printf(")");
+        break;
+    case NODE_DEREF:
+        printf("Deref(\n");
+        print_ast_indent(node->data.deref.expr, indent_level + 1);
+        printf("\n");
+        for (int i = 0; i < indent_level; i++)
+            printf("  ");
+        printf(")");
+        break;
     default:
         break;
     }
@@ -181,14 +255,38 @@ static void print_ast(ast_node_t* node)
 /* Command-line Utilities */
 static void print_usage(const char* prog_name)
 {
-    printf("Usage: %s [options] <source_file>\n", prog_name);
+    printf("Usage: %s [options] <source_file>...  ('-' reads stdin)\n", prog_name);
+    printf("       %s [options] --batch=FILE\n", prog_name);
+    printf("       %s --server=SOCKET\n", prog_name);
+    printf("       %s --connect=SOCKET [options] <source_file>...\n", prog_name);
     printf("Options:\n");
     printf("  -h, --help                Display this help message and exit\n");
     printf("  -u, --usage               Display usage information and exit\n");
     printf("  -v, --version             Display version information and exit\n");
     printf("  -V, --verbose             Enable verbose output\n");
-    printf("  -f, --output-format=TYPE  Set output format (lexer, ast, bin)\n");
-    printf("  -o, --output=FILE         Specify output file for binary\n");
+    printf("  -f, --output-format=TYPE  Set output format (lexer, ast, qbe, asm, bin)\n");
+    printf("  -ffunction-sections       Place each function in its own section\n");
+    printf("  -ftime-report[=json]      Print the time spent in each phase, as text or JSON\n");
+    printf("  -ferror-limit=N           Stop reporting errors after N of them (0: no limit)\n");
+    printf("      --trace=FILE          Write a Chrome trace of phases and functions to FILE\n");
+    printf("      --mem-stats           Print allocations per category and phase, and peak RSS\n");
+    printf("  -Rpass[=REGEX]            Print optimizations applied by passes matching REGEX\n");
+    printf("  -Rpass-missed[=REGEX]     Print optimizations not applied, and why\n");
+    printf("  -Rpass-analysis[=REGEX]   Print the analysis results deciding optimizations\n");
+    printf("  -fsave-optimization-record[=yaml|json]\n");
+    printf("                            Write all remarks to <output>.opt.yaml or .opt.json\n");
+    printf("  -fdata-sections           Place each global and string in its own section\n");
+    printf("  -o, --output=FILE         Specify output file, '-' for stdout\n");
+    printf("  -O, --optimize=LEVEL      Set optimization level (0, 1)\n");
+    printf("  -j, --jobs=N              Compile up to N modules in parallel\n");
+    printf("  -MD                       Write dependency manifests, skip up-to-date modules\n");
+    printf("  -s, --stats               Print code size and generic instantiation statistics\n");
+    printf("      --simd=ISA            Lower vector operations for ISA (none, sse2, avx2)\n");
+    printf("      --profile=FILE        Order functions by the call counts in FILE (with -O1)\n");
+    printf("      --gc-sections         Link with garbage collection of unused sections\n");
+    printf("      --batch=FILE          Compile each 'input -> output' line of FILE (with -j)\n");
+    printf("      --server=SOCKET       Serve compilations on SOCKET, caching parsed modules\n");
+    printf("      --connect=SOCKET      Forward the command line to the server on SOCKET\n");
 }
 
 static void print_version(void)
@@ -196,103 +294,65 @@ static void print_version(void)
     printf("cmicro version 0.1.0\n");
 }
 
-/* Main Function */
-int main(int argc, char** argv)
+// -Rpass[=REGEX], -Rpass-missed[=REGEX] and -Rpass-analysis[=REGEX], the option letter takes
+// the rest as argument.
+static bool parse_remark_option(const char* arg)
 {
-    int         verbose       = 0;
-    const char* output_format = "bin";   // Default to bin
-    const char* output_file   = "a.out"; // Default output file
-    const char* filename      = NULL;
-
-    /* Parse command-line options */
-    static struct option long_options[] = {{"help", no_argument, 0, 'h'},
-                                           {"usage", no_argument, 0, 'u'},
-                                           {"version", no_argument, 0, 'v'},
-                                           {"verbose", no_argument, 0, 'V'},
-                                           {"output-format", required_argument, 0, 'f'},
-                                           {"output", required_argument, 0, 'o'},
-                                           {0, 0, 0, 0}};
-
-    int opt;
-    while ((opt = getopt_long(argc, argv, "huvVf:o:", long_options, NULL)) != -1)
+    static const char* names[REMARK_KIND_COUNT] = {
+        [REMARK_PASSED]   = "pass",
+        [REMARK_MISSED]   = "pass-missed",
+        [REMARK_ANALYSIS] = "pass-analysis",
+    };
+    for (int kind = 0; kind < REMARK_KIND_COUNT; kind++)
     {
-        switch (opt)
-        {
-        case 'h':
-            print_usage(argv[0]);
-            return 0;
-        case 'u':
-            print_usage(argv[0]);
-            return 0;
-        case 'v':
-            print_version();
-            return 0;
-        case 'V':
-            verbose = 1;
-            break;
-        case 'f':
-            if (strcmp(optarg, "lexer") != 0 && strcmp(optarg, "ast") != 0 &&
-                strcmp(optarg, "bin") != 0)
-            {
-                fprintf(stderr,
-                        "Error: Invalid output format '%s'. Must be 'lexer', 'ast', or 'bin'.\n",
-                        optarg);
-                return 1;
-            }
-            output_format = optarg;
-            break;
-        case 'o':
-            output_file = optarg;
-            break;
-        default:
-            print_usage(argv[0]);
-            return 1;
-        }
-    }
-
-    if (optind >= argc)
-    {
-        fprintf(stderr, "Error: No source file provided\n");
-        print_usage(argv[0]);
-        return 1;
-    }
-
-    filename = argv[optind];
-
-    /* Read source file */
-    if (verbose)
-    {
-        printf("[*] Reading source file '%s'...\n", filename);
-    }
-
-    FILE* f = fopen(filename, "rb");
-    if (!f)
-    {
-        perror("Error: Failed to open source file");
-        return 1;
-    }
-
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    rewind(f);
-
-    char* source = malloc(file_size + 1);
-    if (!source)
-    {
-        fprintf(stderr, "Error: Memory allocation failed for source buffer\n");
-        fclose(f);
-        return 1;
+        size_t len = strlen(names[kind]);
+        if (strncmp(arg, names[kind], len) != 0 || (arg[len] != '\0' && arg[len] != '='))
+            continue;
+        if (remark_filter(kind, arg[len] ? arg + len + 1 : NULL))
+            return true;
+        fprintf(stderr, "Error: Invalid regular expression in '-R%s'\n", arg);
+        return false;
     }
+    fprintf(stderr, "Error: Invalid option '-R%s'. Must be -Rpass, -Rpass-missed or "
+                    "-Rpass-analysis.\n",
+            arg);
+    return false;
+}
 
-    size_t read_bytes = fread(source, 1, file_size, f);
-    fclose(f);
-    source[read_bytes] = '\0';
+static bool write_trace(const char* path)
+{
+    if (trace_write(path))
+        return true;
+    fprintf(stderr, "Error: Failed to write trace file '%s'\n", path);
+    return false;
+}
 
-    if (verbose)
+/* Reads a whole source file, which can be a pipe when the source is stdin */
+static char* read_source(FILE* f, size_t* len)
+{
+    size_t capacity = 4096;
+    char*  source   = malloc(capacity);
+    *len            = 0;
+    while (source)
     {
-        printf("[+] Done reading source file\n");
+        *len += fread(source + *len, 1, capacity - *len - 1, f);
+        if (*len < capacity - 1)
+            break;
+        capacity *= 2;
+        char* new_source = realloc(source, capacity);
+        if (!new_source)
+            free(source);
+        source = new_source;
     }
+    if (source)
+        source[*len] = '\0';
+    return source;
+}
 
+// Lexes, parses and generates code for a source read by compile_file(), which owns it.
+static int compile_source(char* source, size_t read_bytes, const char* output_file,
+                          const char* output_format, const codegen_options_t* opts, int verbose)
+{
     /* Lexing */
     if (verbose)
     {
@@ -302,35 +362,33 @@ int main(int argc, char** argv)
     lexer_t  lex      = {source, read_bytes, 0, 1, 1};
     size_t   capacity = 64;
     size_t   count    = 0;
-    token_t* tokens   = malloc(capacity * sizeof(token_t));
+    token_t* tokens   = mem_malloc(capacity * sizeof(token_t), MEM_TOKENS);
     if (!tokens)
     {
         fprintf(stderr, "Error: Memory allocation failed for token buffer\n");
-        free(source);
         return 1;
     }
 
+    timing_begin(PHASE_LEX);
     while (1)
     {
         token_t tok = lexer_next(&lex);
 
         if (tok.type == TOKEN_ERROR)
         {
-            fprintf(stderr, "Error: Lexing error at [%u:%u]\n", tok.line, tok.column);
+            ERROR_FATAL(NULL, 0, 0, "Lexing failed");
             free(tokens);
-            free(source);
             return 1;
         }
 
         if (count >= capacity)
         {
             capacity *= 2;
-            token_t* new_tokens = realloc(tokens, capacity * sizeof(token_t));
+            token_t* new_tokens = mem_realloc(tokens, capacity * sizeof(token_t), MEM_TOKENS);
             if (!new_tokens)
             {
                 fprintf(stderr, "Error: Memory allocation failed for token buffer\n");
                 free(tokens);
-                free(source);
                 return 1;
             }
             tokens = new_tokens;
@@ -341,6 +399,8 @@ int main(int argc, char** argv)
         if (tok.type == TOKEN_EOF)
             break;
     }
+    timing_end(PHASE_LEX);
+    timing_add(COUNTER_TOKENS, count);
 
     if (verbose)
     {
@@ -388,7 +448,6 @@ int main(int argc, char** argv)
                 }
             }
             free(tokens);
-            free(source);
             return 0;
         }
     }
@@ -399,10 +458,12 @@ int main(int argc, char** argv)
         printf("[*] Parsing tokens into AST...\n");
     }
 
+    timing_begin(PHASE_PARSE);
     ast_node_t* ast = ast_gen(tokens);
+    timing_end(PHASE_PARSE);
     if (!ast)
     {
-        fprintf(stderr, "Error: Failed to generate AST\n");
+        ERROR_FATAL(NULL, 0, 0, "Failed to generate AST");
         for (size_t i = 0; i < count; i++)
         {
             if (tokens[i].type == TOKEN_SLIT)
@@ -411,10 +472,10 @@ int main(int argc, char** argv)
             }
         }
         free(tokens);
-        free(source);
         return 1;
     }
 
+    timing_add(COUNTER_AST_NODES, ast_node_count(ast));
     if (verbose)
     {
         printf("[+] Done parsing\n");
@@ -437,20 +498,21 @@ int main(int argc, char** argv)
                 }
             }
             free(tokens);
-            free(source);
             return 0;
         }
     }
 
-    /* Codegen for bin output */
-    if (strcmp(output_format, "bin") == 0)
+    /* Codegen for bin, qbe and asm output */
+    int result = 0;
+    if (strcmp(output_format, "bin") == 0 || strcmp(output_format, "qbe") == 0 ||
+        strcmp(output_format, "asm") == 0)
     {
         if (verbose)
         {
             printf("[*] Generating code to '%s'...\n", output_file);
         }
 
-        codegen_generate(ast, output_file);
+        result = codegen_generate(ast, output_file, opts);
 
         if (verbose)
         {
@@ -468,7 +530,342 @@ int main(int argc, char** argv)
         }
     }
     free(tokens);
+    return result;
+}
+
+static int compile_file(const char* filename, const char* output_file, const char* output_format,
+                        const codegen_options_t* opts, int verbose)
+{
+    /* Read source file */
+    if (verbose)
+    {
+        printf("[*] Reading source file '%s'...\n", filename);
+    }
+
+    timing_begin(PHASE_READ);
+    FILE* f = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "rb");
+    if (!f)
+    {
+        perror("Error: Failed to open source file");
+        timing_end(PHASE_READ);
+        return 1;
+    }
+
+    size_t read_bytes = 0;
+    char*  source     = read_source(f, &read_bytes);
+    if (f != stdin)
+        fclose(f);
+    if (!source)
+    {
+        fprintf(stderr, "Error: Memory allocation failed for source buffer\n");
+        timing_end(PHASE_READ);
+        return 1;
+    }
+    timing_end(PHASE_READ);
+    timing_add(COUNTER_BYTES_IN, read_bytes);
+
+    if (verbose)
+    {
+        printf("[+] Done reading source file\n");
+    }
+
+    // Diagnostics are collected while the source is compiled and written out sorted.
+    error_begin(filename, source, read_bytes);
+    int result = compile_source(source, read_bytes, output_file, output_format, opts, verbose);
+    error_flush();
     free(source);
+    return result;
+}
+
+typedef struct batch_options
+{
+    const char*              output_format;
+    const codegen_options_t* opts;
+    int                      verbose;
+} batch_options_t;
+
+static int compile_batch_entry(const char* input, const char* output, void* data)
+{
+    const batch_options_t* batch = data;
+    return compile_file(input, output, batch->output_format, batch->opts, batch->verbose);
+}
+
+/* Compiles one command line, directly or on behalf of a compile server client */
+static int run(int argc, char** argv, module_cache_t* cache)
+{
+    int         verbose       = 0;
+    const char* output_format = "bin";   // Default to bin
+    const char* output_file   = "a.out"; // Default output file
+    int         opt_level     = 0;
+    int         print_stats   = 0;
+    simd_isa_t  simd          = SIMD_SSE2;
+    const char* profile       = NULL;
+    bool        func_sections = false;
+    bool        data_sections = false;
+    bool        gc_sections   = false;
+    int         jobs          = 1;
+    int         time_report   = 0; // NOTE: 1 for text, 2 for JSON
+    bool        manifest      = false;
+    bool        mem_stats     = false;
+    const char* trace_path    = NULL;
+    const char* batch         = NULL;
+
+    /* Parse command-line options */
+    static struct option long_options[] = {{"help", no_argument, 0, 'h'},
+                                           {"usage", no_argument, 0, 'u'},
+                                           {"version", no_argument, 0, 'v'},
+                                           {"verbose", no_argument, 0, 'V'},
+                                           {"output-format", required_argument, 0, 'f'},
+                                           {"output", required_argument, 0, 'o'},
+                                           {"optimize", required_argument, 0, 'O'},
+                                           {"jobs", required_argument, 0, 'j'},
+                                           {"stats", no_argument, 0, 's'},
+                                           {"simd", required_argument, 0, 'S'},
+                                           {"profile", required_argument, 0, 'P'},
+                                           {"gc-sections", no_argument, 0, 'G'},
+                                           {"mem-stats", no_argument, 0, 'm'},
+                                           {"trace", required_argument, 0, 'T'},
+                                           {"batch", required_argument, 0, 'B'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    timing_reset();
+    mem_stats_reset();
+    trace_reset();
+    remark_reset();
+    error_set_limit(0);
+    optind = 0; // NOTE: the server runs many command lines, 0 makes getopt start over
+    while ((opt = getopt_long(argc, argv, "huvVf:o:O:j:M:R:s", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        case 'u':
+            print_usage(argv[0]);
+            return 0;
+        case 'v':
+            print_version();
+            return 0;
+        case 'V':
+            verbose = 1;
+            break;
+        case 'f':
+            // -ffunction-sections and -fdata-sections share the option letter of -f TYPE.
+            if (strcmp(optarg, "function-sections") == 0)
+            {
+                func_sections = true;
+                break;
+            }
+            if (strcmp(optarg, "data-sections") == 0)
+            {
+                data_sections = true;
+                break;
+            }
+            if (strcmp(optarg, "time-report") == 0 || strcmp(optarg, "time-report=json") == 0)
+            {
+                time_report = optarg[11] ? 2 : 1;
+                break;
+            }
+            if (strncmp(optarg, "error-limit=", 12) == 0)
+            {
+                char* end   = NULL;
+                long  limit = strtol(optarg + 12, &end, 10);
+                if (!optarg[12] || *end || limit < 0)
+                {
+                    fprintf(stderr, "Error: Invalid error limit '%s'\n", optarg + 12);
+                    return 1;
+                }
+                error_set_limit((unsigned) limit);
+                break;
+            }
+            if (strncmp(optarg, "save-optimization-record", 24) == 0 &&
+                (optarg[24] == '\0' || optarg[24] == '='))
+            {
+                if (optarg[24] == '\0' || strcmp(optarg + 24, "=yaml") == 0)
+                    remark_record(REMARK_FORMAT_YAML);
+                else if (strcmp(optarg + 24, "=json") == 0)
+                    remark_record(REMARK_FORMAT_JSON);
+                else
+                {
+                    fprintf(stderr,
+                            "Error: Invalid optimization record format '%s'. Must be 'yaml' or "
+                            "'json'.\n",
+                            optarg + 25);
+                    return 1;
+                }
+                break;
+            }
+            if (strcmp(optarg, "lexer") != 0 && strcmp(optarg, "ast") != 0 &&
+                strcmp(optarg, "qbe") != 0 && strcmp(optarg, "asm") != 0 &&
+                strcmp(optarg, "bin") != 0)
+            {
+                fprintf(stderr,
+                        "Error: Invalid output format '%s'. Must be 'lexer', 'ast', 'qbe', "
+                        "'asm', or 'bin'.\n",
+                        optarg);
+                return 1;
+            }
+            output_format = optarg;
+            break;
+        case 'o':
+            output_file = optarg;
+            break;
+        case 'O':
+            if (strcmp(optarg, "0") != 0 && strcmp(optarg, "1") != 0)
+            {
+                fprintf(stderr, "Error: Invalid optimization level '%s'. Must be 0 or 1.\n",
+                        optarg);
+                return 1;
+            }
+            opt_level = optarg[0] - '0';
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs < 1)
+            {
+                fprintf(stderr, "Error: Invalid job count '%s'. Must be at least 1.\n", optarg);
+                return 1;
+            }
+            break;
+        case 'M':
+            // -MD, the option letter takes the rest as argument
+            if (strcmp(optarg, "D") != 0)
+            {
+                fprintf(stderr, "Error: Invalid option '-M%s'. Did you mean -MD?\n", optarg);
+                return 1;
+            }
+            manifest = true;
+            break;
+        case 'R':
+            if (!parse_remark_option(optarg))
+                return 1;
+            break;
+        case 's':
+            print_stats = 1;
+            break;
+        case 'S':
+            if (strcmp(optarg, "none") == 0)
+                simd = SIMD_NONE;
+            else if (strcmp(optarg, "sse2") == 0)
+                simd = SIMD_SSE2;
+            else if (strcmp(optarg, "avx2") == 0)
+                simd = SIMD_AVX2;
+            else
+            {
+                fprintf(stderr,
+                        "Error: Invalid SIMD target '%s'. Must be 'none', 'sse2' or 'avx2'.\n",
+                        optarg);
+                return 1;
+            }
+            break;
+        case 'P':
+            profile = optarg;
+            break;
+        case 'G':
+            gc_sections = true;
+            break;
+        case 'm':
+            mem_stats = true;
+            break;
+        case 'T':
+            trace_path = optarg;
+            break;
+        case 'B':
+            batch = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    mem_stats_enable(mem_stats);
+    trace_enable(trace_path != NULL);
+
+    if (batch && optind < argc)
+    {
+        fprintf(stderr, "Error: Source files are read from the batch file with --batch\n");
+        return 1;
+    }
+    if (optind >= argc && !batch)
+    {
+        fprintf(stderr, "Error: No source file provided\n");
+        print_usage(argv[0]);
+        return 1;
+    }
 
-    return 0;
-}
\ No newline at end of file
+    codegen_options_t opts = {.opt_level         = opt_level,
+                              .print_stats       = print_stats,
+                              .simd              = simd,
+                              .profile           = profile,
+                              .function_sections = func_sections,
+                              .data_sections     = data_sections,
+                              .gc_sections       = gc_sections,
+                              .emit              = CODEGEN_EMIT_BIN};
+    if (strcmp(output_format, "qbe") == 0)
+        opts.emit = CODEGEN_EMIT_QBE;
+    else if (strcmp(output_format, "asm") == 0)
+        opts.emit = CODEGEN_EMIT_ASM;
+
+    int result = 0;
+    if (batch)
+    {
+        batch_options_t  entry  = {output_format, &opts, verbose};
+        driver_options_t driver = {.jobs = jobs, .verbose = verbose};
+        result                  = driver_batch(batch, compile_batch_entry, &entry, &driver);
+    }
+    /* Several sources are compiled to objects and linked, the server and -MD build this way */
+    else if (argc - optind > 1 ||
+             ((cache || manifest) && strcmp(output_format, "bin") == 0 &&
+              strcmp(argv[optind], "-") != 0))
+    {
+        if (strcmp(output_format, "bin") != 0)
+        {
+            fprintf(stderr, "Error: Output format '%s' takes a single source file\n",
+                    output_format);
+            return 1;
+        }
+        for (int i = optind; i < argc; i++)
+        {
+            if (argc - optind > 1 && strcmp(argv[i], "-") == 0)
+            {
+                fprintf(stderr, "Error: Reading from stdin takes a single source file\n");
+                return 1;
+            }
+        }
+        if (argc - optind > 1 && strcmp(output_file, "-") == 0)
+        {
+            fprintf(stderr, "Error: Writing to stdout takes a single source file\n");
+            return 1;
+        }
+        driver_options_t driver = {
+            .jobs = jobs, .verbose = verbose, .cache = cache, .manifest = manifest};
+        result = driver_build((const char* const*) &argv[optind], argc - optind, output_file,
+                              &opts, &driver);
+    }
+    else
+    {
+        trace_set_module(argv[optind]);
+        remark_set_file(argv[optind]);
+        result = compile_file(argv[optind], output_file, output_format, &opts, verbose);
+    }
+
+    if (time_report)
+        timing_report(stderr, time_report == 2);
+    if (mem_stats)
+        mem_stats_report(stderr);
+    if (trace_path && !write_trace(trace_path))
+        return 1;
+    return result;
+}
+
+/* Main Function */
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strncmp(argv[1], "--server=", 9) == 0)
+        return server_run(argv[1] + 9, run);
+    if (argc > 1 && strncmp(argv[1], "--connect=", 10) == 0)
+        return client_run(argv[1] + 10, argc - 2, argv + 2);
+    return run(argc, argv, NULL);
+}
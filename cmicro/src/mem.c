@@ -0,0 +1,268 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#define _GNU_SOURCE
+#include <mem.h>
+#include <timing.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+// With --mem-stats every live allocation is kept in a hash table with its size and category, so
+// frees can be accounted too. Memory allocated by the C library (open_memstream() buffers,
+// realpath()) is not in the table, freeing it is ignored.
+typedef struct mem_entry
+{
+    void*          ptr; // NOTE: NULL for empty slots, TOMBSTONE for removed ones
+    size_t         size;
+    mem_category_t category;
+} mem_entry_t;
+
+typedef struct mem_counts
+{
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes; // bytes allocated in total
+    uint64_t live;  // bytes allocated and not yet freed
+    uint64_t peak;  // high-water mark of live
+} mem_counts_t;
+
+typedef struct mem_stats
+{
+    mem_counts_t categories[MEM_CATEGORY_COUNT];
+    mem_counts_t phases[PHASE_COUNT + 1]; // NOTE: live and peak are not kept, the last entry
+                                          // is outside of any phase
+    mem_counts_t total;
+    long         peak_rss_kb; // NOTE: of the worker processes, merged in by the driver
+} mem_stats_t;
+
+#define TOMBSTONE ((void*) 1)
+
+static bool         enabled    = false;
+static mem_stats_t  stats      = {0};
+static mem_entry_t* table      = NULL;
+static size_t       table_size = 0; // NOTE: a power of two
+static size_t       table_used = 0; // live entries and tombstones
+
+static const char* category_names[MEM_CATEGORY_COUNT] = {
+    [MEM_SOURCE] = "source",   [MEM_TOKENS] = "tokens", [MEM_AST] = "ast",
+    [MEM_SYMBOLS] = "symbols", [MEM_TEMPS] = "temps",   [MEM_OTHER] = "other",
+};
+
+static size_t slot_of(const void* ptr)
+{
+    uintptr_t h = (uintptr_t) ptr;
+    h ^= h >> 17;
+    h *= 0x9e3779b97f4a7c15ull;
+    return (size_t) (h ^ (h >> 29)) & (table_size - 1);
+}
+
+static bool table_grow(void)
+{
+    mem_entry_t* old      = table;
+    size_t       old_size = table_size;
+    table_size            = table_size ? table_size * 2 : 4096;
+    table                 = calloc(table_size, sizeof(mem_entry_t));
+    table_used            = 0;
+    if (!table)
+    {
+        enabled = false;
+        free(old);
+        return false;
+    }
+    for (size_t i = 0; i < old_size; i++)
+    {
+        if (!old[i].ptr || old[i].ptr == TOMBSTONE)
+            continue;
+        size_t s = slot_of(old[i].ptr);
+        while (table[s].ptr)
+            s = (s + 1) & (table_size - 1);
+        table[s] = old[i];
+        table_used++;
+    }
+    free(old);
+    return true;
+}
+
+static void count_alloc(mem_counts_t* c, size_t size)
+{
+    c->allocs++;
+    c->bytes += size;
+    c->live += size;
+    if (c->live > c->peak)
+        c->peak = c->live;
+}
+
+static void count_free(mem_counts_t* c, size_t size)
+{
+    c->frees++;
+    c->live = c->live > size ? c->live - size : 0;
+}
+
+static void track(void* ptr, size_t size, mem_category_t category)
+{
+    if (!enabled || !ptr)
+        return;
+    if ((table_used + 1) * 2 > table_size && !table_grow())
+        return;
+    size_t s = slot_of(ptr);
+    while (table[s].ptr && table[s].ptr != TOMBSTONE)
+        s = (s + 1) & (table_size - 1);
+    if (!table[s].ptr)
+        table_used++;
+    table[s] = (mem_entry_t){ptr, size, category};
+    count_alloc(&stats.categories[category], size);
+    stats.phases[timing_phase()].allocs++;
+    stats.phases[timing_phase()].bytes += size;
+    count_alloc(&stats.total, size);
+}
+
+static void untrack(void* ptr)
+{
+    if (!enabled || !ptr || !table)
+        return;
+    size_t s = slot_of(ptr);
+    while (table[s].ptr && table[s].ptr != ptr)
+        s = (s + 1) & (table_size - 1);
+    if (!table[s].ptr)
+        return;
+    count_free(&stats.categories[table[s].category], table[s].size);
+    stats.phases[timing_phase()].frees++;
+    count_free(&stats.total, table[s].size);
+    table[s].ptr = TOMBSTONE;
+}
+
+void* mem_malloc(size_t size, mem_category_t category)
+{
+    void* ptr = malloc(size);
+    track(ptr, size, category);
+    return ptr;
+}
+
+void* mem_calloc(size_t count, size_t size, mem_category_t category)
+{
+    void* ptr = calloc(count, size);
+    track(ptr, count * size, category);
+    return ptr;
+}
+
+void* mem_realloc(void* ptr, size_t size, mem_category_t category)
+{
+    void* new_ptr = realloc(ptr, size);
+    if (new_ptr || size == 0)
+        untrack(ptr);
+    track(new_ptr, size, category);
+    return new_ptr;
+}
+
+char* mem_strdup(const char* s, mem_category_t category)
+{
+    char* copy = strdup(s);
+    track(copy, copy ? strlen(copy) + 1 : 0, category);
+    return copy;
+}
+
+char* mem_strndup(const char* s, size_t n, mem_category_t category)
+{
+    char* copy = strndup(s, n);
+    track(copy, copy ? strlen(copy) + 1 : 0, category);
+    return copy;
+}
+
+void mem_free(void* ptr)
+{
+    untrack(ptr);
+    free(ptr);
+}
+
+void mem_stats_enable(bool enable)
+{
+    enabled = enable;
+}
+
+// Forgets all counts and tracked allocations, e.g. in a forked worker, whose inherited
+// allocations are accounted by the driver already.
+void mem_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    free(table);
+    table      = NULL;
+    table_size = 0;
+    table_used = 0;
+}
+
+bool mem_stats_save(FILE* out)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    stats.peak_rss_kb = usage.ru_maxrss;
+    return fwrite(&stats, sizeof(stats), 1, out) == 1;
+}
+
+static void merge_counts(mem_counts_t* into, const mem_counts_t* from)
+{
+    into->allocs += from->allocs;
+    into->frees += from->frees;
+    into->bytes += from->bytes;
+    if (from->peak > into->peak)
+        into->peak = from->peak;
+}
+
+// Peaks of workers are merged as the highest peak of any one process, not as a sum.
+bool mem_stats_merge(FILE* in)
+{
+    mem_stats_t other;
+    if (fread(&other, sizeof(other), 1, in) != 1)
+        return false;
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+        merge_counts(&stats.categories[i], &other.categories[i]);
+    for (int i = 0; i <= PHASE_COUNT; i++)
+        merge_counts(&stats.phases[i], &other.phases[i]);
+    merge_counts(&stats.total, &other.total);
+    if (other.peak_rss_kb > stats.peak_rss_kb)
+        stats.peak_rss_kb = other.peak_rss_kb;
+    return true;
+}
+
+static void report_counts(FILE* out, const char* name, const mem_counts_t* c, bool live)
+{
+    fprintf(out, "%-10s %10" PRIu64 " %10" PRIu64 " %12" PRIu64, name, c->allocs, c->frees,
+            c->bytes);
+    if (live)
+        fprintf(out, " %12" PRIu64 " %12" PRIu64, c->live, c->peak);
+    fprintf(out, "\n");
+}
+
+void mem_stats_report(FILE* out)
+{
+    static const char* phase_names[PHASE_COUNT + 1] = {
+        [PHASE_READ] = "read",       [PHASE_LEX] = "lex", [PHASE_PARSE] = "parse",
+        [PHASE_CODEGEN] = "codegen", [PHASE_QBE] = "qbe", [PHASE_CLANG] = "clang",
+        [PHASE_LINK] = "link",       [PHASE_COUNT] = "none",
+    };
+    struct rusage self;
+    struct rusage children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    fprintf(out, "=== Memory ===\n");
+    fprintf(out, "%-10s %10s %10s %12s %12s %12s\n", "Category", "Allocs", "Frees", "Bytes",
+            "Live", "Peak");
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+        report_counts(out, category_names[i], &stats.categories[i], true);
+    report_counts(out, "total", &stats.total, true);
+    fprintf(out, "%-10s %10s %10s %12s\n", "Phase", "Allocs", "Frees", "Bytes");
+    for (int i = 0; i <= PHASE_COUNT; i++)
+    {
+        if (stats.phases[i].allocs || stats.phases[i].frees)
+            report_counts(out, phase_names[i], &stats.phases[i], false);
+    }
+    fprintf(out, "Peak RSS: %ld KiB (largest worker %ld KiB, largest child process %ld KiB)\n",
+            self.ru_maxrss, stats.peak_rss_kb, children.ru_maxrss);
+}
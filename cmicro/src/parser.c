@@ -7,10 +7,13 @@
 
 #define _GNU_SOURCE
 #include <parser.h>
+#include <types.h>
 #include <stdlib.h>
 #include <error.h>
 #include <string.h>
 #include <stdbool.h>
+#define MEM_CATEGORY MEM_AST
+#include <mem.h>
 
 static bool error = false;
 
@@ -23,6 +26,8 @@ typedef struct parser
 {
     token_t* tokens;
     size_t   pos;
+    char**   type_params; // type parameters of the generic function being parsed
+    size_t   type_param_count;
 } parser_t;
 
 static inline token_t parser_peek(parser_t* parser)
@@ -40,7 +45,7 @@ static void parser_error(parser_t* parser, const char* message)
     if (!error)
     {
         token_t tok = parser_peek(parser);
-        ERROR_FATAL("", tok.line, tok.column, message);
+        ERROR_RANGE(NULL, tok.line, tok.column, (uint32_t) tok.len, message);
         error = true;
     }
 }
@@ -73,14 +78,26 @@ static int get_precedence(token_type_t op)
 /* ================== */
 /* Node utilities     */
 /* ================== */
+
+// Gives `node` the position of `tok` unless a more specific one was set already.
+static ast_node_t* ast_locate(ast_node_t* node, token_t tok)
+{
+    if (node && node->line == 0)
+    {
+        node->line   = tok.line;
+        node->column = tok.column;
+    }
+    return node;
+}
+
 static ast_node_t* ast_create_binop(token_type_t op, ast_node_t* left, ast_node_t* right)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for binop node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for binop node");
         error = true;
         return NULL;
     }
@@ -95,10 +112,10 @@ static ast_node_t* ast_create_number_int(int64_t value)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for number node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for number node");
         error = true;
         return NULL;
     }
@@ -112,10 +129,10 @@ static ast_node_t* ast_create_number_float(double value)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for number node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for number node");
         error = true;
         return NULL;
     }
@@ -129,10 +146,10 @@ static ast_node_t* ast_create_string(char* value, size_t len)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for string node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string node");
         error = true;
         return NULL;
     }
@@ -146,10 +163,10 @@ static ast_node_t* ast_create_ident(char* name, size_t name_len)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for ident node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for ident node");
         error = true;
         return NULL;
     }
@@ -163,18 +180,32 @@ static ast_node_t* ast_create_assign(char* name, size_t name_len, char* type, as
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for assign node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for assign node");
         error = true;
         return NULL;
     }
-    node->type                 = NODE_ASSIGN;
-    node->data.assign.name     = name;
-    node->data.assign.name_len = name_len;
-    node->data.assign.type     = type;
-    node->data.assign.value    = value;
+    node->type                        = NODE_ASSIGN;
+    node->data.assign.name            = name;
+    node->data.assign.name_len        = name_len;
+    node->data.assign.type            = type;
+    node->data.assign.value           = value;
+    node->data.assign.target          = NULL;
+    node->data.assign.is_thread_local = false;
+    node->data.assign.is_extern       = false;
+    return node;
+}
+
+static ast_node_t* ast_create_store(ast_node_t* target, ast_node_t* value)
+{
+    if (error)
+        return NULL;
+    ast_node_t* node = ast_create_assign(NULL, 0, NULL, value);
+    if (!node)
+        return NULL;
+    node->data.assign.target = target;
     return node;
 }
 
@@ -182,10 +213,10 @@ static ast_node_t* ast_create_return(ast_node_t* expr)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for return node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for return node");
         error = true;
         return NULL;
     }
@@ -199,20 +230,22 @@ static ast_node_t* ast_create_func_def(char* name, size_t name_len, char* return
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for func_def node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for func_def node");
         error = true;
         return NULL;
     }
-    node->type                         = NODE_FUNC_DEF;
-    node->data.func_def.name           = name;
-    node->data.func_def.name_len       = name_len;
-    node->data.func_def.return_type    = return_type;
-    node->data.func_def.params         = params;
-    node->data.func_def.root           = root;
-    node->data.func_def.is_declaration = is_declaration;
+    node->type                           = NODE_FUNC_DEF;
+    node->data.func_def.name             = name;
+    node->data.func_def.name_len         = name_len;
+    node->data.func_def.return_type      = return_type;
+    node->data.func_def.params           = params;
+    node->data.func_def.root             = root;
+    node->data.func_def.is_declaration   = is_declaration;
+    node->data.func_def.type_params      = NULL;
+    node->data.func_def.type_param_count = 0;
     return node;
 }
 
@@ -221,18 +254,20 @@ static ast_node_t* ast_create_func_call(char* name, size_t name_len, ast_node_t*
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for func_call node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for func_call node");
         error = true;
         return NULL;
     }
-    node->type                     = NODE_FUNC_CALL;
-    node->data.func_call.name      = name;
-    node->data.func_call.name_len  = name_len;
-    node->data.func_call.args      = args;
-    node->data.func_call.arg_count = arg_count;
+    node->type                          = NODE_FUNC_CALL;
+    node->data.func_call.name           = name;
+    node->data.func_call.name_len       = name_len;
+    node->data.func_call.args           = args;
+    node->data.func_call.arg_count      = arg_count;
+    node->data.func_call.type_args      = NULL;
+    node->data.func_call.type_arg_count = 0;
     return node;
 }
 
@@ -240,10 +275,10 @@ static ast_node_t* ast_create_block(ast_node_t* stmts, size_t stmt_count)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for block node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for block node");
         error = true;
         return NULL;
     }
@@ -257,10 +292,10 @@ static ast_node_t* ast_create_program(ast_node_t* func_defs, size_t func_def_cou
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for program node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for program node");
         error = true;
         return NULL;
     }
@@ -275,10 +310,10 @@ static ast_node_t* ast_create_if(ast_node_t* condition, ast_node_t* then_block,
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for if node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for if node");
         error = true;
         return NULL;
     }
@@ -289,15 +324,32 @@ static ast_node_t* ast_create_if(ast_node_t* condition, ast_node_t* then_block,
     return node;
 }
 
+static ast_node_t* ast_create_while(ast_node_t* condition, ast_node_t* body)
+{
+    if (error)
+        return NULL;
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
+    if (!node)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for while node");
+        error = true;
+        return NULL;
+    }
+    node->type                      = NODE_WHILE;
+    node->data.while_stmt.condition = condition;
+    node->data.while_stmt.body      = body;
+    return node;
+}
+
 static ast_node_t* ast_create_elseif(ast_node_t* condition, ast_node_t* then_block,
                                      ast_node_t* else_block)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for elseif node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for elseif node");
         error = true;
         return NULL;
     }
@@ -312,10 +364,10 @@ static ast_node_t* ast_create_else(ast_node_t* block)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for else node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for else node");
         error = true;
         return NULL;
     }
@@ -331,7 +383,7 @@ static param_node_t* ast_create_param(char* name, size_t name_len, char* type)
     param_node_t* param = (param_node_t*) malloc(sizeof(param_node_t));
     if (!param)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for param node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for param node");
         error = true;
         return NULL;
     }
@@ -347,10 +399,10 @@ static ast_node_t* ast_create_import(char* module)
 {
     if (error)
         return NULL;
-    ast_node_t* node = (ast_node_t*) malloc(sizeof(ast_node_t));
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
     if (!node)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for import node");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for import node");
         error = true;
         return NULL;
     }
@@ -359,18 +411,239 @@ static ast_node_t* ast_create_import(char* module)
     return node;
 }
 
+static ast_node_t* ast_create_cast(char* type, ast_node_t* expr)
+{
+    if (error)
+        return NULL;
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
+    if (!node)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for cast node");
+        error = true;
+        return NULL;
+    }
+    node->type           = NODE_CAST;
+    node->data.cast.type = type;
+    node->data.cast.expr = expr;
+    return node;
+}
+
+static ast_node_t* ast_create_addr_of(ast_node_t* expr)
+{
+    if (error)
+        return NULL;
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
+    if (!node)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for address-of node");
+        error = true;
+        return NULL;
+    }
+    node->type              = NODE_ADDR_OF;
+    node->data.addr_of.expr = expr;
+    return node;
+}
+
+static ast_node_t* ast_create_deref(ast_node_t* expr)
+{
+    if (error)
+        return NULL;
+    ast_node_t* node = (ast_node_t*) calloc(1, sizeof(ast_node_t));
+    if (!node)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for dereference node");
+        error = true;
+        return NULL;
+    }
+    node->type            = NODE_DEREF;
+    node->data.deref.expr = expr;
+    return node;
+}
+
 /* ================== */
 /* Parsers            */
 /* ================== */
+static char*         parse_type(parser_t* parser);
 static ast_node_t*   parse_factor(parser_t* parser);
 static ast_node_t*   parse_expression(parser_t* parser, int min_precedence);
 static ast_node_t*   parse_statement(parser_t* parser);
 static param_node_t* parse_param_list(parser_t* parser);
 static ast_node_t*   parse_func_def(parser_t* parser);
+static ast_node_t*   parse_func_body(parser_t* parser, token_t name_tok, char* return_type);
 static ast_node_t*   parse_func_call(parser_t* parser);
+static ast_node_t*   parse_call_args(parser_t* parser, char* name, size_t name_len);
 static ast_node_t*   parse_if_statement(parser_t* parser);
+static ast_node_t*   parse_while_statement(parser_t* parser);
+static ast_node_t*   parse_asm_statement(parser_t* parser);
 
-static ast_node_t* parse_factor(parser_t* parser)
+static bool is_type_token(parser_t* parser, token_t tok)
+{
+    if (tok.type == TOKEN_KEYWORD)
+        return type_lookup_n(tok.lexeme, tok.len) != NULL;
+    if (tok.type != TOKEN_IDENT)
+        return false;
+    for (size_t i = 0; i < parser->type_param_count; i++)
+    {
+        if (strlen(parser->type_params[i]) == tok.len &&
+            strncmp(parser->type_params[i], tok.lexeme, tok.len) == 0)
+            return true;
+    }
+    return false;
+}
+
+// A statement starting with 'IDENT IDENT' or 'IDENT * ... IDENT' declares something whose type is
+// named by an identifier (a type parameter).
+static bool at_ident_declaration(parser_t* parser)
+{
+    size_t pos = parser->pos + 1;
+    while (parser->tokens[pos].type == TOKEN_STAR)
+        pos++;
+    token_t tok = parser->tokens[pos];
+    if (tok.type == TOKEN_KEYWORD && tok.len == 8 && strncmp(tok.lexeme, "restrict", 8) == 0)
+        tok = parser->tokens[++pos];
+    return tok.type == TOKEN_IDENT;
+}
+
+static void free_type_list(char** types, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        free(types[i]);
+    free(types);
+}
+
+// Parses '<' TYPE (',' TYPE)* '>'. With `names_only` every entry must be a plain identifier, as
+// in the type parameter list of a generic function.
+static char** parse_type_list(parser_t* parser, size_t* count, bool names_only)
+{
+    *count = 0;
+    if (error)
+        return NULL;
+    if (parser_peek(parser).type != TOKEN_LT)
+    {
+        parser_error(parser, "Expected '<'");
+        return NULL;
+    }
+    parser_advance(parser);
+    char** types    = NULL;
+    size_t capacity = 0;
+    while (1)
+    {
+        char* type = NULL;
+        if (names_only)
+        {
+            token_t name_tok = parser_peek(parser);
+            if (name_tok.type != TOKEN_IDENT)
+            {
+                parser_error(parser, "Expected type parameter name");
+                free_type_list(types, *count);
+                return NULL;
+            }
+            parser_advance(parser);
+            type = strndup(name_tok.lexeme, name_tok.len);
+        }
+        else
+        {
+            type = parse_type(parser);
+        }
+        if (error || !type)
+        {
+            if (!error)
+            {
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for type list");
+                error = true;
+            }
+            free(type);
+            free_type_list(types, *count);
+            return NULL;
+        }
+        if (*count >= capacity)
+        {
+            capacity         = capacity ? capacity * 2 : 4;
+            char** new_types = (char**) realloc(types, capacity * sizeof(char*));
+            if (!new_types)
+            {
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for type list");
+                error = true;
+                free(type);
+                free_type_list(types, *count);
+                return NULL;
+            }
+            types = new_types;
+        }
+        types[(*count)++] = type;
+        if (parser_peek(parser).type == TOKEN_COMMA)
+        {
+            parser_advance(parser);
+            continue;
+        }
+        if (parser_peek(parser).type != TOKEN_GT)
+        {
+            parser_error(parser, "Expected ',' or '>' in type list");
+            free_type_list(types, *count);
+            return NULL;
+        }
+        parser_advance(parser);
+        return types;
+    }
+}
+
+// 'name<TYPE...>(' starts a call with explicit type arguments.
+static bool at_generic_call(parser_t* parser)
+{
+    return parser->tokens[parser->pos].type == TOKEN_IDENT &&
+           parser->tokens[parser->pos + 1].type == TOKEN_LT &&
+           is_type_token(parser, parser->tokens[parser->pos + 2]);
+}
+
+// Parses a type name followed by any number of '*' and an optional 'restrict' qualifier on the
+// outermost pointer, e.g. "int", "char**" or "int* restrict".
+static char* parse_type(parser_t* parser)
+{
+    if (error)
+        return NULL;
+    token_t type_tok = parser_peek(parser);
+    if (type_tok.type != TOKEN_KEYWORD && type_tok.type != TOKEN_IDENT)
+    {
+        parser_error(parser, "Expected type");
+        return NULL;
+    }
+    parser_advance(parser);
+    size_t stars = 0;
+    while (parser_peek(parser).type == TOKEN_STAR)
+    {
+        parser_advance(parser);
+        stars++;
+    }
+    bool    is_restrict = false;
+    token_t qual_tok    = parser_peek(parser);
+    if (qual_tok.type == TOKEN_KEYWORD && qual_tok.len == 8 &&
+        strncmp(qual_tok.lexeme, "restrict", 8) == 0)
+    {
+        if (stars == 0)
+        {
+            parser_error(parser, "'restrict' requires a pointer type");
+            return NULL;
+        }
+        parser_advance(parser);
+        is_restrict = true;
+    }
+    size_t len  = type_tok.len + stars + (is_restrict ? 9 : 0);
+    char*  type = (char*) malloc(len + 1);
+    if (!type)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for type name");
+        error = true;
+        return NULL;
+    }
+    memcpy(type, type_tok.lexeme, type_tok.len);
+    memset(type + type_tok.len, '*', stars);
+    if (is_restrict)
+        memcpy(type + type_tok.len + stars, " restrict", 9);
+    type[len] = '\0';
+    return type;
+}
+
+static ast_node_t* parse_factor_node(parser_t* parser)
 {
     if (error)
         return NULL;
@@ -392,7 +665,7 @@ static ast_node_t* parse_factor(parser_t* parser)
         char* str = strndup(tok.value.str.x, tok.value.str.y);
         if (!str)
         {
-            ERROR_FATAL("", 0, 0, "Memory allocation failed for string");
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for string");
             error = true;
             return NULL;
         }
@@ -400,6 +673,8 @@ static ast_node_t* parse_factor(parser_t* parser)
     }
     else if (tok.type == TOKEN_IDENT)
     {
+        if (at_generic_call(parser))
+            return parse_func_call(parser);
         token_t ident_tok = parser_advance(parser);
         if (parser_peek(parser).type == TOKEN_LPAREN)
         {
@@ -409,12 +684,60 @@ static ast_node_t* parse_factor(parser_t* parser)
         char* name = strndup(ident_tok.lexeme, ident_tok.len);
         if (!name)
         {
-            ERROR_FATAL("", 0, 0, "Memory allocation failed for identifier");
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for identifier");
             error = true;
             return NULL;
         }
         return ast_create_ident(name, ident_tok.len);
     }
+    else if (tok.type == TOKEN_STAR)
+    {
+        parser_advance(parser);
+        ast_node_t* expr = parse_factor(parser);
+        if (error)
+            return NULL;
+        return ast_create_deref(expr);
+    }
+    else if (tok.type == TOKEN_AMP)
+    {
+        parser_advance(parser);
+        if (parser_peek(parser).type != TOKEN_IDENT)
+        {
+            parser_error(parser, "Expected identifier after '&'");
+            return NULL;
+        }
+        ast_node_t* expr = parse_factor(parser);
+        if (error)
+            return NULL;
+        if (expr->type != NODE_IDENT)
+        {
+            parser_error(parser, "Cannot take the address of a function call");
+            ast_free(expr);
+            return NULL;
+        }
+        return ast_create_addr_of(expr);
+    }
+    else if (tok.type == TOKEN_LPAREN && is_type_token(parser, parser->tokens[parser->pos + 1]))
+    {
+        parser_advance(parser);
+        char* type = parse_type(parser);
+        if (error)
+            return NULL;
+        if (parser_peek(parser).type != TOKEN_RPAREN)
+        {
+            parser_error(parser, "Expected ')' after cast type");
+            free(type);
+            return NULL;
+        }
+        parser_advance(parser);
+        ast_node_t* expr = parse_factor(parser);
+        if (error)
+        {
+            free(type);
+            return NULL;
+        }
+        return ast_create_cast(type, expr);
+    }
     else if (tok.type == TOKEN_LPAREN)
     {
         parser_advance(parser);
@@ -435,6 +758,12 @@ static ast_node_t* parse_factor(parser_t* parser)
     return NULL;
 }
 
+static ast_node_t* parse_factor(parser_t* parser)
+{
+    token_t tok = parser_peek(parser);
+    return ast_locate(parse_factor_node(parser), tok);
+}
+
 static ast_node_t* parse_expression(parser_t* parser, int min_precedence)
 {
     if (error)
@@ -460,7 +789,7 @@ static ast_node_t* parse_expression(parser_t* parser, int min_precedence)
             ast_free(left);
             return NULL;
         }
-        left = ast_create_binop(op, left, right);
+        left = ast_locate(ast_create_binop(op, left, right), tok);
         if (error)
         {
             return NULL;
@@ -526,8 +855,7 @@ static param_node_t* parse_param_list(parser_t* parser)
             break;
         }
 
-        token_t type_tok = parser_peek(parser);
-        if (type_tok.type != TOKEN_KEYWORD)
+        if (!is_type_token(parser, parser_peek(parser)))
         {
             parser_error(parser, "Expected type in parameter list");
             while (head)
@@ -540,12 +868,9 @@ static param_node_t* parse_param_list(parser_t* parser)
             }
             return NULL;
         }
-        parser_advance(parser);
-
-        token_t name_tok = parser_peek(parser);
-        if (name_tok.type != TOKEN_IDENT)
+        char* type_name = parse_type(parser);
+        if (error)
         {
-            parser_error(parser, "Expected identifier in parameter list");
             while (head)
             {
                 param_node_t* next = head->next;
@@ -556,13 +881,12 @@ static param_node_t* parse_param_list(parser_t* parser)
             }
             return NULL;
         }
-        parser_advance(parser);
 
-        char* type_name = strndup(type_tok.lexeme, type_tok.len);
-        if (!type_name)
+        token_t name_tok = parser_peek(parser);
+        if (name_tok.type != TOKEN_IDENT)
         {
-            ERROR_FATAL("", 0, 0, "Memory allocation failed for type name");
-            error = true;
+            free(type_name);
+            parser_error(parser, "Expected identifier in parameter list");
             while (head)
             {
                 param_node_t* next = head->next;
@@ -573,11 +897,13 @@ static param_node_t* parse_param_list(parser_t* parser)
             }
             return NULL;
         }
+        parser_advance(parser);
+
         char* param_name = strndup(name_tok.lexeme, name_tok.len);
         if (!param_name)
         {
             free(type_name);
-            ERROR_FATAL("", 0, 0, "Memory allocation failed for param name");
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for param name");
             error = true;
             while (head)
             {
@@ -651,41 +977,59 @@ static ast_node_t* parse_func_def(parser_t* parser)
 {
     if (error)
         return NULL;
-    token_t return_type_tok = parser_peek(parser);
-    if (return_type_tok.type != TOKEN_KEYWORD)
+    if (parser_peek(parser).type != TOKEN_KEYWORD && parser_peek(parser).type != TOKEN_IDENT)
     {
         parser_error(parser, "Expected return type for function definition");
         return NULL;
     }
-    parser_advance(parser);
+    char* return_type = parse_type(parser);
+    if (error)
+        return NULL;
 
     token_t name_tok = parser_peek(parser);
     if (name_tok.type != TOKEN_IDENT)
     {
+        free(return_type);
         parser_error(parser, "Expected function name");
         return NULL;
     }
     parser_advance(parser);
 
-    param_node_t* params = parse_param_list(parser);
-    if (error)
+    size_t type_param_count = 0;
+    char** type_params      = NULL;
+    if (parser_peek(parser).type == TOKEN_LT)
     {
-        while (params)
+        type_params = parse_type_list(parser, &type_param_count, true);
+        if (error)
         {
-            param_node_t* next = params->next;
-            free(params->name);
-            free(params->type);
-            free(params);
-            params = next;
+            free(return_type);
+            return NULL;
         }
+    }
+    parser->type_params      = type_params;
+    parser->type_param_count = type_param_count;
+
+    ast_node_t* func = parse_func_body(parser, name_tok, return_type);
+
+    parser->type_params      = NULL;
+    parser->type_param_count = 0;
+    if (!func)
+    {
+        free_type_list(type_params, type_param_count);
         return NULL;
     }
+    func->data.func_def.type_params      = type_params;
+    func->data.func_def.type_param_count = type_param_count;
+    return func;
+}
 
-    char* return_type = strndup(return_type_tok.lexeme, return_type_tok.len);
-    if (!return_type)
+// Parses the parameter list and body (or ';') of a function, given its name and return type.
+static ast_node_t* parse_func_body(parser_t* parser, token_t name_tok, char* return_type)
+{
+    param_node_t* params = parse_param_list(parser);
+    if (error)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for return type");
-        error = true;
+        free(return_type);
         while (params)
         {
             param_node_t* next = params->next;
@@ -696,11 +1040,12 @@ static ast_node_t* parse_func_def(parser_t* parser)
         }
         return NULL;
     }
+
     char* name = strndup(name_tok.lexeme, name_tok.len);
     if (!name)
     {
         free(return_type);
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for function name");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function name");
         error = true;
         while (params)
         {
@@ -769,7 +1114,7 @@ static ast_node_t* parse_func_def(parser_t* parser)
             ast_node_t* new_stmts = (ast_node_t*) realloc(stmts, capacity * sizeof(ast_node_t));
             if (!new_stmts)
             {
-                ERROR_FATAL("", 0, 0, "Memory allocation failed for statements");
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for statements");
                 error = true;
                 ast_free(stmt);
                 free(name);
@@ -849,12 +1194,38 @@ static ast_node_t* parse_func_call(parser_t* parser)
     char* name = strndup(name_tok.lexeme, name_tok.len);
     if (!name)
     {
-        ERROR_FATAL("", 0, 0, "Memory allocation failed for function name");
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function name");
         error = true;
         return NULL;
     }
     parser_advance(parser);
 
+    size_t type_arg_count = 0;
+    char** type_args      = NULL;
+    if (parser_peek(parser).type == TOKEN_LT)
+    {
+        type_args = parse_type_list(parser, &type_arg_count, false);
+        if (error)
+        {
+            free(name);
+            return NULL;
+        }
+    }
+
+    ast_node_t* call = parse_call_args(parser, name, name_tok.len);
+    if (!call)
+    {
+        free_type_list(type_args, type_arg_count);
+        return NULL;
+    }
+    call->data.func_call.type_args      = type_args;
+    call->data.func_call.type_arg_count = type_arg_count;
+    return call;
+}
+
+// Parses '(' ARG (',' ARG)* ')' of a call to `name`, takes ownership of `name`.
+static ast_node_t* parse_call_args(parser_t* parser, char* name, size_t name_len)
+{
     if (parser_peek(parser).type != TOKEN_LPAREN)
     {
         free(name);
@@ -877,7 +1248,7 @@ static ast_node_t* parse_func_call(parser_t* parser)
                 ast_node_t* new_args = (ast_node_t*) realloc(args, capacity * sizeof(ast_node_t));
                 if (!new_args)
                 {
-                    ERROR_FATAL("", 0, 0, "Memory allocation failed for args");
+                    ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for args");
                     error = true;
                     for (size_t i = 0; i < arg_count; i++)
                         ast_free_internal(&args[i]);
@@ -925,7 +1296,7 @@ static ast_node_t* parse_func_call(parser_t* parser)
         return NULL;
     }
     parser_advance(parser);
-    return ast_create_func_call(name, name_tok.len, args, arg_count);
+    return ast_create_func_call(name, name_len, args, arg_count);
 }
 
 static ast_node_t* parse_if_statement(parser_t* parser)
@@ -994,7 +1365,7 @@ static ast_node_t* parse_if_statement(parser_t* parser)
             ast_node_t* new_stmts = (ast_node_t*) realloc(stmts, capacity * sizeof(ast_node_t));
             if (!new_stmts)
             {
-                ERROR_FATAL("", 0, 0, "Memory allocation failed for statements");
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for statements");
                 error = true;
                 ast_free(stmt);
                 ast_free(condition);
@@ -1076,7 +1447,7 @@ static ast_node_t* parse_if_statement(parser_t* parser)
                         (ast_node_t*) realloc(stmts, capacity * sizeof(ast_node_t));
                     if (!new_stmts)
                     {
-                        ERROR_FATAL("", 0, 0, "Memory allocation failed for else statements");
+                        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for else statements");
                         error = true;
                         ast_free(stmt);
                         ast_free(condition);
@@ -1136,7 +1507,200 @@ static ast_node_t* parse_if_statement(parser_t* parser)
     return ast_create_if(condition, then_block, else_block);
 }
 
-static ast_node_t* parse_statement(parser_t* parser)
+static ast_node_t* parse_while_statement(parser_t* parser)
+{
+    if (error)
+        return NULL;
+    parser_advance(parser);
+    if (parser_peek(parser).type != TOKEN_LPAREN)
+    {
+        parser_error(parser, "Expected '(' after 'while'");
+        return NULL;
+    }
+    parser_advance(parser);
+
+    ast_node_t* condition = parse_expression(parser, 0);
+    if (error || !condition)
+    {
+        parser_error(parser, "Expected condition expression in 'while'");
+        return NULL;
+    }
+    if (parser_peek(parser).type != TOKEN_RPAREN)
+    {
+        parser_error(parser, "Expected ')' after condition");
+        ast_free(condition);
+        return NULL;
+    }
+    parser_advance(parser);
+
+    if (parser_peek(parser).type != TOKEN_LBRACE)
+    {
+        parser_error(parser, "Expected '{' for while body");
+        ast_free(condition);
+        return NULL;
+    }
+    ast_node_t* body = parse_statement(parser);
+    if (error || !body)
+    {
+        ast_free(condition);
+        return NULL;
+    }
+    return ast_create_while(condition, body);
+}
+
+static void free_asm_operands(asm_operand_t* operands, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(operands[i].constraint);
+        ast_free(operands[i].expr);
+    }
+    free(operands);
+}
+
+// Parses `"c" (expr), ...` up to the next ':' or ')'.
+static asm_operand_t* parse_asm_operands(parser_t* parser, size_t* count)
+{
+    asm_operand_t* operands = NULL;
+    size_t         capacity = 0;
+    *count                  = 0;
+    while (parser_peek(parser).type == TOKEN_SLIT)
+    {
+        token_t constraint = parser_advance(parser);
+        if (parser_peek(parser).type != TOKEN_LPAREN)
+        {
+            parser_error(parser, "Expected '(' after asm operand constraint");
+            free_asm_operands(operands, *count);
+            return NULL;
+        }
+        parser_advance(parser);
+        ast_node_t* expr = parse_expression(parser, 0);
+        if (error || !expr || parser_peek(parser).type != TOKEN_RPAREN)
+        {
+            if (!error)
+                parser_error(parser, "Expected ')' after asm operand");
+            ast_free(expr);
+            free_asm_operands(operands, *count);
+            return NULL;
+        }
+        parser_advance(parser);
+        if (*count >= capacity)
+        {
+            capacity               = capacity ? capacity * 2 : 4;
+            asm_operand_t* resized = realloc(operands, capacity * sizeof(asm_operand_t));
+            if (!resized)
+            {
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for asm operands");
+                error = true;
+                ast_free(expr);
+                free_asm_operands(operands, *count);
+                return NULL;
+            }
+            operands = resized;
+        }
+        operands[*count].constraint = strndup(constraint.value.str.x, constraint.value.str.y);
+        operands[*count].expr       = expr;
+        (*count)++;
+        if (parser_peek(parser).type != TOKEN_COMMA)
+            break;
+        parser_advance(parser);
+    }
+    return operands;
+}
+
+// asm("template" : outputs : inputs : clobbers); adjacent template strings are concatenated.
+static ast_node_t* parse_asm_statement(parser_t* parser)
+{
+    if (error)
+        return NULL;
+    parser_advance(parser);
+    if (parser_peek(parser).type != TOKEN_LPAREN)
+    {
+        parser_error(parser, "Expected '(' after 'asm'");
+        return NULL;
+    }
+    parser_advance(parser);
+    if (parser_peek(parser).type != TOKEN_SLIT)
+    {
+        parser_error(parser, "Expected assembly template string");
+        return NULL;
+    }
+    ast_node_t* node = calloc(1, sizeof(ast_node_t));
+    if (!node)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for asm node");
+        error = true;
+        return NULL;
+    }
+    node->type    = NODE_ASM;
+    ast_asm_t* as = &node->data.asm_stmt;
+    while (parser_peek(parser).type == TOKEN_SLIT)
+    {
+        token_t piece = parser_advance(parser);
+        char*   text  = realloc(as->text, as->text_len + piece.value.str.y + 1);
+        if (!text)
+        {
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for asm template");
+            error = true;
+            ast_free(node);
+            return NULL;
+        }
+        memcpy(text + as->text_len, piece.value.str.x, piece.value.str.y);
+        as->text_len += piece.value.str.y;
+        text[as->text_len] = '\0';
+        as->text           = text;
+    }
+    for (int section = 0; section < 3 && parser_peek(parser).type == TOKEN_COLON; section++)
+    {
+        parser_advance(parser);
+        if (section == 0)
+            as->outputs = parse_asm_operands(parser, &as->output_count);
+        else if (section == 1)
+            as->inputs = parse_asm_operands(parser, &as->input_count);
+        else
+        {
+            while (!error && parser_peek(parser).type == TOKEN_SLIT)
+            {
+                token_t clobber = parser_advance(parser);
+                char**  resized = realloc(as->clobbers, (as->clobber_count + 1) * sizeof(char*));
+                if (!resized)
+                {
+                    ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for asm clobbers");
+                    error = true;
+                    break;
+                }
+                as->clobbers = resized;
+                as->clobbers[as->clobber_count++] =
+                    strndup(clobber.value.str.x, clobber.value.str.y);
+                if (parser_peek(parser).type != TOKEN_COMMA)
+                    break;
+                parser_advance(parser);
+            }
+        }
+        if (error)
+        {
+            ast_free(node);
+            return NULL;
+        }
+    }
+    if (parser_peek(parser).type != TOKEN_RPAREN)
+    {
+        parser_error(parser, "Expected ')' to close asm statement");
+        ast_free(node);
+        return NULL;
+    }
+    parser_advance(parser);
+    if (parser_peek(parser).type != TOKEN_SEMI)
+    {
+        parser_error(parser, "Expected ';' after asm statement");
+        ast_free(node);
+        return NULL;
+    }
+    parser_advance(parser);
+    return node;
+}
+
+static ast_node_t* parse_statement_node(parser_t* parser)
 {
     if (error)
         return NULL;
@@ -1168,7 +1732,7 @@ static ast_node_t* parse_statement(parser_t* parser)
                 ast_node_t* new_stmts = (ast_node_t*) realloc(stmts, capacity * sizeof(ast_node_t));
                 if (!new_stmts)
                 {
-                    ERROR_FATAL("", 0, 0, "Memory allocation failed for block statements");
+                    ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for block statements");
                     error = true;
                     ast_free(stmt);
                     for (size_t i = 0; i < stmt_count; i++)
@@ -1195,6 +1759,35 @@ static ast_node_t* parse_statement(parser_t* parser)
 
         return ast_create_block(stmts, stmt_count);
     }
+    else if (tok.type == TOKEN_STAR)
+    {
+        ast_node_t* target = parse_factor(parser);
+        if (error)
+            return NULL;
+        if (parser_peek(parser).type != TOKEN_ASSIGN)
+        {
+            parser_error(parser, "Expected '=' after dereference");
+            ast_free(target);
+            return NULL;
+        }
+        parser_advance(parser);
+        ast_node_t* value = parse_expression(parser, 0);
+        if (error || !value)
+        {
+            parser_error(parser, "Expected expression after '=' in store");
+            ast_free(target);
+            return NULL;
+        }
+        if (parser_peek(parser).type != TOKEN_SEMI)
+        {
+            parser_error(parser, "Expected ';' after store");
+            ast_free(target);
+            ast_free(value);
+            return NULL;
+        }
+        parser_advance(parser);
+        return ast_create_store(target, value);
+    }
     else if (tok.type == TOKEN_KEYWORD && strncmp(tok.lexeme, "return", tok.len) == 0)
     {
         parser_advance(parser);
@@ -1213,6 +1806,18 @@ static ast_node_t* parse_statement(parser_t* parser)
         parser_advance(parser);
         return ast_create_return(expr);
     }
+    else if (tok.type == TOKEN_KEYWORD && strncmp(tok.lexeme, "if", tok.len) == 0)
+    {
+        return parse_if_statement(parser);
+    }
+    else if (tok.type == TOKEN_KEYWORD && strncmp(tok.lexeme, "while", tok.len) == 0)
+    {
+        return parse_while_statement(parser);
+    }
+    else if (tok.type == TOKEN_KEYWORD && strncmp(tok.lexeme, "asm", tok.len) == 0)
+    {
+        return parse_asm_statement(parser);
+    }
     else if (tok.type == TOKEN_KEYWORD && strncmp(tok.lexeme, "import", tok.len) == 0)
     {
         parser_advance(parser);
@@ -1239,7 +1844,7 @@ static ast_node_t* parse_statement(parser_t* parser)
         char* module = (char*) malloc(total_len + 1);
         if (!module)
         {
-            ERROR_FATAL("", 0, 0, "Memory allocation failed for module name");
+            ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for module name");
             error = true;
             return NULL;
         }
@@ -1283,60 +1888,115 @@ static ast_node_t* parse_statement(parser_t* parser)
 
         return ast_create_import(module);
     }
-    else if (tok.type == TOKEN_KEYWORD)
+    else if (tok.type == TOKEN_KEYWORD || (tok.type == TOKEN_IDENT && at_ident_declaration(parser)))
     {
-        token_t type_tok = parser_advance(parser);
+        // Storage classes, codegen only accepts them on globals.
+        bool is_thread_local = false;
+        bool is_extern       = false;
+        while (parser_peek(parser).type == TOKEN_KEYWORD)
+        {
+            token_t kw = parser_peek(parser);
+            if (strncmp(kw.lexeme, "thread_local", kw.len) == 0)
+                is_thread_local = true;
+            else if (strncmp(kw.lexeme, "extern", kw.len) == 0)
+                is_extern = true;
+            else
+                break;
+            parser_advance(parser);
+        }
+        size_t start = parser->pos;
+        char*  type  = parse_type(parser);
+        if (error)
+            return NULL;
         token_t name_tok = parser_peek(parser);
         if (name_tok.type != TOKEN_IDENT)
         {
+            free(type);
             parser_error(parser, "Expected identifier after type");
             return NULL;
         }
         parser_advance(parser);
-        if (parser_peek(parser).type == TOKEN_LPAREN)
+        if (parser_peek(parser).type == TOKEN_LPAREN || parser_peek(parser).type == TOKEN_LT)
         {
-            parser->pos -= 2;
+            free(type);
+            if (is_thread_local || is_extern)
+            {
+                parser_error(parser, "Storage class is only allowed on variables");
+                return NULL;
+            }
+            parser->pos = start;
             return parse_func_def(parser);
         }
+        else if (parser_peek(parser).type == TOKEN_SEMI)
+        {
+            // Definitions without a value are zero-initialized.
+            parser_advance(parser);
+            char* name = strndup(name_tok.lexeme, name_tok.len);
+            if (!name)
+            {
+                free(type);
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for definition");
+                error = true;
+                return NULL;
+            }
+            ast_node_t* node = ast_create_assign(name, name_tok.len, type, NULL);
+            if (node)
+            {
+                node->data.assign.is_thread_local = is_thread_local;
+                node->data.assign.is_extern       = is_extern;
+            }
+            return node;
+        }
+        else if (is_extern)
+        {
+            free(type);
+            parser_error(parser, "Extern variables cannot have a value");
+            return NULL;
+        }
         else if (parser_peek(parser).type == TOKEN_ASSIGN)
         {
             parser_advance(parser);
             ast_node_t* value = parse_expression(parser, 0);
             if (error || !value)
             {
+                free(type);
                 parser_error(parser, "Expected expression after '=' in definition");
                 return NULL;
             }
             if (parser_peek(parser).type != TOKEN_SEMI)
             {
+                free(type);
                 parser_error(parser, "Expected ';' after definition");
                 ast_free(value);
                 return NULL;
             }
             parser_advance(parser);
             char* name = strndup(name_tok.lexeme, name_tok.len);
-            char* type = strndup(type_tok.lexeme, type_tok.len);
-            if (!name || !type)
+            if (!name)
             {
-                free(name);
                 free(type);
                 ast_free(value);
-                ERROR_FATAL("", 0, 0, "Memory allocation failed for definition");
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for definition");
                 error = true;
                 return NULL;
             }
-            return ast_create_assign(name, name_tok.len, type, value);
+            ast_node_t* node = ast_create_assign(name, name_tok.len, type, value);
+            if (node)
+                node->data.assign.is_thread_local = is_thread_local;
+            return node;
         }
         else
         {
-            parser_error(parser, "Expected '=' or '(' after identifier");
+            free(type);
+            parser_error(parser, "Expected '=', ';' or '(' after identifier");
             return NULL;
         }
     }
     else if (tok.type == TOKEN_IDENT)
     {
-        token_t name_tok = parser_advance(parser);
-        if (parser_peek(parser).type == TOKEN_LPAREN)
+        bool    is_generic = at_generic_call(parser);
+        token_t name_tok   = parser_advance(parser);
+        if (parser_peek(parser).type == TOKEN_LPAREN || is_generic)
         {
             parser->pos--;
             ast_node_t* call = parse_func_call(parser);
@@ -1371,7 +2031,7 @@ static ast_node_t* parse_statement(parser_t* parser)
             if (!name)
             {
                 ast_free(value);
-                ERROR_FATAL("", 0, 0, "Memory allocation failed for assignment");
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for assignment");
                 error = true;
                 return NULL;
             }
@@ -1388,12 +2048,19 @@ static ast_node_t* parse_statement(parser_t* parser)
     return NULL;
 }
 
+// Statements and factors are located at their first token, binary expressions at the operator.
+static ast_node_t* parse_statement(parser_t* parser)
+{
+    token_t tok = parser_peek(parser);
+    return ast_locate(parse_statement_node(parser), tok);
+}
+
 /* ================== */
 /* Main parser        */
 /* ================== */
 ast_node_t* ast_gen(token_t* tokens)
 {
-    parser_t parser = {.tokens = tokens, .pos = 0};
+    parser_t parser = {.tokens = tokens, .pos = 0, .type_params = NULL, .type_param_count = 0};
     error           = false;
 
     ast_node_t* func_defs      = NULL;
@@ -1413,9 +2080,11 @@ ast_node_t* ast_gen(token_t* tokens)
         if (!stmt)
             break;
 
-        if (stmt->type != NODE_FUNC_DEF && stmt->type != NODE_IMPORT)
+        bool is_global = stmt->type == NODE_ASSIGN && stmt->data.assign.type;
+        if (stmt->type != NODE_FUNC_DEF && stmt->type != NODE_IMPORT && !is_global)
         {
-            parser_error(&parser, "Only function definitions and imports are allowed at top level");
+            parser_error(&parser,
+                         "Only function definitions, globals and imports are allowed at top level");
             ast_free(stmt);
             for (size_t i = 0; i < func_def_count; i++)
                 ast_free_internal(&func_defs[i]);
@@ -1430,7 +2099,7 @@ ast_node_t* ast_gen(token_t* tokens)
                 (ast_node_t*) realloc(func_defs, capacity * sizeof(ast_node_t));
             if (!new_func_defs)
             {
-                ERROR_FATAL("", 0, 0, "Memory allocation failed for function definitions");
+                ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for function definitions");
                 error = true;
                 ast_free(stmt);
                 for (size_t i = 0; i < func_def_count; i++)
@@ -1457,6 +2126,92 @@ ast_node_t* ast_gen(token_t* tokens)
     return ast_create_program(func_defs, func_def_count);
 }
 
+/* ================== */
+/* Traversal          */
+/* ================== */
+void ast_walk(ast_node_t* node, ast_visit_fn_t fn, void* data)
+{
+    if (!node)
+        return;
+    fn(node, data);
+    switch (node->type)
+    {
+    case NODE_BINOP:
+        ast_walk(node->data.binop.left, fn, data);
+        ast_walk(node->data.binop.right, fn, data);
+        break;
+    case NODE_ASSIGN:
+        ast_walk(node->data.assign.target, fn, data);
+        ast_walk(node->data.assign.value, fn, data);
+        break;
+    case NODE_RETURN:
+        ast_walk(node->data.return_stmt.expr, fn, data);
+        break;
+    case NODE_FUNC_DEF:
+        ast_walk(node->data.func_def.root, fn, data);
+        break;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < node->data.func_call.arg_count; i++)
+            ast_walk(&node->data.func_call.args[i], fn, data);
+        break;
+    case NODE_BLOCK:
+        for (size_t i = 0; i < node->data.block.stmt_count; i++)
+            ast_walk(&node->data.block.stmts[i], fn, data);
+        break;
+    case NODE_PROGRAM:
+        for (size_t i = 0; i < node->data.program.func_def_count; i++)
+            ast_walk(&node->data.program.func_defs[i], fn, data);
+        break;
+    case NODE_IF:
+        ast_walk(node->data.if_stmt.condition, fn, data);
+        ast_walk(node->data.if_stmt.then_block, fn, data);
+        ast_walk(node->data.if_stmt.else_block, fn, data);
+        break;
+    case NODE_ELSEIF:
+        ast_walk(node->data.elseif_stmt.condition, fn, data);
+        ast_walk(node->data.elseif_stmt.then_block, fn, data);
+        ast_walk(node->data.elseif_stmt.else_block, fn, data);
+        break;
+    case NODE_ELSE:
+        ast_walk(node->data.else_stmt.block, fn, data);
+        break;
+    case NODE_CAST:
+        ast_walk(node->data.cast.expr, fn, data);
+        break;
+    case NODE_ADDR_OF:
+        ast_walk(node->data.addr_of.expr, fn, data);
+        break;
+    case NODE_DEREF:
+        ast_walk(node->data.deref.expr, fn, data);
+        break;
+    case NODE_WHILE:
+        ast_walk(node->data.while_stmt.condition, fn, data);
+        ast_walk(node->data.while_stmt.body, fn, data);
+        break;
+    case NODE_ASM:
+        for (size_t i = 0; i < node->data.asm_stmt.output_count; i++)
+            ast_walk(node->data.asm_stmt.outputs[i].expr, fn, data);
+        for (size_t i = 0; i < node->data.asm_stmt.input_count; i++)
+            ast_walk(node->data.asm_stmt.inputs[i].expr, fn, data);
+        break;
+    default:
+        break;
+    }
+}
+
+static void count_node(ast_node_t* node, void* data)
+{
+    (void) node;
+    (*(size_t*) data)++;
+}
+
+size_t ast_node_count(ast_node_t* node)
+{
+    size_t count = 0;
+    ast_walk(node, count_node, &count);
+    return count;
+}
+
 static void ast_free_internal(ast_node_t* node)
 {
     if (!node)
@@ -1483,6 +2238,7 @@ static void ast_free_internal(ast_node_t* node)
         if (node->data.assign.type)
             free(node->data.assign.type);
         ast_free(node->data.assign.value);
+        ast_free(node->data.assign.target);
         break;
     case NODE_RETURN:
         ast_free(node->data.return_stmt.expr);
@@ -1504,6 +2260,7 @@ static void ast_free_internal(ast_node_t* node)
             param = next;
         }
         ast_free(node->data.func_def.root);
+        free_type_list(node->data.func_def.type_params, node->data.func_def.type_param_count);
         break;
     case NODE_FUNC_CALL:
         if (node->data.func_call.name)
@@ -1516,6 +2273,7 @@ static void ast_free_internal(ast_node_t* node)
             }
             free(node->data.func_call.args);
         }
+        free_type_list(node->data.func_call.type_args, node->data.func_call.type_arg_count);
         break;
     case NODE_BLOCK:
         if (node->data.block.stmts)
@@ -1554,6 +2312,29 @@ static void ast_free_internal(ast_node_t* node)
         if (node->data.import.module)
             free(node->data.import.module);
         break;
+    case NODE_CAST:
+        if (node->data.cast.type)
+            free(node->data.cast.type);
+        ast_free(node->data.cast.expr);
+        break;
+    case NODE_ADDR_OF:
+        ast_free(node->data.addr_of.expr);
+        break;
+    case NODE_DEREF:
+        ast_free(node->data.deref.expr);
+        break;
+    case NODE_WHILE:
+        ast_free(node->data.while_stmt.condition);
+        ast_free(node->data.while_stmt.body);
+        break;
+    case NODE_ASM:
+        free(node->data.asm_stmt.text);
+        free_asm_operands(node->data.asm_stmt.outputs, node->data.asm_stmt.output_count);
+        free_asm_operands(node->data.asm_stmt.inputs, node->data.asm_stmt.input_count);
+        for (size_t i = 0; i < node->data.asm_stmt.clobber_count; i++)
+            free(node->data.asm_stmt.clobbers[i]);
+        free(node->data.asm_stmt.clobbers);
+        break;
     }
 }
 
@@ -0,0 +1,260 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#define _GNU_SOURCE
+#include <remark.h>
+#include <regex.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define MEM_CATEGORY MEM_OTHER
+#include <mem.h>
+
+// Remarks selected with -Rpass, -Rpass-missed and -Rpass-analysis are printed to stderr as they
+// are emitted, like diagnostics. With -fsave-optimization-record all of them are also kept and
+// written out per compiled module, as YAML documents in the format of LLVM's optimization
+// records or as a JSON array.
+typedef struct remark
+{
+    remark_kind_t kind;
+    const char*   pass; // NOTE: a string literal of the emitting pass
+    char*         function;
+    uint32_t      line; // NOTE: 0 when the remark has no position
+    uint32_t      column;
+    char*         message;
+} remark_t;
+
+typedef struct remark_filter_state
+{
+    bool    enabled;
+    bool    match_all;
+    regex_t pattern; // NOTE: only valid when enabled and not match_all
+} remark_filter_state_t;
+
+static remark_filter_state_t filters[REMARK_KIND_COUNT];
+static bool                  recording = false;
+static remark_format_t       format    = REMARK_FORMAT_YAML;
+static char*                 file      = NULL;
+static remark_t*             remarks   = NULL;
+static size_t                count     = 0;
+static size_t                capacity  = 0;
+
+static const char* kind_options[REMARK_KIND_COUNT] = {
+    [REMARK_PASSED]   = "-Rpass",
+    [REMARK_MISSED]   = "-Rpass-missed",
+    [REMARK_ANALYSIS] = "-Rpass-analysis",
+};
+
+static const char* kind_tags[REMARK_KIND_COUNT] = {
+    [REMARK_PASSED]   = "Passed",
+    [REMARK_MISSED]   = "Missed",
+    [REMARK_ANALYSIS] = "Analysis",
+};
+
+static void clear_filter(remark_filter_state_t* f)
+{
+    if (f->enabled && !f->match_all)
+        regfree(&f->pattern);
+    f->enabled = false;
+}
+
+// Selects the remarks of `kind` to print, like clang the pattern is a regular expression matched
+// against the pass name. Returns false if it doesn't compile.
+bool remark_filter(remark_kind_t kind, const char* pattern)
+{
+    remark_filter_state_t* f = &filters[kind];
+    clear_filter(f);
+    f->match_all = pattern == NULL;
+    if (pattern && regcomp(&f->pattern, pattern, REG_EXTENDED | REG_NOSUB) != 0)
+        return false;
+    f->enabled = true;
+    return true;
+}
+
+void remark_record(remark_format_t record_format)
+{
+    recording = true;
+    format    = record_format;
+}
+
+static bool selected(remark_kind_t kind, const char* pass)
+{
+    const remark_filter_state_t* f = &filters[kind];
+    return f->enabled && (f->match_all || regexec(&f->pattern, pass, 0, NULL, 0) == 0);
+}
+
+void remark_set_file(const char* name)
+{
+    free(file);
+    file = name ? strdup(name) : NULL;
+}
+
+void remark_emit(remark_kind_t kind, const char* pass, const char* function, uint32_t line,
+                 uint32_t column, const char* fmt, ...)
+{
+    bool print = selected(kind, pass);
+    if (!print && !recording)
+        return;
+    char*   message = NULL;
+    va_list args;
+    va_start(args, fmt);
+    int len = vasprintf(&message, fmt, args);
+    va_end(args);
+    if (len < 0)
+        return;
+    if (print)
+    {
+        fprintf(stderr, "%s:", file ? file : "cmicro");
+        if (line)
+            fprintf(stderr, "%u:%u:", line, column);
+        fprintf(stderr, " remark: %s [%s=%s]\n", message, kind_options[kind], pass);
+    }
+    if (!recording)
+    {
+        free(message);
+        return;
+    }
+    if (count == capacity)
+    {
+        size_t    new_capacity = capacity ? capacity * 2 : 64;
+        remark_t* new_remarks  = realloc(remarks, new_capacity * sizeof(remark_t));
+        if (!new_remarks)
+        {
+            free(message);
+            return;
+        }
+        remarks  = new_remarks;
+        capacity = new_capacity;
+    }
+    remarks[count++] = (remark_t){kind, pass, strdup(function ? function : ""), line, column,
+                                  message};
+}
+
+/* ================== */
+/* Records            */
+/* ================== */
+
+static void write_yaml_string(FILE* out, const char* s)
+{
+    fputc('\'', out);
+    for (; *s; s++)
+    {
+        if (*s == '\'')
+            fputc('\'', out);
+        fputc(*s, out);
+    }
+    fputc('\'', out);
+}
+
+static void write_json_string(FILE* out, const char* s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20)
+            fprintf(out, "\\u%04x", *s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void write_yaml(FILE* out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const remark_t* r = &remarks[i];
+        fprintf(out, "--- !%s\n", kind_tags[r->kind]);
+        fprintf(out, "Pass:            %s\n", r->pass);
+        if (r->line)
+        {
+            fprintf(out, "DebugLoc:        { File: ");
+            write_yaml_string(out, file ? file : "");
+            fprintf(out, ", Line: %u, Column: %u }\n", r->line, r->column);
+        }
+        fprintf(out, "Function:        ");
+        write_yaml_string(out, r->function ? r->function : "");
+        fprintf(out, "\nMessage:         ");
+        write_yaml_string(out, r->message);
+        fprintf(out, "\n...\n");
+    }
+}
+
+static void write_json(FILE* out)
+{
+    fprintf(out, "[");
+    for (size_t i = 0; i < count; i++)
+    {
+        const remark_t* r = &remarks[i];
+        fprintf(out, "%s\n{\"kind\": \"%s\", \"pass\": ", i ? "," : "", kind_tags[r->kind]);
+        write_json_string(out, r->pass);
+        fprintf(out, ", \"file\": ");
+        write_json_string(out, file ? file : "");
+        fprintf(out, ", \"line\": %u, \"column\": %u, \"function\": ", r->line, r->column);
+        write_json_string(out, r->function ? r->function : "");
+        fprintf(out, ", \"message\": ");
+        write_json_string(out, r->message);
+        fprintf(out, "}");
+    }
+    fprintf(out, "%s]\n", count ? "\n" : "");
+}
+
+static void clear_remarks(void)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(remarks[i].function);
+        free(remarks[i].message);
+    }
+    count = 0;
+}
+
+// The record of a module goes next to its output, <output>.opt.yaml or <output>.opt.json. A
+// streamed output (-o -) has no path, its record goes next to the source instead. The remarks
+// are dropped afterwards, so the next module starts a record of its own.
+bool remark_write(const char* output_path)
+{
+    if (!recording)
+        return true;
+    const char* base = output_path;
+    if (strcmp(output_path, "-") == 0)
+        base = file && strcmp(file, "-") != 0 ? file : "stdin";
+    char* path = NULL;
+    if (asprintf(&path, "%s.opt.%s", base, format == REMARK_FORMAT_JSON ? "json" : "yaml") < 0)
+    {
+        clear_remarks();
+        return false;
+    }
+    FILE* out = fopen(path, "w");
+    free(path);
+    if (out)
+    {
+        if (format == REMARK_FORMAT_JSON)
+            write_json(out);
+        else
+            write_yaml(out);
+    }
+    clear_remarks();
+    return out && fclose(out) == 0;
+}
+
+// Forgets the options and the remarks, e.g. between the requests of the compile server.
+void remark_reset(void)
+{
+    clear_remarks();
+    free(remarks);
+    remarks  = NULL;
+    capacity = 0;
+    for (int i = 0; i < REMARK_KIND_COUNT; i++)
+        clear_filter(&filters[i]);
+    recording = false;
+    format    = REMARK_FORMAT_YAML;
+    remark_set_file(NULL);
+}
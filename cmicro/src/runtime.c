@@ -0,0 +1,414 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <runtime.h>
+#include <string.h>
+
+// Runtime modules are assembly appended to the program's assembly when the program imports
+// them, so freestanding programs need no C library. Each function is split by size class: the
+// small sizes are handled with (overlapping) scalar moves, bulk sizes with the widest vector
+// registers the target ISA has, or string instructions with --simd=none (e.g. kernel code that
+// must not touch vector registers).
+
+/* ================== */
+/* std.mem            */
+/* ================== */
+
+// memcpy(rdi = dst, rsi = src, rdx = n), returns dst
+static const char memcpy_small[] = "\tmovq %rdi, %rax\n"
+                                   "\tcmpq $16, %rdx\n"
+                                   "\tjae .Lmemcpy_bulk\n"
+                                   "\tcmpq $8, %rdx\n"
+                                   "\tjb .Lmemcpy_4\n"
+                                   "\tmovq (%rsi), %rcx\n"
+                                   "\tmovq -8(%rsi,%rdx), %r8\n"
+                                   "\tmovq %rcx, (%rdi)\n"
+                                   "\tmovq %r8, -8(%rdi,%rdx)\n"
+                                   "\tret\n"
+                                   ".Lmemcpy_4:\n"
+                                   "\tcmpq $4, %rdx\n"
+                                   "\tjb .Lmemcpy_2\n"
+                                   "\tmovl (%rsi), %ecx\n"
+                                   "\tmovl -4(%rsi,%rdx), %r8d\n"
+                                   "\tmovl %ecx, (%rdi)\n"
+                                   "\tmovl %r8d, -4(%rdi,%rdx)\n"
+                                   "\tret\n"
+                                   ".Lmemcpy_2:\n"
+                                   "\tcmpq $2, %rdx\n"
+                                   "\tjb .Lmemcpy_1\n"
+                                   "\tmovzwl (%rsi), %ecx\n"
+                                   "\tmovzwl -2(%rsi,%rdx), %r8d\n"
+                                   "\tmovw %cx, (%rdi)\n"
+                                   "\tmovw %r8w, -2(%rdi,%rdx)\n"
+                                   "\tret\n"
+                                   ".Lmemcpy_1:\n"
+                                   "\ttestq %rdx, %rdx\n"
+                                   "\tjz .Lmemcpy_ret\n"
+                                   "\tmovzbl (%rsi), %ecx\n"
+                                   "\tmovb %cl, (%rdi)\n"
+                                   ".Lmemcpy_ret:\n"
+                                   "\tret\n"
+                                   ".Lmemcpy_bulk:\n";
+
+static const char memcpy_bulk_none[] = "\tmovq %rdx, %rcx\n"
+                                       "\trep movsb\n"
+                                       "\tret\n";
+
+// Head and tail are copied unaligned, everything in between with aligned stores.
+static const char memcpy_bulk_sse2[] = "\tmovdqu (%rsi), %xmm0\n"
+                                       "\tmovdqu -16(%rsi,%rdx), %xmm1\n"
+                                       "\tleaq 16(%rdi), %rcx\n"
+                                       "\tandq $-16, %rcx\n"
+                                       "\tmovq %rcx, %r8\n"
+                                       "\tsubq %rdi, %r8\n"
+                                       "\taddq %rsi, %r8\n"
+                                       "\tleaq -16(%rdi,%rdx), %r9\n"
+                                       "\tcmpq %r9, %rcx\n"
+                                       "\tjae .Lmemcpy_done\n"
+                                       ".Lmemcpy_loop:\n"
+                                       "\tmovdqu (%r8), %xmm2\n"
+                                       "\tmovdqa %xmm2, (%rcx)\n"
+                                       "\taddq $16, %rcx\n"
+                                       "\taddq $16, %r8\n"
+                                       "\tcmpq %r9, %rcx\n"
+                                       "\tjb .Lmemcpy_loop\n"
+                                       ".Lmemcpy_done:\n"
+                                       "\tmovdqu %xmm0, (%rdi)\n"
+                                       "\tmovdqu %xmm1, -16(%rdi,%rdx)\n"
+                                       "\tret\n";
+
+static const char memcpy_bulk_avx2[] = "\tcmpq $32, %rdx\n"
+                                       "\tja .Lmemcpy_wide\n"
+                                       "\tvmovdqu (%rsi), %xmm0\n"
+                                       "\tvmovdqu -16(%rsi,%rdx), %xmm1\n"
+                                       "\tvmovdqu %xmm0, (%rdi)\n"
+                                       "\tvmovdqu %xmm1, -16(%rdi,%rdx)\n"
+                                       "\tret\n"
+                                       ".Lmemcpy_wide:\n"
+                                       "\tvmovdqu (%rsi), %ymm0\n"
+                                       "\tvmovdqu -32(%rsi,%rdx), %ymm1\n"
+                                       "\tleaq 32(%rdi), %rcx\n"
+                                       "\tandq $-32, %rcx\n"
+                                       "\tmovq %rcx, %r8\n"
+                                       "\tsubq %rdi, %r8\n"
+                                       "\taddq %rsi, %r8\n"
+                                       "\tleaq -32(%rdi,%rdx), %r9\n"
+                                       "\tcmpq %r9, %rcx\n"
+                                       "\tjae .Lmemcpy_done\n"
+                                       ".Lmemcpy_loop:\n"
+                                       "\tvmovdqu (%r8), %ymm2\n"
+                                       "\tvmovdqa %ymm2, (%rcx)\n"
+                                       "\taddq $32, %rcx\n"
+                                       "\taddq $32, %r8\n"
+                                       "\tcmpq %r9, %rcx\n"
+                                       "\tjb .Lmemcpy_loop\n"
+                                       ".Lmemcpy_done:\n"
+                                       "\tvmovdqu %ymm0, (%rdi)\n"
+                                       "\tvmovdqu %ymm1, -32(%rdi,%rdx)\n"
+                                       "\tvzeroupper\n"
+                                       "\tret\n";
+
+// memset(rdi = dst, esi = byte, rdx = n), returns dst. r8 holds the byte repeated 8 times.
+static const char memset_small[] = "\tmovq %rdi, %rax\n"
+                                   "\tmovzbl %sil, %ecx\n"
+                                   "\tmovabsq $0x0101010101010101, %r8\n"
+                                   "\timulq %rcx, %r8\n"
+                                   "\tcmpq $16, %rdx\n"
+                                   "\tjae .Lmemset_bulk\n"
+                                   "\tcmpq $8, %rdx\n"
+                                   "\tjb .Lmemset_4\n"
+                                   "\tmovq %r8, (%rdi)\n"
+                                   "\tmovq %r8, -8(%rdi,%rdx)\n"
+                                   "\tret\n"
+                                   ".Lmemset_4:\n"
+                                   "\tcmpq $4, %rdx\n"
+                                   "\tjb .Lmemset_2\n"
+                                   "\tmovl %r8d, (%rdi)\n"
+                                   "\tmovl %r8d, -4(%rdi,%rdx)\n"
+                                   "\tret\n"
+                                   ".Lmemset_2:\n"
+                                   "\tcmpq $2, %rdx\n"
+                                   "\tjb .Lmemset_1\n"
+                                   "\tmovw %r8w, (%rdi)\n"
+                                   "\tmovw %r8w, -2(%rdi,%rdx)\n"
+                                   "\tret\n"
+                                   ".Lmemset_1:\n"
+                                   "\ttestq %rdx, %rdx\n"
+                                   "\tjz .Lmemset_ret\n"
+                                   "\tmovb %r8b, (%rdi)\n"
+                                   ".Lmemset_ret:\n"
+                                   "\tret\n"
+                                   ".Lmemset_bulk:\n";
+
+static const char memset_bulk_none[] = "\tmovl %esi, %eax\n"
+                                       "\tmovq %rdi, %r9\n"
+                                       "\tmovq %rdx, %rcx\n"
+                                       "\trep stosb\n"
+                                       "\tmovq %r9, %rax\n"
+                                       "\tret\n";
+
+static const char memset_bulk_sse2[] = "\tmovq %r8, %xmm0\n"
+                                       "\tpunpcklqdq %xmm0, %xmm0\n"
+                                       "\tmovdqu %xmm0, (%rdi)\n"
+                                       "\tmovdqu %xmm0, -16(%rdi,%rdx)\n"
+                                       "\tleaq 16(%rdi), %rcx\n"
+                                       "\tandq $-16, %rcx\n"
+                                       "\tleaq -16(%rdi,%rdx), %r9\n"
+                                       "\tcmpq %r9, %rcx\n"
+                                       "\tjae .Lmemset_done\n"
+                                       ".Lmemset_loop:\n"
+                                       "\tmovdqa %xmm0, (%rcx)\n"
+                                       "\taddq $16, %rcx\n"
+                                       "\tcmpq %r9, %rcx\n"
+                                       "\tjb .Lmemset_loop\n"
+                                       ".Lmemset_done:\n"
+                                       "\tret\n";
+
+static const char memset_bulk_avx2[] = "\tvmovq %r8, %xmm0\n"
+                                       "\tvpbroadcastq %xmm0, %ymm0\n"
+                                       "\tcmpq $32, %rdx\n"
+                                       "\tja .Lmemset_wide\n"
+                                       "\tvmovdqu %xmm0, (%rdi)\n"
+                                       "\tvmovdqu %xmm0, -16(%rdi,%rdx)\n"
+                                       "\tvzeroupper\n"
+                                       "\tret\n"
+                                       ".Lmemset_wide:\n"
+                                       "\tvmovdqu %ymm0, (%rdi)\n"
+                                       "\tvmovdqu %ymm0, -32(%rdi,%rdx)\n"
+                                       "\tleaq 32(%rdi), %rcx\n"
+                                       "\tandq $-32, %rcx\n"
+                                       "\tleaq -32(%rdi,%rdx), %r9\n"
+                                       "\tcmpq %r9, %rcx\n"
+                                       "\tjae .Lmemset_done\n"
+                                       ".Lmemset_loop:\n"
+                                       "\tvmovdqa %ymm0, (%rcx)\n"
+                                       "\taddq $32, %rcx\n"
+                                       "\tcmpq %r9, %rcx\n"
+                                       "\tjb .Lmemset_loop\n"
+                                       ".Lmemset_done:\n"
+                                       "\tvzeroupper\n"
+                                       "\tret\n";
+
+// memcmp(rdi = a, rsi = b, rdx = n). The vector loop finds the first differing block, the
+// scalar tail compares 8 bytes at a time and then finds the differing byte.
+static const char memcmp_head[] = "\txorl %ecx, %ecx\n";
+
+static const char memcmp_vec_sse2[] = ".Lmemcmp_vec:\n"
+                                      "\tleaq 16(%rcx), %r8\n"
+                                      "\tcmpq %rdx, %r8\n"
+                                      "\tja .Lmemcmp_word\n"
+                                      "\tmovdqu (%rdi,%rcx), %xmm0\n"
+                                      "\tmovdqu (%rsi,%rcx), %xmm1\n"
+                                      "\tpcmpeqb %xmm1, %xmm0\n"
+                                      "\tpmovmskb %xmm0, %r9d\n"
+                                      "\tcmpl $0xffff, %r9d\n"
+                                      "\tjne .Lmemcmp_diff\n"
+                                      "\tmovq %r8, %rcx\n"
+                                      "\tjmp .Lmemcmp_vec\n"
+                                      ".Lmemcmp_diff:\n"
+                                      "\tnotl %r9d\n"
+                                      "\tbsfl %r9d, %r9d\n"
+                                      "\taddq %r9, %rcx\n"
+                                      "\tmovzbl (%rdi,%rcx), %eax\n"
+                                      "\tmovzbl (%rsi,%rcx), %r8d\n"
+                                      "\tsubl %r8d, %eax\n"
+                                      "\tret\n";
+
+static const char memcmp_vec_avx2[] = ".Lmemcmp_vec:\n"
+                                      "\tleaq 32(%rcx), %r8\n"
+                                      "\tcmpq %rdx, %r8\n"
+                                      "\tja .Lmemcmp_leave\n"
+                                      "\tvmovdqu (%rdi,%rcx), %ymm0\n"
+                                      "\tvpcmpeqb (%rsi,%rcx), %ymm0, %ymm0\n"
+                                      "\tvpmovmskb %ymm0, %r9d\n"
+                                      "\tcmpl $-1, %r9d\n"
+                                      "\tjne .Lmemcmp_diff\n"
+                                      "\tmovq %r8, %rcx\n"
+                                      "\tjmp .Lmemcmp_vec\n"
+                                      ".Lmemcmp_diff:\n"
+                                      "\tvzeroupper\n"
+                                      "\tnotl %r9d\n"
+                                      "\tbsfl %r9d, %r9d\n"
+                                      "\taddq %r9, %rcx\n"
+                                      "\tmovzbl (%rdi,%rcx), %eax\n"
+                                      "\tmovzbl (%rsi,%rcx), %r8d\n"
+                                      "\tsubl %r8d, %eax\n"
+                                      "\tret\n"
+                                      ".Lmemcmp_leave:\n"
+                                      "\tvzeroupper\n";
+
+static const char memcmp_tail[] = ".Lmemcmp_word:\n"
+                                  "\tleaq 8(%rcx), %r8\n"
+                                  "\tcmpq %rdx, %r8\n"
+                                  "\tja .Lmemcmp_tail\n"
+                                  "\tmovq (%rdi,%rcx), %r9\n"
+                                  "\tcmpq (%rsi,%rcx), %r9\n"
+                                  "\tjne .Lmemcmp_tail\n"
+                                  "\tmovq %r8, %rcx\n"
+                                  "\tjmp .Lmemcmp_word\n"
+                                  ".Lmemcmp_tail:\n"
+                                  "\txorl %eax, %eax\n"
+                                  ".Lmemcmp_byte:\n"
+                                  "\tcmpq %rdx, %rcx\n"
+                                  "\tjae .Lmemcmp_ret\n"
+                                  "\tmovzbl (%rdi,%rcx), %eax\n"
+                                  "\tmovzbl (%rsi,%rcx), %r8d\n"
+                                  "\tincq %rcx\n"
+                                  "\tsubl %r8d, %eax\n"
+                                  "\tjz .Lmemcmp_byte\n"
+                                  ".Lmemcmp_ret:\n"
+                                  "\tret\n";
+
+// strlen(rdi = s). Reads are aligned, so they never cross into an unmapped page.
+static const char strlen_none[] = "\tmovq %rdi, %rax\n"
+                                  ".Lstrlen_head:\n"
+                                  "\ttestq $7, %rax\n"
+                                  "\tjz .Lstrlen_words\n"
+                                  "\tcmpb $0, (%rax)\n"
+                                  "\tje .Lstrlen_done\n"
+                                  "\tincq %rax\n"
+                                  "\tjmp .Lstrlen_head\n"
+                                  ".Lstrlen_words:\n"
+                                  "\tmovabsq $0x0101010101010101, %r8\n"
+                                  "\tmovabsq $0x8080808080808080, %r9\n"
+                                  ".Lstrlen_word:\n"
+                                  "\tmovq (%rax), %rdx\n"
+                                  "\tmovq %rdx, %rcx\n"
+                                  "\tsubq %r8, %rdx\n"
+                                  "\tnotq %rcx\n"
+                                  "\tandq %rcx, %rdx\n"
+                                  "\ttestq %r9, %rdx\n"
+                                  "\tjnz .Lstrlen_tail\n"
+                                  "\taddq $8, %rax\n"
+                                  "\tjmp .Lstrlen_word\n"
+                                  ".Lstrlen_tail:\n"
+                                  "\tcmpb $0, (%rax)\n"
+                                  "\tje .Lstrlen_done\n"
+                                  "\tincq %rax\n"
+                                  "\tjmp .Lstrlen_tail\n"
+                                  ".Lstrlen_done:\n"
+                                  "\tsubq %rdi, %rax\n"
+                                  "\tret\n";
+
+static const char strlen_sse2[] = "\tmovq %rdi, %rax\n"
+                                  "\tandq $-16, %rax\n"
+                                  "\tmovl %edi, %ecx\n"
+                                  "\tandl $15, %ecx\n"
+                                  "\tpxor %xmm0, %xmm0\n"
+                                  "\tmovdqa (%rax), %xmm1\n"
+                                  "\tpcmpeqb %xmm0, %xmm1\n"
+                                  "\tpmovmskb %xmm1, %edx\n"
+                                  "\tshrl %cl, %edx\n"
+                                  "\ttestl %edx, %edx\n"
+                                  "\tjz .Lstrlen_loop\n"
+                                  "\tbsfl %edx, %eax\n"
+                                  "\tret\n"
+                                  ".Lstrlen_loop:\n"
+                                  "\taddq $16, %rax\n"
+                                  "\tmovdqa (%rax), %xmm1\n"
+                                  "\tpcmpeqb %xmm0, %xmm1\n"
+                                  "\tpmovmskb %xmm1, %edx\n"
+                                  "\ttestl %edx, %edx\n"
+                                  "\tjz .Lstrlen_loop\n"
+                                  "\tbsfl %edx, %edx\n"
+                                  "\taddq %rdx, %rax\n"
+                                  "\tsubq %rdi, %rax\n"
+                                  "\tret\n";
+
+static const char strlen_avx2[] = "\tmovq %rdi, %rax\n"
+                                  "\tandq $-32, %rax\n"
+                                  "\tmovl %edi, %ecx\n"
+                                  "\tandl $31, %ecx\n"
+                                  "\tvpxor %xmm0, %xmm0, %xmm0\n"
+                                  "\tvpcmpeqb (%rax), %ymm0, %ymm1\n"
+                                  "\tvpmovmskb %ymm1, %edx\n"
+                                  "\tshrl %cl, %edx\n"
+                                  "\ttestl %edx, %edx\n"
+                                  "\tjz .Lstrlen_loop\n"
+                                  "\tvzeroupper\n"
+                                  "\tbsfl %edx, %eax\n"
+                                  "\tret\n"
+                                  ".Lstrlen_loop:\n"
+                                  "\taddq $32, %rax\n"
+                                  "\tvpcmpeqb (%rax), %ymm0, %ymm1\n"
+                                  "\tvpmovmskb %ymm1, %edx\n"
+                                  "\ttestl %edx, %edx\n"
+                                  "\tjz .Lstrlen_loop\n"
+                                  "\tvzeroupper\n"
+                                  "\tbsfl %edx, %edx\n"
+                                  "\taddq %rdx, %rax\n"
+                                  "\tsubq %rdi, %rax\n"
+                                  "\tret\n";
+
+typedef struct runtime_func
+{
+    const char* name;
+    const char* parts[SIMD_AVX2 + 1][3]; // NOTE: indexed by ISA, concatenated in order
+} runtime_func_t;
+
+static const runtime_func_t mem_funcs[] = {
+    {"memcpy",
+     {[SIMD_NONE] = {memcpy_small, memcpy_bulk_none},
+      [SIMD_SSE2] = {memcpy_small, memcpy_bulk_sse2},
+      [SIMD_AVX2] = {memcpy_small, memcpy_bulk_avx2}}},
+    {"memset",
+     {[SIMD_NONE] = {memset_small, memset_bulk_none},
+      [SIMD_SSE2] = {memset_small, memset_bulk_sse2},
+      [SIMD_AVX2] = {memset_small, memset_bulk_avx2}}},
+    {"memcmp",
+     {[SIMD_NONE] = {memcmp_head, memcmp_tail},
+      [SIMD_SSE2] = {memcmp_head, memcmp_vec_sse2, memcmp_tail},
+      [SIMD_AVX2] = {memcmp_head, memcmp_vec_avx2, memcmp_tail}}},
+    {"strlen",
+     {[SIMD_NONE] = {strlen_none}, [SIMD_SSE2] = {strlen_sse2}, [SIMD_AVX2] = {strlen_avx2}}},
+};
+
+/* ================== */
+/* Modules            */
+/* ================== */
+
+typedef struct runtime_module
+{
+    const char*           name;
+    const runtime_func_t* funcs;
+    size_t                func_count;
+} runtime_module_t;
+
+static const runtime_module_t modules[] = {
+    {"std.mem", mem_funcs, sizeof(mem_funcs) / sizeof(mem_funcs[0])},
+};
+
+static const runtime_module_t* find_module(const char* module)
+{
+    for (size_t i = 0; i < sizeof(modules) / sizeof(modules[0]); i++)
+    {
+        if (strcmp(modules[i].name, module) == 0)
+            return &modules[i];
+    }
+    return NULL;
+}
+
+// Writes the functions of a runtime module, returns the number of functions written (0 for
+// modules that have no runtime, like std.io which is provided by the C library).
+int runtime_write(FILE* out, const char* module, simd_isa_t isa)
+{
+    const runtime_module_t* m = module ? find_module(module) : NULL;
+    if (!m)
+        return 0;
+    for (size_t i = 0; i < m->func_count; i++)
+    {
+        const runtime_func_t* f = &m->funcs[i];
+        // Every object importing the module carries a copy, the COMDAT group keeps just one.
+        fprintf(out, ".section .text.%s,\"axG\",@progbits,%s,comdat\n", f->name, f->name);
+        fprintf(out, ".p2align 4\n.globl %s\n.type %s, @function\n%s:\n", f->name, f->name,
+                f->name);
+        for (size_t j = 0; j < 3 && f->parts[isa][j]; j++)
+            fputs(f->parts[isa][j], out);
+        fprintf(out, ".size %s, .-%s\n", f->name, f->name);
+    }
+    return (int) m->func_count;
+}
@@ -0,0 +1,312 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#define _GNU_SOURCE
+#include <server.h>
+#include <error.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define MEM_CATEGORY MEM_OTHER
+#include <mem.h>
+
+// A request is a 32-bit payload length, sent together with the client's stdin, stdout and stderr
+// (SCM_RIGHTS), followed by the payload: the client's working directory and its arguments, each
+// NUL-terminated. The server answers with the 32-bit exit status. The compiler writes straight
+// to the client's descriptors, so the client only waits for the status.
+
+enum
+{
+    CLIENT_FDS  = 3,
+    MAX_PAYLOAD = 1 << 20
+};
+
+static bool write_all(int fd, const void* buf, size_t len)
+{
+    const char* p = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* buf, size_t len)
+{
+    char* p = buf;
+    while (len > 0)
+    {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool socket_address(const char* socket_path, struct sockaddr_un* addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path))
+    {
+        ERROR_FATAL(NULL, 0, 0, "Socket path is too long");
+        return false;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return true;
+}
+
+/* ================== */
+/* Server             */
+/* ================== */
+
+// Closes the descriptors passed with a message that was rejected.
+static void close_rights(struct msghdr* msg)
+{
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            close(fd);
+        }
+    }
+}
+
+// Receives the request header, returns the payload length or -1.
+static int32_t receive_header(int conn, int* fds)
+{
+    uint32_t      len = 0;
+    char          control[CMSG_SPACE(CLIENT_FDS * sizeof(int))];
+    struct iovec  iov = {&len, sizeof(len)};
+    struct msghdr msg = {0};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t received = recvmsg(conn, &msg, MSG_WAITALL);
+    if (received < 0)
+        return -1;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (received != (ssize_t) sizeof(len) || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(CLIENT_FDS * sizeof(int)))
+    {
+        close_rights(&msg);
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), CLIENT_FDS * sizeof(int));
+    return len > MAX_PAYLOAD ? -1 : (int32_t) len;
+}
+
+// Runs a request with the client's working directory and descriptors, returns its exit status.
+static int serve(char* payload, size_t len, const int* fds, server_handler_t handler,
+                 module_cache_t* cache)
+{
+    int    argc = 0;
+    char** argv = calloc(len + 1, sizeof(char*));
+    if (!argv)
+        return 1;
+    for (size_t i = strlen(payload) + 1; i < len; i += strlen(payload + i) + 1)
+        argv[argc++] = payload + i;
+
+    int cwd = open(".", O_RDONLY | O_DIRECTORY);
+    if (cwd < 0 || chdir(payload) != 0)
+    {
+        dprintf(fds[2], "Error: Compile server cannot enter '%s'\n", payload);
+        if (cwd >= 0)
+            close(cwd);
+        free(argv);
+        return 1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    int saved[CLIENT_FDS];
+    for (int i = 0; i < CLIENT_FDS; i++)
+    {
+        saved[i] = dup(i);
+        dup2(fds[i], i);
+    }
+    int status = handler(argc, argv, cache);
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < CLIENT_FDS; i++)
+    {
+        dup2(saved[i], i);
+        close(saved[i]);
+    }
+    // Writes to a client that went away failed, the next request starts with clean streams.
+    clearerr(stdout);
+    clearerr(stderr);
+    if (fchdir(cwd) != 0)
+        ERROR_FATAL(NULL, 0, 0, "Compile server lost its working directory");
+    close(cwd);
+    free(argv);
+    return status;
+}
+
+// Serves command lines forwarded by client_run() one at a time, until a client sends
+// --shutdown. Parsed modules stay in the cache between requests.
+int server_run(const char* socket_path, server_handler_t handler)
+{
+    struct sockaddr_un addr;
+    if (!socket_address(socket_path, &addr))
+        return 1;
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to create server socket");
+        return 1;
+    }
+    unlink(socket_path);
+    if (bind(sock, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(sock, 16) != 0)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to listen on server socket");
+        close(sock);
+        return 1;
+    }
+    module_cache_t* cache = module_cache_create();
+    if (!cache)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for module cache");
+        close(sock);
+        return 1;
+    }
+    // A client interrupted during its build closes its descriptors and the connection, writing
+    // to them has to fail instead of killing the server.
+    signal(SIGPIPE, SIG_IGN);
+    printf("[*] Compile server listening on '%s'\n", socket_path);
+    fflush(stdout);
+
+    bool running = true;
+    while (running)
+    {
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0)
+            continue;
+        int     fds[CLIENT_FDS] = {-1, -1, -1};
+        int32_t len             = receive_header(conn, fds);
+        char*   payload         = len > 0 ? malloc(len + 1) : NULL;
+        int32_t status          = 1;
+        if (payload && read_all(conn, payload, len))
+        {
+            payload[len] = '\0';
+            size_t arg   = strlen(payload) + 1; // skip the working directory
+            arg += arg < (size_t) len ? strlen(payload + arg) + 1 : 0; // and the program name
+            if (arg < (size_t) len && strcmp(payload + arg, "--shutdown") == 0)
+            {
+                running = false;
+                status  = 0;
+            }
+            else
+            {
+                status = serve(payload, len, fds, handler, cache);
+            }
+        }
+        write_all(conn, &status, sizeof(status)); // NOTE: fails for a dropped client
+        free(payload);
+        for (int i = 0; i < CLIENT_FDS; i++)
+        {
+            if (fds[i] >= 0)
+                close(fds[i]);
+        }
+        close(conn);
+    }
+    close(sock);
+    unlink(socket_path);
+    module_cache_free(cache);
+    return 0;
+}
+
+/* ================== */
+/* Client             */
+/* ================== */
+
+// Forwards `argv` to the server at `socket_path`, with argv[0] being the first forwarded
+// argument, and returns the exit status of the compilation.
+int client_run(const char* socket_path, int argc, char** argv)
+{
+    struct sockaddr_un addr;
+    if (!socket_address(socket_path, &addr))
+        return 1;
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "Error: Failed to connect to compile server '%s'\n", socket_path);
+        if (sock >= 0)
+            close(sock);
+        return 1;
+    }
+
+    char* cwd = getcwd(NULL, 0);
+    if (!cwd)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Failed to get working directory");
+        close(sock);
+        return 1;
+    }
+    // The server's handler expects a program name in front of the arguments.
+    size_t len = strlen(cwd) + 1 + strlen("cmicro") + 1;
+    for (int i = 0; i < argc; i++)
+        len += strlen(argv[i]) + 1;
+    char* payload = malloc(len);
+    if (!payload || len > MAX_PAYLOAD)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Command line is too long for the compile server");
+        free(payload);
+        free(cwd);
+        close(sock);
+        return 1;
+    }
+    size_t n = 0;
+    n += sprintf(payload + n, "%s", cwd) + 1;
+    n += sprintf(payload + n, "cmicro") + 1;
+    for (int i = 0; i < argc; i++)
+        n += sprintf(payload + n, "%s", argv[i]) + 1;
+    free(cwd);
+
+    uint32_t      header          = (uint32_t) len;
+    int           fds[CLIENT_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char          control[CMSG_SPACE(sizeof(fds))];
+    struct iovec  iov = {&header, sizeof(header)};
+    struct msghdr msg = {0};
+    msg.msg_iov          = &iov;
+    msg.msg_iovlen       = 1;
+    msg.msg_control      = control;
+    msg.msg_controllen   = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level     = SOL_SOCKET;
+    cmsg->cmsg_type      = SCM_RIGHTS;
+    cmsg->cmsg_len       = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    int32_t status = 1;
+    if (sendmsg(sock, &msg, 0) != (ssize_t) sizeof(header) || !write_all(sock, payload, len) ||
+        !read_all(sock, &status, sizeof(status)))
+    {
+        fprintf(stderr, "Error: Lost connection to compile server '%s'\n", socket_path);
+        status = 1;
+    }
+    free(payload);
+    close(sock);
+    return status;
+}
@@ -0,0 +1,253 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <simd.h>
+#include <error.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#define MEM_CATEGORY MEM_SYMBOLS
+#include <mem.h>
+
+// QBE has no vector registers, so native vector operations are small assembly functions that
+// are appended to the assembly QBE produces. They take the destination in rdi and the operands
+// in rsi/rdx and only clobber xmm0-xmm2 (ymm0 with AVX2).
+typedef struct simd_stub_entry
+{
+    char*                   name;
+    simd_op_t               op;
+    const type_info_t*      type;
+    unsigned                imm;
+    simd_isa_t              isa;
+    struct simd_stub_entry* next;
+} simd_stub_entry_t;
+
+static simd_stub_entry_t* stubs = NULL;
+
+static const char* op_names[] = {
+    [SIMD_ADD] = "add",         [SIMD_SUB] = "sub",         [SIMD_MUL] = "mul",
+    [SIMD_DIV] = "div",         [SIMD_SHUFFLE] = "shuffle", [SIMD_REDUCE_ADD] = "reduce_add",
+};
+
+/* ================== */
+/* Instruction choice */
+/* ================== */
+
+// Writes the (non-VEX) mnemonic of an element-wise operation, returns false if the ISA has none.
+static bool binop_mnemonic(simd_op_t op, const type_info_t* elem, simd_isa_t isa, char* buf)
+{
+    if (elem->is_float)
+    {
+        const char* suffix = elem->size == 4 ? "ps" : "pd";
+        sprintf(buf, "%s%s", op_names[op], suffix);
+        return op <= SIMD_DIV;
+    }
+    static const char int_suffix[] = {[1] = 'b', [2] = 'w', [4] = 'd', [8] = 'q'};
+    switch (op)
+    {
+    case SIMD_ADD:
+    case SIMD_SUB:
+        sprintf(buf, "p%s%c", op_names[op], int_suffix[elem->size]);
+        return true;
+    case SIMD_MUL:
+        // pmulld is SSE4.1, only its VEX form is used here
+        if (elem->size == 2 || (elem->size == 4 && isa == SIMD_AVX2))
+        {
+            sprintf(buf, "pmull%c", int_suffix[elem->size]);
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+static bool is_supported(simd_op_t op, const type_info_t* type, simd_isa_t isa)
+{
+    char buf[16];
+    switch (op)
+    {
+    case SIMD_SHUFFLE:
+        return type->size == 16 && type->elem->size >= 4;
+    case SIMD_REDUCE_ADD:
+        return !type->elem->is_float && type->elem->size != 2;
+    default:
+        return binop_mnemonic(op, type->elem, isa, buf);
+    }
+}
+
+// Returns the stub implementing `op` on `type`, or NULL if the operation has to be scalarized.
+const char* simd_stub(simd_op_t op, const type_info_t* type, unsigned imm, simd_isa_t isa)
+{
+    if (isa == SIMD_NONE || !type_is_vector(type) || !is_supported(op, type, isa))
+        return NULL;
+    for (simd_stub_entry_t* s = stubs; s; s = s->next)
+    {
+        if (s->op == op && s->type == type && s->imm == imm && s->isa == isa)
+            return s->name;
+    }
+    simd_stub_entry_t* s = calloc(1, sizeof(simd_stub_entry_t));
+    if (!s)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for SIMD stub");
+        return NULL;
+    }
+    s->name = malloc(64);
+    if (!s->name)
+    {
+        free(s);
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for SIMD stub name");
+        return NULL;
+    }
+    if (op == SIMD_SHUFFLE)
+        snprintf(s->name, 64, "__micro_%s_%s_%02x", type->name, op_names[op], imm);
+    else
+        snprintf(s->name, 64, "__micro_%s_%s", type->name, op_names[op]);
+    s->op   = op;
+    s->type = type;
+    s->imm  = imm;
+    s->isa  = isa;
+    s->next = stubs;
+    stubs   = s;
+    return s->name;
+}
+
+// Integer lanes narrower than int are summed as int, so the sum of a byte vector can't overflow.
+const type_info_t* simd_reduce_type(const type_info_t* type)
+{
+    const type_info_t* elem = type->elem;
+    if (!elem->is_float && elem->size < 4)
+        return type_lookup("int");
+    return elem;
+}
+
+/* ================== */
+/* Stub emission      */
+/* ================== */
+static void write_binop(FILE* out, const simd_stub_entry_t* s)
+{
+    char   m[16];
+    size_t size = s->type->size;
+    binop_mnemonic(s->op, s->type->elem, s->isa, m);
+    if (s->isa == SIMD_AVX2 && size == 8)
+    {
+        fprintf(out, "\tvmovq (%%rsi), %%xmm0\n\tvmovq (%%rdx), %%xmm1\n");
+        fprintf(out, "\tv%s %%xmm1, %%xmm0, %%xmm0\n\tvmovq %%xmm0, (%%rdi)\n", m);
+    }
+    else if (s->isa == SIMD_AVX2)
+    {
+        // VEX forms take unaligned memory operands and a whole 256-bit vector at once
+        const char* reg = size == 32 ? "ymm0" : "xmm0";
+        fprintf(out, "\tvmovdqu (%%rsi), %%%s\n", reg);
+        fprintf(out, "\tv%s (%%rdx), %%%s, %%%s\n", m, reg, reg);
+        fprintf(out, "\tvmovdqu %%%s, (%%rdi)\n", reg);
+        if (size == 32)
+            fprintf(out, "\tvzeroupper\n");
+    }
+    else
+    {
+        const char* mov = size == 8 ? "movq" : "movdqu";
+        for (size_t off = 0; off < size; off += 16)
+        {
+            fprintf(out, "\t%s %zu(%%rsi), %%xmm0\n\t%s %zu(%%rdx), %%xmm1\n", mov, off, mov, off);
+            fprintf(out, "\t%s %%xmm1, %%xmm0\n\t%s %%xmm0, %zu(%%rdi)\n", m, mov, off);
+        }
+    }
+}
+
+static void write_shuffle(FILE* out, const simd_stub_entry_t* s)
+{
+    // pshufd selects dwords, a 64-bit lane is a pair of them
+    unsigned imm = s->imm;
+    if (s->type->lanes == 2)
+    {
+        unsigned lo = (imm & 3) * 2, hi = ((imm >> 2) & 3) * 2;
+        imm         = lo | (lo + 1) << 2 | hi << 4 | (hi + 1) << 6;
+    }
+    if (s->isa == SIMD_AVX2)
+    {
+        fprintf(out, "\tvpshufd $%u, (%%rsi), %%xmm0\n\tvmovdqu %%xmm0, (%%rdi)\n", imm);
+        return;
+    }
+    fprintf(out, "\tmovdqu (%%rsi), %%xmm0\n\tpshufd $%u, %%xmm0, %%xmm0\n", imm);
+    fprintf(out, "\tmovdqu %%xmm0, (%%rdi)\n");
+}
+
+static void write_reduce_add(FILE* out, const simd_stub_entry_t* s)
+{
+    size_t size      = s->type->size;
+    size_t elem_size = s->type->elem->size;
+    if (elem_size == 1)
+    {
+        // psadbw against zero sums each group of eight bytes into a 64-bit lane
+        fprintf(out, "\tpxor %%xmm2, %%xmm2\n");
+        fprintf(out, "\t%s (%%rdi), %%xmm0\n\tpsadbw %%xmm2, %%xmm0\n",
+                size == 8 ? "movq" : "movdqu");
+        if (size == 32)
+        {
+            fprintf(out, "\tmovdqu 16(%%rdi), %%xmm1\n\tpsadbw %%xmm2, %%xmm1\n");
+            fprintf(out, "\tpaddq %%xmm1, %%xmm0\n");
+        }
+        if (size >= 16)
+            fprintf(out, "\tpshufd $0x4e, %%xmm0, %%xmm1\n\tpaddq %%xmm1, %%xmm0\n");
+        fprintf(out, "\tmovd %%xmm0, %%eax\n");
+        return;
+    }
+    char add = elem_size == 4 ? 'd' : 'q';
+    fprintf(out, "\tmovdqu (%%rdi), %%xmm0\n");
+    if (size == 32)
+        fprintf(out, "\tmovdqu 16(%%rdi), %%xmm1\n\tpadd%c %%xmm1, %%xmm0\n", add);
+    fprintf(out, "\tpshufd $0x4e, %%xmm0, %%xmm1\n\tpadd%c %%xmm1, %%xmm0\n", add);
+    if (elem_size == 4)
+    {
+        fprintf(out, "\tpshufd $0xb1, %%xmm0, %%xmm1\n\tpaddd %%xmm1, %%xmm0\n");
+        fprintf(out, "\tmovd %%xmm0, %%eax\n");
+    }
+    else
+    {
+        fprintf(out, "\tmovq %%xmm0, %%rax\n");
+    }
+}
+
+// Appends every stub requested so far to `out`, returns the number of stubs written.
+int simd_write_stubs(FILE* out, bool function_sections)
+{
+    int count = 0;
+    for (simd_stub_entry_t* s = stubs; s; s = s->next, count++)
+    {
+        if (function_sections)
+            fprintf(out, ".section .text.%s,\"ax\",@progbits\n", s->name);
+        else
+            fprintf(out, ".text\n");
+        fprintf(out, ".p2align 4\n.type %s, @function\n%s:\n", s->name, s->name);
+        switch (s->op)
+        {
+        case SIMD_SHUFFLE:
+            write_shuffle(out, s);
+            break;
+        case SIMD_REDUCE_ADD:
+            write_reduce_add(out, s);
+            break;
+        default:
+            write_binop(out, s);
+            break;
+        }
+        fprintf(out, "\tret\n.size %s, .-%s\n", s->name, s->name);
+    }
+    return count;
+}
+
+void simd_reset(void)
+{
+    while (stubs)
+    {
+        simd_stub_entry_t* next = stubs->next;
+        free(stubs->name);
+        free(stubs);
+        stubs = next;
+    }
+}
@@ -0,0 +1,173 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#define _GNU_SOURCE
+#include <timing.h>
+#include <trace.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Each phase is also a span of the trace (--trace). CPU time includes the external processes
+// (qbe, clang) waited for during the phase.
+typedef struct phase_time
+{
+    uint64_t wall_ns;
+    uint64_t user_ns;
+    uint64_t sys_ns;
+    uint64_t runs;
+    uint64_t start_wall; // NOTE: only valid between timing_begin() and timing_end()
+    uint64_t start_user;
+    uint64_t start_sys;
+} phase_time_t;
+
+typedef struct timing
+{
+    phase_time_t phases[PHASE_COUNT];
+    uint64_t     counters[COUNTER_COUNT];
+} timing_t;
+
+static timing_t timing  = {0};
+static phase_t  current = PHASE_COUNT;
+
+static const char* phase_names[PHASE_COUNT] = {
+    [PHASE_READ] = "read",       [PHASE_LEX] = "lex", [PHASE_PARSE] = "parse",
+    [PHASE_CODEGEN] = "codegen", [PHASE_QBE] = "qbe", [PHASE_CLANG] = "clang",
+    [PHASE_LINK] = "link",
+};
+
+static const char* counter_names[COUNTER_COUNT] = {
+    [COUNTER_BYTES_IN] = "bytes_in",   [COUNTER_TOKENS] = "tokens",
+    [COUNTER_AST_NODES] = "ast_nodes", [COUNTER_IL_LINES] = "il_lines",
+    [COUNTER_IL_BYTES] = "il_bytes",   [COUNTER_BYTES_OUT] = "bytes_out",
+};
+
+static uint64_t timeval_ns(struct timeval tv)
+{
+    return (uint64_t) tv.tv_sec * 1000000000u + (uint64_t) tv.tv_usec * 1000u;
+}
+
+static void now(uint64_t* wall, uint64_t* user, uint64_t* sys)
+{
+    struct timespec ts;
+    struct rusage   self;
+    struct rusage   children;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    *wall = (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+    *user = timeval_ns(self.ru_utime) + timeval_ns(children.ru_utime);
+    *sys  = timeval_ns(self.ru_stime) + timeval_ns(children.ru_stime);
+}
+
+void timing_begin(phase_t phase)
+{
+    phase_time_t* p = &timing.phases[phase];
+    now(&p->start_wall, &p->start_user, &p->start_sys);
+    current = phase;
+    trace_begin(phase_names[phase], "phase");
+}
+
+void timing_end(phase_t phase)
+{
+    phase_time_t* p = &timing.phases[phase];
+    uint64_t      wall, user, sys;
+    now(&wall, &user, &sys);
+    p->wall_ns += wall - p->start_wall;
+    p->user_ns += user - p->start_user;
+    p->sys_ns += sys - p->start_sys;
+    p->runs++;
+    current = PHASE_COUNT;
+    trace_end();
+}
+
+phase_t timing_phase(void)
+{
+    return current;
+}
+
+void timing_add(counter_t counter, uint64_t value)
+{
+    timing.counters[counter] += value;
+}
+
+// Forked workers save their timings for the driver, which merges them into its own.
+bool timing_save(FILE* out)
+{
+    return fwrite(&timing, sizeof(timing), 1, out) == 1;
+}
+
+bool timing_merge(FILE* in)
+{
+    timing_t other;
+    if (fread(&other, sizeof(other), 1, in) != 1)
+        return false;
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        timing.phases[i].wall_ns += other.phases[i].wall_ns;
+        timing.phases[i].user_ns += other.phases[i].user_ns;
+        timing.phases[i].sys_ns += other.phases[i].sys_ns;
+        timing.phases[i].runs += other.phases[i].runs;
+    }
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        timing.counters[i] += other.counters[i];
+    return true;
+}
+
+// With several jobs the phase times add up over all workers, so they can exceed the build time.
+void timing_report(FILE* out, bool json)
+{
+    phase_time_t total = {0};
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        total.wall_ns += timing.phases[i].wall_ns;
+        total.user_ns += timing.phases[i].user_ns;
+        total.sys_ns += timing.phases[i].sys_ns;
+        total.runs += timing.phases[i].runs;
+    }
+    if (json)
+    {
+        fprintf(out, "{\"phases\": {");
+        for (int i = 0; i < PHASE_COUNT; i++)
+        {
+            const phase_time_t* p = &timing.phases[i];
+            fprintf(out,
+                    "%s\"%s\": {\"wall_ms\": %.3f, \"user_ms\": %.3f, \"sys_ms\": %.3f, "
+                    "\"runs\": %" PRIu64 "}",
+                    i ? ", " : "", phase_names[i], p->wall_ns / 1e6, p->user_ns / 1e6,
+                    p->sys_ns / 1e6, p->runs);
+        }
+        fprintf(out, "}, \"total_wall_ms\": %.3f, \"counters\": {", total.wall_ns / 1e6);
+        for (int i = 0; i < COUNTER_COUNT; i++)
+            fprintf(out, "%s\"%s\": %" PRIu64, i ? ", " : "", counter_names[i],
+                    timing.counters[i]);
+        fprintf(out, "}}\n");
+        return;
+    }
+    fprintf(out, "=== Time report ===\n");
+    fprintf(out, "%-10s %12s %12s %12s %6s\n", "Phase", "Wall (ms)", "User (ms)", "Sys (ms)",
+            "Runs");
+    for (int i = 0; i <= PHASE_COUNT; i++)
+    {
+        const phase_time_t* p = i < PHASE_COUNT ? &timing.phases[i] : &total;
+        fprintf(out, "%-10s %12.3f %12.3f %12.3f %6" PRIu64 "\n",
+                i < PHASE_COUNT ? phase_names[i] : "total", p->wall_ns / 1e6, p->user_ns / 1e6,
+                p->sys_ns / 1e6, p->runs);
+    }
+    fprintf(out, "Bytes in: %" PRIu64 ", out: %" PRIu64 "\n", timing.counters[COUNTER_BYTES_IN],
+            timing.counters[COUNTER_BYTES_OUT]);
+    fprintf(out, "Tokens: %" PRIu64 ", AST nodes: %" PRIu64 "\n", timing.counters[COUNTER_TOKENS],
+            timing.counters[COUNTER_AST_NODES]);
+    fprintf(out, "IL lines: %" PRIu64 " (%" PRIu64 " bytes)\n", timing.counters[COUNTER_IL_LINES],
+            timing.counters[COUNTER_IL_BYTES]);
+}
+
+void timing_reset(void)
+{
+    memset(&timing, 0, sizeof(timing));
+}
@@ -0,0 +1,208 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#define _GNU_SOURCE
+#include <trace.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Spans are written as Chrome trace events ("ph": "X"), which chrome://tracing and Perfetto
+// load. The process is the driver, each compile worker shows up as its own thread.
+typedef struct trace_event
+{
+    char     name[64];
+    char     category[16];
+    char     module[128];
+    uint64_t start_ns;
+    uint64_t dur_ns; // NOTE: 0 while the span is open
+    int32_t  tid;
+} trace_event_t;
+
+enum
+{
+    MAX_DEPTH = 16
+};
+
+static bool           enabled     = false;
+static pid_t          trace_pid   = 0; // NOTE: of the driver, inherited by the workers
+static char           module[128] = "";
+static trace_event_t* events      = NULL;
+static size_t         count       = 0;
+static size_t         capacity    = 0;
+static size_t         open[MAX_DEPTH];
+static size_t         depth = 0; // NOTE: can exceed MAX_DEPTH, deeper spans are dropped
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static void copy_name(char* dst, size_t size, const char* src)
+{
+    size_t len = src ? strlen(src) : 0;
+    if (len >= size) // keep the end of long paths, it names the file
+    {
+        src += len - (size - 1);
+        len = size - 1;
+    }
+    memcpy(dst, src ? src : "", len);
+    dst[len] = '\0';
+}
+
+static bool reserve(size_t n)
+{
+    if (count + n <= capacity)
+        return true;
+    size_t         new_capacity = capacity ? capacity * 2 : 256;
+    trace_event_t* new_events;
+    while (new_capacity < count + n)
+        new_capacity *= 2;
+    new_events = realloc(events, new_capacity * sizeof(trace_event_t));
+    if (!new_events)
+        return false;
+    events   = new_events;
+    capacity = new_capacity;
+    return true;
+}
+
+void trace_enable(bool enable)
+{
+    enabled   = enable;
+    trace_pid = getpid();
+}
+
+bool trace_enabled(void)
+{
+    return enabled;
+}
+
+void trace_set_module(const char* name)
+{
+    copy_name(module, sizeof(module), name);
+}
+
+void trace_begin(const char* name, const char* category)
+{
+    if (!enabled)
+        return;
+    if (depth < MAX_DEPTH && reserve(1))
+    {
+        trace_event_t* e = &events[count];
+        copy_name(e->name, sizeof(e->name), name);
+        copy_name(e->category, sizeof(e->category), category);
+        memcpy(e->module, module, sizeof(module));
+        e->tid      = getpid();
+        e->dur_ns   = 0;
+        e->start_ns = now_ns();
+        open[depth] = count++;
+    }
+    else if (depth < MAX_DEPTH)
+    {
+        open[depth] = SIZE_MAX; // NOTE: out of memory, the span is dropped
+    }
+    depth++;
+}
+
+void trace_end(void)
+{
+    if (!enabled || depth == 0)
+        return;
+    depth--;
+    if (depth < MAX_DEPTH && open[depth] != SIZE_MAX)
+    {
+        trace_event_t* e = &events[open[depth]];
+        e->dur_ns        = now_ns() - e->start_ns;
+    }
+}
+
+// Forked workers save their spans for the driver, which merges them into its own.
+bool trace_save(FILE* out)
+{
+    uint64_t n = count;
+    return fwrite(&n, sizeof(n), 1, out) == 1 &&
+           (count == 0 || fwrite(events, sizeof(trace_event_t), count, out) == count);
+}
+
+bool trace_merge(FILE* in)
+{
+    uint64_t n = 0;
+    if (fread(&n, sizeof(n), 1, in) != 1 || !reserve(n))
+        return false;
+    if (n > 0 && fread(&events[count], sizeof(trace_event_t), n, in) != n)
+        return false;
+    count += n;
+    return true;
+}
+
+static void write_string(FILE* out, const char* s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20)
+            fprintf(out, "\\u%04x", *s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+// Times are in microseconds since the first span, as the trace event format expects.
+bool trace_write(const char* path)
+{
+    FILE* out = fopen(path, "w");
+    if (!out)
+        return false;
+    uint64_t origin = UINT64_MAX;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (events[i].start_ns < origin)
+            origin = events[i].start_ns;
+    }
+    fprintf(out, "{\"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                 "\"args\": {\"name\": \"cmicro\"}}",
+            (int) trace_pid, (int) trace_pid);
+    for (size_t i = 0; i < count; i++)
+    {
+        const trace_event_t* e = &events[i];
+        fprintf(out, ",\n{\"name\": ");
+        write_string(out, e->name);
+        fprintf(out, ", \"cat\": ");
+        write_string(out, e->category);
+        fprintf(out, ", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d",
+                (e->start_ns - origin) / 1e3, e->dur_ns / 1e3, (int) trace_pid, (int) e->tid);
+        if (e->module[0])
+        {
+            fprintf(out, ", \"args\": {\"module\": ");
+            write_string(out, e->module);
+            fprintf(out, "}");
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n], \"displayTimeUnit\": \"ms\"}\n");
+    return fclose(out) == 0;
+}
+
+// Drops the recorded spans, e.g. in a forked worker, whose parent keeps them already.
+void trace_reset(void)
+{
+    free(events);
+    events    = NULL;
+    count     = 0;
+    capacity  = 0;
+    depth     = 0;
+    module[0] = '\0';
+}
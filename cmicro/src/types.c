@@ -0,0 +1,178 @@
+/*
+ * cmicro - Micro compiler
+ * Copyright (C) 2025 Kevin Alavik <kevin@alavik.se>
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <types.h>
+#include <error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define MEM_CATEGORY MEM_SYMBOLS
+#include <mem.h>
+
+/* ================== */
+/* Built-in types     */
+/* ================== */
+static const type_info_t builtin_types[] = {
+    {"void", 0, 0, false, false, false, NULL, 0, NULL, NULL},
+    {"char", 'w', 1, true, false, false, NULL, 0, NULL, NULL},
+    {"uchar", 'w', 1, false, false, false, NULL, 0, NULL, NULL},
+    {"short", 'w', 2, true, false, false, NULL, 0, NULL, NULL},
+    {"ushort", 'w', 2, false, false, false, NULL, 0, NULL, NULL},
+    {"int", 'w', 4, true, false, false, NULL, 0, NULL, NULL},
+    {"uint", 'w', 4, false, false, false, NULL, 0, NULL, NULL},
+    {"long", 'l', 8, true, false, false, NULL, 0, NULL, NULL},
+    {"ulong", 'l', 8, false, false, false, NULL, 0, NULL, NULL},
+    {"float", 's', 4, true, true, false, NULL, 0, NULL, NULL},
+    {"double", 'd', 8, true, true, false, NULL, 0, NULL, NULL},
+    {"string", 'l', 8, false, false, true, &builtin_types[1], 0, NULL, NULL},
+    // Vector values are passed around by the address of their (stack) storage.
+    {"v8u8", 'l', 8, false, false, false, NULL, 8, &builtin_types[2], NULL},
+    {"v16u8", 'l', 16, false, false, false, NULL, 16, &builtin_types[2], NULL},
+    {"v32u8", 'l', 32, false, false, false, NULL, 32, &builtin_types[2], NULL},
+    {"v8i16", 'l', 16, false, false, false, NULL, 8, &builtin_types[3], NULL},
+    {"v4i32", 'l', 16, false, false, false, NULL, 4, &builtin_types[5], NULL},
+    {"v8i32", 'l', 32, false, false, false, NULL, 8, &builtin_types[5], NULL},
+    {"v2i64", 'l', 16, false, false, false, NULL, 2, &builtin_types[7], NULL},
+    {"v4f32", 'l', 16, false, false, false, NULL, 4, &builtin_types[9], NULL},
+    {"v8f32", 'l', 32, false, false, false, NULL, 8, &builtin_types[9], NULL},
+    {"v2f64", 'l', 16, false, false, false, NULL, 2, &builtin_types[10], NULL},
+    {"v4f64", 'l', 32, false, false, false, NULL, 4, &builtin_types[10], NULL},
+};
+static const size_t builtin_type_count = sizeof(builtin_types) / sizeof(builtin_types[0]);
+
+// Pointer types are created on demand and interned, so they can be compared by address.
+static type_info_t* pointer_types = NULL;
+
+const type_info_t* type_pointer_to(const type_info_t* base)
+{
+    if (!base)
+        return NULL;
+    for (type_info_t* t = pointer_types; t; t = t->next)
+    {
+        if (t->pointee == base)
+            return t;
+    }
+    type_info_t* t = calloc(1, sizeof(type_info_t));
+    if (!t)
+    {
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for pointer type");
+        return NULL;
+    }
+    size_t base_len = strlen(base->name);
+    char*  name     = malloc(base_len + 2);
+    if (!name)
+    {
+        free(t);
+        ERROR_FATAL(NULL, 0, 0, "Memory allocation failed for pointer type name");
+        return NULL;
+    }
+    memcpy(name, base->name, base_len);
+    name[base_len]     = '*';
+    name[base_len + 1] = '\0';
+    t->name            = name;
+    t->qbe_type        = 'l';
+    t->size            = 8;
+    t->is_pointer      = true;
+    t->pointee         = base;
+    t->next            = pointer_types;
+    pointer_types      = t;
+    return t;
+}
+
+const type_info_t* type_lookup_n(const char* name, size_t len)
+{
+    if (!name)
+        return NULL;
+    // Qualifiers don't change the type itself, see type_is_restrict().
+    while (len > 9 && strncmp(name + len - 9, " restrict", 9) == 0)
+        len -= 9;
+    size_t stars = 0;
+    while (len > 0 && name[len - 1] == '*')
+        len--, stars++;
+    const type_info_t* t = NULL;
+    for (size_t i = 0; i < builtin_type_count; i++)
+    {
+        if (strlen(builtin_types[i].name) == len && strncmp(builtin_types[i].name, name, len) == 0)
+        {
+            t = &builtin_types[i];
+            break;
+        }
+    }
+    while (t && stars--)
+        t = type_pointer_to(t);
+    return t;
+}
+
+const type_info_t* type_lookup(const char* name)
+{
+    return name ? type_lookup_n(name, strlen(name)) : NULL;
+}
+
+bool type_is_restrict(const char* name)
+{
+    size_t len = name ? strlen(name) : 0;
+    return len > 9 && strcmp(name + len - 9, " restrict") == 0;
+}
+
+bool type_is_integer(const type_info_t* t)
+{
+    return t && t->qbe_type && !t->is_float && !t->is_pointer && !t->lanes;
+}
+
+bool type_is_vector(const type_info_t* t)
+{
+    return t && t->lanes > 0;
+}
+
+const char* type_load_op(const type_info_t* t)
+{
+    if (!t->is_float && !t->is_pointer && t->size == 1)
+        return t->is_signed ? "loadsb" : "loadub";
+    if (!t->is_float && !t->is_pointer && t->size == 2)
+        return t->is_signed ? "loadsh" : "loaduh";
+    switch (t->qbe_type)
+    {
+    case 'l':
+        return "loadl";
+    case 's':
+        return "loads";
+    case 'd':
+        return "loadd";
+    default:
+        return "loadw";
+    }
+}
+
+const char* type_store_op(const type_info_t* t)
+{
+    if (!t->is_float && !t->is_pointer && t->size == 1)
+        return "storeb";
+    if (!t->is_float && !t->is_pointer && t->size == 2)
+        return "storeh";
+    switch (t->qbe_type)
+    {
+    case 'l':
+        return "storel";
+    case 's':
+        return "stores";
+    case 'd':
+        return "stored";
+    default:
+        return "storew";
+    }
+}
+
+void types_reset(void)
+{
+    while (pointer_types)
+    {
+        type_info_t* next = pointer_types->next;
+        free((char*) pointer_types->name);
+        free(pointer_types);
+        pointer_types = next;
+    }
+}
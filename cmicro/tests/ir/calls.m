@@ -0,0 +1,27 @@
+/* Calls: recursion, small helpers and variadic externs. */
+int printf(...);
+
+int fib(int n)
+{
+    if (n < 2)
+    {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+int square(int x)
+{
+    return x * x;
+}
+
+int sum_squares(int a, int b, int c)
+{
+    return square(a) + square(b) + square(c);
+}
+
+int main()
+{
+    printf("%d %d\n", fib(20), sum_squares(1, 2, 3));
+    return 0;
+}
@@ -0,0 +1,83 @@
+#!/bin/sh
+# Compiles every tests/ir/*.m to QBE IL at each -O level and counts the instructions of each
+# function by kind. The counts are compared with golden.txt: the check fails when a count went
+# up or a function was added or removed. Counts that went down are listed, run with --update to
+# take them (or an intentional increase) into golden.txt.
+# Usage: tests/ir/check.sh path/to/cmicro [--update]
+set -e
+CMICRO=$1
+DIR=$(cd "$(dirname "$0")" && pwd)
+GOLDEN=$DIR/golden.txt
+TMP=${TMPDIR:-/tmp}/cmicro-ir.$$
+trap 'rm -f "$TMP.qbe" "$TMP.txt"' EXIT
+
+echo "# file level function total loads stores calls branches allocs" > "$TMP.txt"
+for src in "$DIR"/*.m; do
+    for level in 0 1; do
+        "$CMICRO" -O$level -f qbe -o "$TMP.qbe" "$src" > /dev/null
+        awk -v file="$(basename "$src")" -v level="O$level" '
+            /function .*\$/ {
+                name = substr($0, index($0, "$") + 1)
+                sub(/[ (].*/, "", name)
+                total = loads = stores = calls = branches = allocs = 0
+                next
+            }
+            name == "" || /^@/ { next }
+            /^}/ {
+                print file, level, name, total, loads, stores, calls, branches, allocs
+                name = ""
+                next
+            }
+            {
+                total++
+                if ($0 ~ /=[a-z]+ load/) loads++
+                else if ($0 ~ /^store/) stores++
+                else if ($0 ~ /(^|= *[a-z]+ )call /) calls++
+                else if ($0 ~ /^(jnz|jmp) /) branches++
+                else if ($0 ~ /=l alloc/) allocs++
+            }' "$TMP.qbe" >> "$TMP.txt"
+    done
+done
+
+if [ "$2" = "--update" ]; then
+    cp "$TMP.txt" "$GOLDEN"
+    echo "Updated $GOLDEN"
+    exit 0
+fi
+
+awk '
+    BEGIN {
+        split("total loads stores calls branches allocs", kinds, " ")
+    }
+    /^#/ { next }
+    NR == FNR {
+        golden[$1 " " $2 " " $3] = $0
+        next
+    }
+    {
+        key = $1 " " $2 " " $3
+        if (!(key in golden)) {
+            print "FAIL " key ": new function, not in golden.txt"
+            failed = 1
+            next
+        }
+        split(golden[key], old, " ")
+        for (i = 1; i <= 6; i++) {
+            if ($(i + 3) > old[i + 3]) {
+                print "FAIL " key ": " kinds[i] " " old[i + 3] " -> " $(i + 3)
+                failed = 1
+            } else if ($(i + 3) < old[i + 3]) {
+                print "better " key ": " kinds[i] " " old[i + 3] " -> " $(i + 3)
+            }
+        }
+        delete golden[key]
+    }
+    END {
+        for (key in golden) {
+            print "FAIL " key ": function is gone, not in the output"
+            failed = 1
+        }
+        if (failed)
+            print "IR counts regressed, run tests/ir/check.sh CMICRO --update if intended"
+        exit failed
+    }' "$GOLDEN" "$TMP.txt"
@@ -0,0 +1,19 @@
+/* Generic functions: one instance per set of type arguments. */
+T max<T>(T a, T b)
+{
+    if (a > b)
+    {
+        return a;
+    }
+    return b;
+}
+
+T clamp<T>(T x, T lo, T hi)
+{
+    return max(lo, x) - max(x, hi) + hi;
+}
+
+long use(int a, long b)
+{
+    return max(a, 3) + clamp(b, 0, 10);
+}
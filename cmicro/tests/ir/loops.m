@@ -0,0 +1,47 @@
+/* Loops over locals: promotion to temporaries and the load cache. */
+int sum_to(int n)
+{
+    int sum = 0;
+    int i   = 0;
+    while (i < n)
+    {
+        sum = sum + i;
+        i   = i + 1;
+    }
+    return sum;
+}
+
+long collatz(long n)
+{
+    long steps = 0;
+    while (n != 1)
+    {
+        if (n % 2 == 0)
+        {
+            n = n / 2;
+        }
+        else
+        {
+            n = 3 * n + 1;
+        }
+        steps = steps + 1;
+    }
+    return steps;
+}
+
+int nested(int n)
+{
+    int total = 0;
+    int i     = 0;
+    while (i < n)
+    {
+        int j = 0;
+        while (j < i)
+        {
+            total = total + i * j;
+            j     = j + 1;
+        }
+        i = i + 1;
+    }
+    return total;
+}
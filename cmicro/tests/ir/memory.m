@@ -0,0 +1,50 @@
+/* Pointers and address-taken locals: loads and stores through memory, stack slots. */
+uchar* malloc(long size);
+
+void swap(int* a, int* b)
+{
+    int t = *a;
+    *a    = *b;
+    *b    = t;
+}
+
+int sort3(int x, int y, int z)
+{
+    if (x > y)
+    {
+        swap(&x, &y);
+    }
+    if (y > z)
+    {
+        swap(&y, &z);
+    }
+    if (x > y)
+    {
+        swap(&x, &y);
+    }
+    return x * 100 + y * 10 + z;
+}
+
+long sum_array(long* p, int n)
+{
+    long sum = 0;
+    int  i   = 0;
+    while (i < n)
+    {
+        sum = sum + *(p + i) + *(p + i);
+        i   = i + 1;
+    }
+    return sum;
+}
+
+long fill_and_sum(int n)
+{
+    long* p = (long*) malloc(n * 8);
+    int   i = 0;
+    while (i < n)
+    {
+        *(p + i) = i;
+        i        = i + 1;
+    }
+    return sum_array(p, n);
+}
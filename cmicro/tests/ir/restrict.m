@@ -0,0 +1,15 @@
+/* Restrict pointers: accesses through pointers derived from them may alias them. */
+int derived(int* restrict p, int n)
+{
+    int* q = p + n;
+    *p     = 1;
+    *q     = 2;
+    return *p;
+}
+
+int disjoint(int* restrict p, int* restrict q)
+{
+    *p = 1;
+    *q = 2;
+    return *p;
+}